@@ -0,0 +1,268 @@
+/* main.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Headless benchmark for the host side of LH2: loads a scene, then animates
+   and synchronizes it for a number of frames using the null core. Does not
+   require a GPU or a display. Alternatively, measures the build time and
+   quality of the host-side BVHs for the bundled scenes, or the ray
+   throughput of single-ray, packet and stream traversal.
+*/
+
+#include "platform.h"
+#include "rendersystem.h"
+
+static RenderAPI* renderer = 0;
+
+//  +-----------------------------------------------------------------------------+
+//  |  PrepareScene                                                               |
+//  |  Initialize a scene: a static environment and a crowd of skinned            |
+//  |  characters.                                                          LH2'19|
+//  +-----------------------------------------------------------------------------+
+void PrepareScene( const int crowdSize )
+{
+	renderer->AddScene( "scene.gltf", "../imguiapp/data/pica/", mat4::Translate( 0, -10.2f, 0 ) );
+	const int side = (int)ceilf( sqrtf( (float)crowdSize ) );
+	for (int i = 0; i < crowdSize; i++)
+		renderer->AddScene( "CesiumMan.glb", "../imguiapp/data/", mat4::Translate( (float)(i % side) * 2 - side, -2, (float)(i / side) * 2 - side ) );
+	int lightMat = renderer->AddMaterial( make_float3( 100, 100, 80 ) );
+	int lightQuad = renderer->AddQuad( make_float3( 0, -1, 0 ), make_float3( 0, 26.0f, 0 ), 6.9f, 6.9f, lightMat );
+	renderer->AddInstance( lightQuad );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  BVHBenchmark                                                               |
+//  |  Build a HostBVH for each mesh of the bundled scenes; report the build      |
+//  |  time, the SAH cost and the single-threaded throughput for random rays      |
+//  |  that start inside the mesh bounds. Returns false if the SAH fails to       |
+//  |  create multi-triangle leaves for a non-trivial mesh.                 LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool BVHBenchmark( const int builds )
+{
+	static const char* scenes[][2] = {
+		{ "../imguiapp/data/pica/", "scene.gltf" }, { "../imguiapp/data/", "CesiumMan.glb" },
+		{ "../imguiapp/data/", "AnimatedMorphSphere.glb" }, { "../imguiapp/data/", "legocar.obj" }
+	};
+	renderer = RenderAPI::CreateRenderAPI( "RenderCore_Null" );
+	HostScene* scene = renderer->GetScene();
+	printf( "%-32s %9s %9s %9s %10s %8s %9s\n", "mesh", "tris", "nodes", "tris/leaf", "build", "SAH", "Mrays/s" );
+	uint seed = 0x12345, totalTris = 0;
+	bool passed = true;
+	float totalBuild = 0;
+	for (int s = 0; s < sizeof( scenes ) / sizeof( scenes[0] ); s++)
+	{
+		const int meshBase = (int)scene->meshPool.size();
+		if (strstr( scenes[s][1], ".obj" )) renderer->AddMesh( scenes[s][1], scenes[s][0], 1.0f );
+		else renderer->AddScene( scenes[s][1], scenes[s][0] );
+		for (int i = meshBase; i < (int)scene->meshPool.size(); i++)
+		{
+			const HostMesh* mesh = scene->meshPool[i];
+			HostBVH bvh;
+			float buildTime = 1e34f;
+			for (int b = 0; b < builds; b++) bvh.Build( mesh ), buildTime = min( buildTime, bvh.buildTime );
+			const aabb bounds = bvh.Bounds();
+			vector<HostRay> rays( 100000 );
+			for (HostRay& ray : rays)
+			{
+				const float3 O = make_float3( bounds.bmin[0] + RandomFloat( seed ) * bounds.Extend( 0 ),
+					bounds.bmin[1] + RandomFloat( seed ) * bounds.Extend( 1 ), bounds.bmin[2] + RandomFloat( seed ) * bounds.Extend( 2 ) );
+				ray = HostRay( O, normalize( make_float3( RandomFloat( seed ) - 0.5f, RandomFloat( seed ) - 0.5f, RandomFloat( seed ) - 0.5f ) ) );
+			}
+			Timer timer;
+			for (HostRay& ray : rays) bvh.Intersect( ray );
+			const float traceTime = timer.elapsed();
+			const string name = string( scenes[s][1] ) + "/" + mesh->name;
+			uint leafCount = 0;
+			for (uint n = 0; n < bvh.nodesUsed; n++) if (n != 1 && bvh.nodes[n].IsLeaf()) leafCount++;
+			const float trisPerLeaf = (float)bvh.primCount / max( 1u, leafCount );
+			printf( "%-32.32s %9u %9u %9.2f %8.2fms %8.2f %9.2f\n", name.c_str(), bvh.primCount, bvh.nodesUsed, trisPerLeaf, buildTime * 1000, bvh.SAHCost(), rays.size() / (traceTime * 1e6f) );
+			if (bvh.primCount >= 64 && trisPerLeaf <= 1.0f) printf( "FAILED: %s has single-triangle leaves only\n", name.c_str() ), passed = false;
+			totalTris += bvh.primCount, totalBuild += buildTime;
+		}
+	}
+	printf( "%-32s %9u %9s %9s %8.2fms\n", "total", totalTris, "", "", totalBuild * 1000 );
+	renderer->Shutdown();
+	return passed;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  MeasureRays                                                                |
+//  |  Helper for RayBenchmark: trace a set of rays one at a time, in packets of  |
+//  |  eight consecutive rays, and in streams; returns the throughput of each,    |
+//  |  in Mrays/s. Rays with t = 0 are inactive and not counted.            LH2'19|
+//  +-----------------------------------------------------------------------------+
+float3 MeasureRays( const HostSceneBVH* bvh, const vector<HostRay>& rays, const bool occlusion )
+{
+	const int count = (int)rays.size();
+	int active = 0;
+	for (const HostRay& ray : rays) if (ray.t > 0) active++;
+	vector<HostRay> single = rays, stream = rays;
+	vector<HostRayPacket> packets( (count + 7) / 8 );
+	for (int i = 0; i < (int)packets.size() * 8; i++) packets[i / 8].Set( i & 7, i < count ? rays[i] : HostRay( make_float3( 0 ), make_float3( 0, 0, 1 ), 0 ) );
+	bool* occluded = new bool[count];
+	uint dummy = 0;
+	Timer timer;
+	if (occlusion) for (HostRay& ray : single) { if (ray.t > 0) dummy += bvh->IsOccluded( ray ); }
+	else for (HostRay& ray : single) if (ray.t > 0) bvh->Intersect( ray );
+	const float singleTime = timer.elapsed();
+	timer.reset();
+	if (occlusion) for (HostRayPacket& packet : packets) dummy += bvh->IsOccluded( packet );
+	else for (HostRayPacket& packet : packets) bvh->Intersect( packet );
+	const float packetTime = timer.elapsed();
+	timer.reset();
+	for (int first = 0; first < count; first += 4096)
+	{
+		if (occlusion) bvh->IsOccluded( stream.data() + first, min( 4096, count - first ), occluded + first );
+		else bvh->Intersect( stream.data() + first, min( 4096, count - first ) );
+	}
+	const float streamTime = timer.elapsed();
+	delete[] occluded;
+	if (dummy == 0xffffffff) printf( " " ); // keep the occlusion queries
+	return make_float3( active / (singleTime * 1e6f), active / (packetTime * 1e6f), active / (streamTime * 1e6f) );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RayBenchmark                                                               |
+//  |  Trace primary, shadow and diffuse bounce rays for the bundled glTF scenes, |
+//  |  using the host-side scene BVH of the RenderSystem. Scenes are placed far   |
+//  |  apart; the camera looks at one scene at a time. Reports single-threaded    |
+//  |  throughput for single rays, packets and streams.                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RayBenchmark()
+{
+	static const char* scenes[][2] = {
+		{ "../imguiapp/data/pica/", "scene.gltf" }, { "../imguiapp/data/", "CesiumMan.glb" }, { "../imguiapp/data/", "AnimatedMorphSphere.glb" }
+	};
+	const int width = 512, height = 512;
+	renderer = RenderAPI::CreateRenderAPI( "RenderCore_Null" );
+	renderer->EnableHostBVH( true );
+	HostScene* scene = renderer->GetScene();
+	printf( "AVX2: %s; Mrays/s on a single thread\n", HostBVH::AVX2Supported() ? "yes" : "no" );
+	printf( "%-28s %-8s %9s %9s %9s %9s\n", "scene", "rays", "count", "single", "packet", "stream" );
+	uint seed = 0x12345;
+	for (int s = 0; s < sizeof( scenes ) / sizeof( scenes[0] ); s++)
+	{
+		const int meshBase = (int)scene->meshPool.size();
+		renderer->AddScene( scenes[s][1], scenes[s][0], mat4::Translate( s * 10000.0f, 0, 0 ) );
+		renderer->SynchronizeSceneData();
+		const HostSceneBVH* bvh = renderer->GetHostBVH();
+		aabb bounds;
+		bounds.Reset();
+		for (size_t i = 0; i < bvh->instances.size(); i++) if (bvh->instances[i].mesh >= meshBase) bounds.Grow( bvh->instanceBounds[i] );
+		// primary rays, in blocks of 4x2 pixels
+		const float3 center = (bounds.bmin3 + bounds.bmax3) * 0.5f, extent = bounds.bmax3 - bounds.bmin3;
+		const float radius = 0.5f * length( extent );
+		const float3 eye = center + normalize( make_float3( 0.3f, 0.4f, 1 ) ) * radius * 1.8f, light = center + make_float3( 0, radius * 2, 0 );
+		const float3 forward = normalize( center - eye ), right = normalize( cross( forward, make_float3( 0, 1, 0 ) ) ), up = cross( right, forward );
+		vector<HostRay> primary;
+		for (int y = 0; y < height; y += 2) for (int x = 0; x < width; x += 4) for (int i = 0; i < 8; i++)
+		{
+			const float u = (x + (i & 3) + 0.5f) / width * 2 - 1, v = 1 - (y + (i >> 2) + 0.5f) / height * 2;
+			primary.push_back( HostRay( eye, normalize( forward + right * u * 0.8f + up * v * 0.8f ) ) );
+		}
+		// shadow and bounce rays start at the primary hits; for pixels without a hit, these are inactive
+		vector<HostRay> hits = primary, shadow, bounce;
+		for (HostRay& ray : hits) bvh->Intersect( ray );
+		for (const HostRay& ray : hits)
+		{
+			if (ray.tri == -1) { shadow.push_back( HostRay( eye, forward, 0 ) ); continue; }
+			const float3 P = ray.O + ray.D * ray.t - ray.D * (radius * 1e-4f), L = light - P;
+			shadow.push_back( HostRay( P, normalize( L ), length( L ) * 0.999f ) );
+			float3 R = normalize( make_float3( RandomFloat( seed ) - 0.5f, RandomFloat( seed ) - 0.5f, RandomFloat( seed ) - 0.5f ) );
+			bounce.push_back( HostRay( P, dot( R, ray.D ) > 0 ? R * -1.0f : R ) );
+		}
+		const char* type[3] = { "primary", "shadow", "bounce" };
+		const vector<HostRay>* sets[3] = { &primary, &shadow, &bounce };
+		for (int i = 0; i < 3; i++)
+		{
+			const float3 rate = MeasureRays( bvh, *sets[i], i == 1 );
+			printf( "%-28.28s %-8s %9i %9.2f %9.2f %9.2f\n", i == 0 ? scenes[s][1] : "", type[i], (int)sets[i]->size(), rate.x, rate.y, rate.z );
+		}
+	}
+	renderer->Shutdown();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  main                                                                       |
+//  |  Application entry point.                                                   |
+//  |  Usage: benchapp [crowd size] [frame count] [pipelined: 0 or 1]             |
+//  |                  [trace file, for replayapp, or -]                          |
+//  |                  [profile file, Chrome trace JSON]                          |
+//  |     or: benchapp bvh [build count]                                          |
+//  |     or: benchapp rays                                                 LH2'19|
+//  +-----------------------------------------------------------------------------+
+int main( int argc, char* argv[] )
+{
+	if (argc > 1 && !strcmp( argv[1], "bvh" ))
+	{
+		return BVHBenchmark( argc > 2 ? max( 1, atoi( argv[2] ) ) : 5 ) ? 0 : 1;
+	}
+	if (argc > 1 && !strcmp( argv[1], "rays" ))
+	{
+		RayBenchmark();
+		return 0;
+	}
+	const int crowdSize = argc > 1 ? atoi( argv[1] ) : 64;
+	const int frameCount = argc > 2 ? atoi( argv[2] ) : 500;
+	const bool pipelined = argc > 3 && atoi( argv[3] ) != 0;
+	const char* traceFile = argc > 4 && strcmp( argv[4], "-" ) != 0 ? argv[4] : 0;
+	const char* profileFile = argc > 5 ? argv[5] : 0;
+	// initialize renderer; the null core renders to a host buffer, so no OpenGL context is needed
+	renderer = RenderAPI::CreateRenderAPI( "RenderCore_Null", traceFile );
+	Bitmap target( SCRWIDTH, SCRHEIGHT );
+	renderer->SetTarget( &target, 1 );
+	renderer->SetPipelinedSync( pipelined );
+	// load
+	Timer timer;
+	PrepareScene( crowdSize );
+	const float loadTime = timer.elapsed();
+	timer.reset();
+	renderer->SynchronizeSceneData();
+	const float firstSyncTime = timer.elapsed();
+	// animate and synchronize
+	Profiler::Enable( profileFile != 0 );
+	float animTime = 0, syncTime = 0, renderTime = 0, sceneUpdateTime = 0, poseTime = 0;
+	for (int frame = 0; frame < frameCount; frame++)
+	{
+		PROFILE_ZONE( "Frame" );
+		timer.reset();
+		renderer->WaitForSceneSync();
+		for (int i = 0; i < renderer->AnimationCount(); i++) renderer->UpdateAnimation( i, 1.0f / 60.0f );
+		animTime += timer.elapsed();
+		timer.reset();
+		renderer->SynchronizeSceneData();
+		syncTime += timer.elapsed();
+		timer.reset();
+		renderer->Render( Converge );
+		renderTime += timer.elapsed();
+		SystemStats stats = renderer->GetSystemStats();
+		sceneUpdateTime += stats.sceneUpdateTime, poseTime += stats.poseTime;
+	}
+	renderer->WaitForSceneSync();
+	Profiler::Enable( false );
+	// report
+	const float ms = 1000.0f / max( 1, frameCount );
+	printf( "crowd size: %i, frames: %i, pipelined: %s\n", crowdSize, frameCount, pipelined ? "yes" : "no" );
+	printf( "load:          %9.3fms\n", loadTime * 1000 );
+	printf( "first sync:    %9.3fms\n", firstSyncTime * 1000 );
+	printf( "animation:     %9.3fms/frame\n", animTime * ms );
+	printf( "synchronize:   %9.3fms/frame\n", syncTime * ms );
+	printf( "  scene graph: %9.3fms/frame\n", sceneUpdateTime * ms );
+	printf( "  posing:      %9.3fms/frame\n", poseTime * ms );
+	printf( "render:        %9.3fms/frame\n", renderTime * ms );
+	if (profileFile) printf( Profiler::ExportChromeTrace( profileFile ) ? "profile written to %s\n" : "could not write %s\n", profileFile );
+	renderer->Shutdown(); // the null core prints its per entry point statistics here
+	return 0;
+}
+
+// EOF
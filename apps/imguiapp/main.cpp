@@ -194,20 +194,20 @@ int main()
 		ImGui::End();
 		ImGui::Begin( "Material parameters", 0 );
 		ImGui::Text( "name:    %s", currentMaterial.name.c_str() );
-		ImGui::ColorEdit3( "color", (float*)&currentMaterial.color );
-		ImGui::ColorEdit3( "absorption", (float*)&currentMaterial.absorption );
-		ImGui::SliderFloat( "metallic", &currentMaterial.metallic, 0, 1 );
-		ImGui::SliderFloat( "subsurface", &currentMaterial.subsurface, 0, 1 );
-		ImGui::SliderFloat( "specular", &currentMaterial.specular, 0, 1 );
-		ImGui::SliderFloat( "roughness", &currentMaterial.roughness, 0, 1 );
-		ImGui::SliderFloat( "specularTint", &currentMaterial.specularTint, 0, 1 );
-		ImGui::SliderFloat( "anisotropic", &currentMaterial.anisotropic, 0, 1 );
-		ImGui::SliderFloat( "sheen", &currentMaterial.sheen, 0, 1 );
-		ImGui::SliderFloat( "sheenTint", &currentMaterial.sheenTint, 0, 1 );
-		ImGui::SliderFloat( "clearcoat", &currentMaterial.clearcoat, 0, 1 );
-		ImGui::SliderFloat( "clearcoatGloss", &currentMaterial.clearcoatGloss, 0, 1 );
-		ImGui::SliderFloat( "transmission", &currentMaterial.transmission, 0, 1 );
-		ImGui::SliderFloat( "eta (1/ior)", &currentMaterial.eta, 0.25f, 1.0f );
+		if (ImGui::ColorEdit3( "color", (float*)&currentMaterial.color )) currentMaterial.MarkAsDirty();
+		if (ImGui::ColorEdit3( "absorption", (float*)&currentMaterial.absorption )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "metallic", &currentMaterial.metallic, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "subsurface", &currentMaterial.subsurface, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "specular", &currentMaterial.specular, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "roughness", &currentMaterial.roughness, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "specularTint", &currentMaterial.specularTint, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "anisotropic", &currentMaterial.anisotropic, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "sheen", &currentMaterial.sheen, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "sheenTint", &currentMaterial.sheenTint, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "clearcoat", &currentMaterial.clearcoat, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "clearcoatGloss", &currentMaterial.clearcoatGloss, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "transmission", &currentMaterial.transmission, 0, 1 )) currentMaterial.MarkAsDirty();
+		if (ImGui::SliderFloat( "eta (1/ior)", &currentMaterial.eta, 0.25f, 1.0f )) currentMaterial.MarkAsDirty();
 		ImGui::End();
 		ImGui::Render();
 		ImGui_ImplOpenGL3_RenderDrawData( ImGui::GetDrawData() );
@@ -0,0 +1,86 @@
+/* main.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Replays a trace of core API calls, recorded by passing a trace file
+   name to RenderAPI::CreateRenderAPI, on any core at full speed. There
+   is no scene loading, animation or RenderSystem involved, so this is
+   a reproducible benchmark for core changes.
+*/
+
+#include "platform.h"
+#include "rendersystem.h"
+
+static GLFWwindow* window = 0;
+static GLTexture* renderTarget = 0;
+static Bitmap* hostTarget = 0;
+
+//  +-----------------------------------------------------------------------------+
+//  |  InitGL                                                                     |
+//  |  Create an invisible window, for the OpenGL context of the render           |
+//  |  target.                                                              LH2'19|
+//  +-----------------------------------------------------------------------------+
+void InitGL()
+{
+	if (!glfwInit()) exit( EXIT_FAILURE );
+	glfwWindowHint( GLFW_CONTEXT_VERSION_MAJOR, 4 );
+	glfwWindowHint( GLFW_CONTEXT_VERSION_MINOR, 5 );
+	glfwWindowHint( GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE );
+	glfwWindowHint( GLFW_VISIBLE, GL_FALSE );
+	if (!(window = glfwCreateWindow( 64, 64, "LightHouse v2.0 replay", nullptr, nullptr ))) exit( EXIT_FAILURE );
+	glfwMakeContextCurrent( window );
+	if (!gladLoadGLLoader( (GLADloadproc)glfwGetProcAddress )) exit( EXIT_FAILURE );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  main                                                                       |
+//  |  Application entry point.                                                   |
+//  |  Usage: replayapp <trace file> [core] [passes] [-headless]            LH2'19|
+//  +-----------------------------------------------------------------------------+
+int main( int argc, char* argv[] )
+{
+	if (argc < 2)
+	{
+		printf( "usage: replayapp <trace file> [core] [passes] [-headless]\n" );
+		return 1;
+	}
+	const char* coreName = argc > 2 ? argv[2] : "RenderCore_Optix7";
+	const int passes = argc > 3 ? max( 1, atoi( argv[3] ) ) : 1;
+	const bool headless = argc > 4 && strcmp( argv[4], "-headless" ) == 0;
+	// load the trace
+	CoreTracePlayer player;
+	if (!player.Load( argv[1] )) FATALERROR( "Could not load trace %s", argv[1] );
+	// create the core; render targets are created when the trace sets one
+	if (!headless) InitGL();
+	CoreAPI_Base* core = CoreAPI_Base::CreateCoreAPI( coreName );
+	player.setTarget = []( CoreAPI_Base* core, const int width, const int height, const uint spp )
+	{
+		if (hostTarget) delete hostTarget, hostTarget = 0;
+		if (renderTarget) delete renderTarget, renderTarget = 0;
+		if (window) core->SetTarget( renderTarget = new GLTexture( width, height, GLTexture::FLOAT ), spp );
+		else core->SetHostTarget( hostTarget = new Bitmap( width, height ), spp );
+	};
+	// replay
+	for (int i = 0; i < passes; i++)
+	{
+		Timer timer;
+		player.Replay( core );
+		printf( "pass %i: %.3fms\n", i, timer.elapsed() * 1000 );
+	}
+	player.PrintStats();
+	core->Shutdown();
+	if (window) glfwTerminate();
+	return 0;
+}
+
+// EOF
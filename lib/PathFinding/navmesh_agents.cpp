@@ -157,9 +157,14 @@ void NavMeshAgents::RemoveAgent(Agent* agent)
 //  +-----------------------------------------------------------------------------+
 bool NavMeshAgents::UpdateAgentMovement(float deltaTime)
 {
+	PROFILE_ZONE("NavMeshAgents::UpdateAgentMovement");
+	// agents only read the navmesh and write their own rigid body, so they move in parallel
+	std::vector<char> agentChanged(m_agents.size(), 0);
+	parallel_for(0, (int)m_agents.size(), 64, [&](int i) {
+		if (m_agents[i].isAlive()) agentChanged[i] = m_agents[i].UpdateMovement(deltaTime);
+	});
 	bool changed = false;
-	for (std::vector<Agent>::iterator it = m_agents.begin(); it != m_agents.end(); it++)
-		if (it->isAlive()) changed |= it->UpdateMovement(deltaTime);
+	for (char c : agentChanged) changed |= c != 0;
 	return changed;
 }
 
@@ -170,6 +175,7 @@ bool NavMeshAgents::UpdateAgentMovement(float deltaTime)
 //  +-----------------------------------------------------------------------------+
 bool NavMeshAgents::UpdateAgentBehavior(float deltaTime)
 {
+	PROFILE_ZONE("NavMeshAgents::UpdateAgentBehavior");
 	bool changed = false;
 	m_timeCounter += deltaTime;
 	if (m_timeCounter < m_updateTimeInterval) return false;
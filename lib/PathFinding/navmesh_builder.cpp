@@ -70,6 +70,7 @@ NavMeshBuilder::NavMeshBuilder(const char* dir) : m_dir(dir)
 //  +-----------------------------------------------------------------------------+
 NavMeshStatus NavMeshBuilder::Build(HostScene* scene)
 {
+	PROFILE_ZONE("NavMeshBuilder::Build");
 	m_status = NavMeshStatus::SUCCESS;
 	if (!scene || scene->rootNodes.empty())
 		RECAST_ERROR(NavMeshStatus::RC | NavMeshStatus::INPUT, "HostScene is nullptr\n");
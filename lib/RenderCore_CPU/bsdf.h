@@ -0,0 +1,119 @@
+/* bsdf.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file provides the environment that the shared BSDF code expects
+   from a GPU core, in plain C++: the ShadingData struct and its parameter
+   macros, and the math helpers of tools_shared.h. Only the CPU path
+   tracer includes it.
+*/
+
+#pragma once
+
+// host versions of the device function qualifiers; see compatibility.h
+#define LH2_DEVFUNC static inline
+#define LH2_KERNEL
+
+#define CHAR2FLT(a,s) (((float)(((a)>>s)&255))*(1.0f/255.0f))
+
+namespace lh2core
+{
+
+inline float __uint_as_float( const uint x ) { union { uint u; float f; } v; v.u = x; return v.f; }
+inline uint __float_as_uint( const float x ) { union { uint u; float f; } v; v.f = x; return v.u; }
+
+//  +-----------------------------------------------------------------------------+
+//  |  ShadingData                                                                |
+//  |  Material properties at an intersection point; same layout as in the GPU    |
+//  |  cores, so the parameter macros below match tools_shared.h.           LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct ShadingData
+{
+	float3 color; int flags;
+	float3 transmittance; int matID;
+	uint4 parameters;
+	/* 16 uchars:   x: metallic, subsurface, specular, roughness;
+					y: specTint, anisotropic, sheen, sheenTint;
+					z: clearcoat, clearcoatGloss, transmission, dummy;
+					w: eta (32-bit float). */
+	bool IsEmissive() const { return color.x > 1.0f || color.y > 1.0f || color.z > 1.0f; }
+	void InvertETA() { parameters.w = __float_as_uint( 1.0f / __uint_as_float( parameters.w ) ); }
+#define METALLIC CHAR2FLT( shadingData.parameters.x, 0 )
+#define SUBSURFACE CHAR2FLT( shadingData.parameters.x, 8 )
+#define SPECULAR CHAR2FLT( shadingData.parameters.x, 16 )
+#define ROUGHNESS (max( 0.001f, CHAR2FLT( shadingData.parameters.x, 24 ) ))
+#define SPECTINT CHAR2FLT( shadingData.parameters.y, 0 )
+#define ANISOTROPIC CHAR2FLT( shadingData.parameters.y, 8 )
+#define SHEEN CHAR2FLT( shadingData.parameters.y, 16 )
+#define SHEENTINT CHAR2FLT( shadingData.parameters.y, 24 )
+#define CLEARCOAT CHAR2FLT( shadingData.parameters.z, 0 )
+#define CLEARCOATGLOSS CHAR2FLT( shadingData.parameters.z, 8 )
+#define TRANSMISSION CHAR2FLT( shadingData.parameters.z, 16 )
+#define ETA __uint_as_float( shadingData.parameters.w )
+};
+
+// helpers from tools_shared.h; sqr, lerp and reflect are provided by the platform
+
+LH2_DEVFUNC uint WangHash( uint s ) { s = (s ^ 61) ^ (s >> 16), s *= 9, s = s ^ (s >> 4), s *= 0x27d4eb2d, s = s ^ (s >> 15); return s; }
+LH2_DEVFUNC float saturate( const float x ) { return max( 0.0f, min( 1.0f, x ) ); }
+LH2_DEVFUNC float mix( const float a, const float b, const float x ) { return x <= 0 ? a : x >= 1 ? b : lerp( a, b, x ); }
+LH2_DEVFUNC void __sincosf( const float a, float* s, float* c ) { *s = sinf( a ), *c = cosf( a ); }
+
+LH2_DEVFUNC float3 Tangent2World( const float3& V, const float3& N )
+{
+	// "Building an Orthonormal Basis, Revisited"
+	float sign = copysignf( 1.0f, N.z );
+	const float a = -1.0f / (sign + N.z);
+	const float b = N.x * N.y * a;
+	const float3 B = make_float3( 1.0f + sign * N.x * N.x * a, sign * b, -sign * N.x );
+	const float3 T = make_float3( b, sign + N.y * N.y * a, -N.y );
+	return V.x * T + V.y * B + V.z * N;
+}
+
+LH2_DEVFUNC float3 World2Tangent( const float3& V, const float3& N )
+{
+	float sign = copysignf( 1.0f, N.z );
+	const float a = -1.0f / (sign + N.z);
+	const float b = N.x * N.y * a;
+	const float3 B = make_float3( 1.0f + sign * N.x * N.x * a, sign * b, -sign * N.x );
+	const float3 T = make_float3( b, sign + N.y * N.y * a, -N.y );
+	return make_float3( dot( V, T ), dot( V, B ), dot( V, N ) );
+}
+
+LH2_DEVFUNC float3 DiffuseReflectionCosWeighted( const float r0, const float r1 )
+{
+	const float term1 = TWOPI * r0, term2 = sqrtf( 1 - r1 );
+	float s, c;
+	__sincosf( term1, &s, &c );
+	return make_float3( c * term2, s * term2, sqrtf( r1 ) );
+}
+
+LH2_DEVFUNC float SurvivalProbability( const float3& diffuse )
+{
+	return min( 1.0f, max( max( diffuse.x, diffuse.y ), diffuse.z ) );
+}
+
+LH2_DEVFUNC float3 SafeOrigin( const float3& O, const float3& R, const float3& N, const float geoEpsilon )
+{
+	// offset outgoing ray direction along R and / or N: along N when strongly parallel to the origin surface; mostly along R otherwise
+	const float parallel = 1 - fabs( dot( N, R ) );
+	const float v = parallel * parallel;
+	return O + R * geoEpsilon * (1 - v) + N * geoEpsilon * v;
+}
+
+// the Disney BSDF, shared with the GPU cores
+#include "sharedbsdf.h"
+
+} // namespace lh2core
+
+// EOF
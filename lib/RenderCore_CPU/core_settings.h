@@ -0,0 +1,57 @@
+/* core_settings.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   The settings and classes in this file are core-specific:
+   - avilable in host and device code
+   - specific to this particular core.
+   Global settings can be configured shared.h.
+*/
+
+#pragma once
+
+// core-specific settings
+#define CLAMPFIREFLIES		// suppress fireflies by clamping
+#define MAXPATHLENGTH		16		// paths are terminated after this many segments, or earlier by russian roulette
+#define TILESIZE			16		// size of a screen tile, in pixels; the unit of work for the worker threads
+// #define NOTEXTURES		// all texture reads will be white
+
+#define NOHIT				-1
+
+// clamping
+#ifdef CLAMPFIREFLIES
+#define CLAMPINTENSITY		const float v=max(contribution.x,max(contribution.y,contribution.z)); \
+							if(v>clampValue){const float m=clampValue/v;contribution.x*=m; \
+							contribution.y*=m;contribution.z*=m; }
+#else
+#define CLAMPINTENSITY
+#endif
+
+#include "platform.h"
+
+#ifdef _DEBUG
+#pragma comment(lib, "../platform/lib/debug/platform.lib" )
+#else
+#pragma comment(lib, "../platform/lib/release/platform.lib" )
+#endif
+
+using namespace lighthouse2;
+
+#include "core_api_base.h"
+#include "host_bvh.h"
+#include "core_api.h"
+#include "rendercore.h"
+
+using namespace lh2core;
+
+// EOF
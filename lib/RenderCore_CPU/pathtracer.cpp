@@ -0,0 +1,421 @@
+/* pathtracer.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   The stages of the wavefront path tracer, for the paths of a single tile:
+   Generate produces the primary rays, Extend traces a buffer of rays
+   through the host BVH, Shade processes the intersections (following the
+   shadeKernel of RenderCore_PrimeRef) and produces extension rays and
+   shadow rays, and Connect traces the shadow rays and adds the potential
+   contributions of the unoccluded ones.
+*/
+
+#include "core_settings.h"
+#include "bsdf.h"
+
+#define S_SPECULAR		1	// path flags: last vertex was specular
+#define PATHIDX(s)		((s).data >> 8)
+
+//  +-----------------------------------------------------------------------------+
+//  |  RandomBarycentrics                                                         |
+//  |  Helper function for selecting a random point on a triangle. From:          |
+//  |  https://pharr.org/matt/blog/2019/02/27/triangle-sampling-1.html      LH2'19|
+//  +-----------------------------------------------------------------------------+
+static float3 RandomBarycentrics( const float r0 )
+{
+	const uint uf = (uint)(r0 * (1ull << 32));			// convert to 0:32 fixed point
+	float2 A = make_float2( 1, 0 ), B = make_float2( 0, 1 ), C = make_float2( 0, 0 ); // barycentrics
+	for (int i = 0; i < 16; ++i)						// for each base-4 digit
+	{
+		const int d = (uf >> (2 * (15 - i))) & 0x3;		// get the digit
+		float2 An, Bn, Cn;
+		switch (d)
+		{
+		case 0: An = (B + C) * 0.5f; Bn = (A + C) * 0.5f; Cn = (A + B) * 0.5f; break;
+		case 1: An = A; Bn = (A + B) * 0.5f; Cn = (A + C) * 0.5f; break;
+		case 2: An = (B + A) * 0.5f; Bn = B; Cn = (B + C) * 0.5f; break;
+		default: An = (C + A) * 0.5f; Bn = (C + B) * 0.5f; Cn = C; break;
+		}
+		A = An, B = Bn, C = Cn;
+	}
+	const float2 r = (A + B + C) * 0.3333333f;
+	return make_float3( r.x, r.y, 1 - r.x - r.y );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RandomPointOnLens                                                          |
+//  |  Generate a random point on the lens.                                 LH2'19|
+//  +-----------------------------------------------------------------------------+
+static float3 RandomPointOnLens( const float r0, float r1, const float3& pos, const float aperture, const float3& right, const float3& up )
+{
+	const float blade = (float)(int)(r0 * 9);
+	float r2 = (r0 - blade * (1.0f / 9.0f)) * 9.0f;
+	const float x1 = sinf( blade * PI / 4.5f ), y1 = cosf( blade * PI / 4.5f );
+	const float x2 = sinf( (blade + 1.0f) * PI / 4.5f ), y2 = cosf( (blade + 1.0f) * PI / 4.5f );
+	if ((r1 + r2) > 1) r1 = 1.0f - r1, r2 = 1.0f - r2;
+	const float xr = x1 * r1 + x2 * r2;
+	const float yr = y1 * r1 + y2 * r2;
+	return pos + aperture * (right * xr + up * yr);
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Generate                                                       |
+//  |  Set up the tile and produce the primary rays for all its pixels and        |
+//  |  samples. Returns the number of paths.                                LH2'19|
+//  +-----------------------------------------------------------------------------+
+int RenderCore::Generate( const int tileIdx, const ViewPyramid& view, const uint R0, Wavefront& wave ) const
+{
+	const int tilesX = (scrwidth + TILESIZE - 1) / TILESIZE;
+	wave.tileIdx = tileIdx;
+	wave.x0 = (tileIdx % tilesX) * TILESIZE, wave.w = min( TILESIZE, scrwidth - wave.x0 );
+	wave.y0 = (tileIdx / tilesX) * TILESIZE, wave.h = min( TILESIZE, scrheight - wave.y0 );
+	const int pixelCount = wave.w * wave.h, pathCount = pixelCount * scrspp;
+	wave.Reserve( pathCount );
+	wave.accumulator.assign( pixelCount, make_float4( 0 ) );
+	const float3 right = view.p2 - view.p1, up = view.p3 - view.p1;
+	for (int i = 0; i < pathCount; i++)
+	{
+		const int pixelIdx = i % pixelCount, sampleIdx = i / pixelCount;
+		const int x = wave.x0 + pixelIdx % wave.w, y = wave.y0 + pixelIdx / wave.w;
+		// seed on the screen-space path index, so the noise does not depend on the tiling
+		uint seed = WangHash( x + (y + sampleIdx * scrheight) * scrwidth + R0 );
+		const float r0 = RandomFloat( seed ), r1 = RandomFloat( seed );
+		const float r2 = RandomFloat( seed ), r3 = RandomFloat( seed );
+		const float3 posOnPixel = view.p1 + ((float)x + r0) * (right / (float)scrwidth) + ((float)y + r1) * (up / (float)scrheight);
+		const float3 posOnLens = RandomPointOnLens( r2, r3, view.pos, view.aperture, right, up );
+		wave.rays[0][i] = HostRay( posOnLens, normalize( posOnPixel - posOnLens ) );
+		wave.states[0][i].throughput = make_float3( 1 );
+		wave.states[0][i].data = (i << 8) + S_SPECULAR;
+	}
+	return pathCount;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Extend                                                         |
+//  |  Find the nearest intersection for a buffer of rays.                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Extend( HostRay* rays, const int count ) const
+{
+	// rays of a single tile are coherent for the first segment only; the stream
+	// traversal sorts them into packets where it can
+	bvh.Intersect( rays, count );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Shade                                                          |
+//  |  Process the intersections of the extension rays in wave.rays[0]: add       |
+//  |  emission and sky contributions, write a shadow ray for next event          |
+//  |  estimation and an extension ray to wave.rays[1]. Returns the number of     |
+//  |  extension rays.                                                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+int RenderCore::Shade( const int pathCount, const int pathLength, const uint R0, Wavefront& wave, int& shadowRayCount )
+{
+	const int pixelCount = wave.w * wave.h;
+	int extensionRayCount = 0;
+	shadowRayCount = 0;
+	for (int i = 0; i < pathCount; i++)
+	{
+		const HostRay& ray = wave.rays[0][i];
+		PathState state = wave.states[0][i];
+		const uint pathIdx = PATHIDX( state );
+		const uint pixelIdx = pathIdx % pixelCount, sampleIdx = pathIdx / pixelCount;
+		const int x = wave.x0 + pixelIdx % wave.w, y = wave.y0 + pixelIdx / wave.w;
+		const float3 D = ray.D;
+		float3 throughput = state.throughput;
+		// use skydome if we didn't hit any geometry
+		if (ray.tri == NOHIT)
+		{
+			float3 contribution = throughput * SampleSkydome( D );
+			if (pathLength > 1) { CLAMPINTENSITY; }
+			wave.accumulator[pixelIdx] += make_float4( contribution, 0 );
+			continue;
+		}
+		// object picking
+		if (pathLength == 1 && sampleIdx == 0 && x == probePos.x && y == probePos.y)
+			coreStats.probedInstid = ray.inst,	// record instance id at the selected pixel
+			coreStats.probedTriid = ray.tri,	// record primitive id at the selected pixel
+			coreStats.probedDist = ray.t;		// record primary ray hit distance
+		// get shadingData and normals
+		ShadingData shadingData;
+		float3 N, iN, T;
+		const float3 I = ray.O + ray.t * D;
+		if (!GetShadingData( D, ray, shadingData, N, iN, T ))
+		{
+			// alpha-masked texel: continue the ray behind the surface
+			HostRay& extensionRay = wave.rays[1][extensionRayCount];
+			extensionRay = HostRay( I + D * geometryEpsilon, D );
+			wave.states[1][extensionRayCount++] = state;
+			continue;
+		}
+		// stop on light
+		if (shadingData.IsEmissive() /* r, g or b exceeds 1 */)
+		{
+			const float DdotNL = -dot( D, N );
+			if (DdotNL > 0 /* lights are not double sided */ && (pathLength == 1 || (state.data & S_SPECULAR)))
+			{
+				float3 contribution = throughput * shadingData.color;
+				if (pathLength > 1) { CLAMPINTENSITY; }
+				wave.accumulator[pixelIdx] += make_float4( contribution, 0 );
+			}
+			continue;
+		}
+		// initialize seed based on the screen-space path index
+		uint seed = WangHash( (x + (y + sampleIdx * scrheight) * scrwidth) * 17 + R0 );
+		// detect pure specular surfaces
+		if (ROUGHNESS == 0.001f || TRANSMISSION > 0.999f) state.data |= S_SPECULAR; else state.data &= ~S_SPECULAR;
+		// normal alignment for backfacing polygons
+		const float flip = (dot( D, N ) > 0) ? -1.0f : 1.0f;
+		N *= flip;		// fix geometric normal
+		iN *= flip;		// fix final normal (includes normal map)
+		if (flip > 0)
+		{
+			shadingData.InvertETA(); // leaving medium; eta ==> 1 / eta
+			shadingData.transmittance = make_float3( 0 );
+		}
+		// next event estimation: connect eye path to light
+		if (!(state.data & S_SPECULAR))
+		{
+			const float r0 = RandomFloat( seed ), r1 = RandomFloat( seed );
+			float pickProb, lightPdf = 0;
+			float3 lightColor, L = RandomPointOnLight( r0, r1, I, iN, pickProb, lightPdf, lightColor ) - I;
+			const float dist = length( L );
+			L *= 1.0f / dist;
+			const float NdotL = dot( L, iN );
+			if (NdotL > 0 && lightPdf > 0)
+			{
+				float dummy;
+				const float3 sampledBSDF = EvaluateBSDF( shadingData, iN, T, D * -1.0f, L, dummy );
+				// calculate potential contribution
+				float3 contribution = throughput * sampledBSDF * lightColor * (NdotL / (pickProb * lightPdf));
+				CLAMPINTENSITY;
+				// add fire-and-forget shadow ray to the connections buffer
+				wave.shadowRays[shadowRayCount] = HostRay( SafeOrigin( I, L, N, geometryEpsilon ), L, dist - 2 * geometryEpsilon );
+				wave.potentials[shadowRayCount++] = make_float4( contribution, __uint_as_float( pixelIdx ) );
+			}
+		}
+		// evaluate bsdf to obtain direction for next path segment
+		float3 R;
+		float newBsdfPdf;
+		bool specular = false;
+		const float r3 = RandomFloat( seed ), r4 = RandomFloat( seed ), r5 = RandomFloat( seed );
+		const float3 bsdf = SampleBSDF( shadingData, iN, N, T, D * -1.0f, ray.t, r3, r4, R, newBsdfPdf, specular );
+		if (newBsdfPdf < EPSILON || isnan( newBsdfPdf )) continue;
+		if (specular) state.data |= S_SPECULAR; // SampleBSDF used a specular bounce to calculate R
+		// russian roulette
+		const float p = pathLength == MAXPATHLENGTH ? 0 : (state.data & S_SPECULAR ? 1 : SurvivalProbability( bsdf ));
+		if (p < r5) continue;
+		throughput *= bsdf * fabs( dot( iN, R ) ) / (p * newBsdfPdf);
+		// write extension ray
+		wave.rays[1][extensionRayCount] = HostRay( SafeOrigin( I, R, N, geometryEpsilon ), R );
+		state.throughput = throughput;
+		wave.states[1][extensionRayCount++] = state;
+	}
+	return extensionRayCount;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Connect                                                        |
+//  |  Trace the shadow rays and add the contributions of the unoccluded ones     |
+//  |  to the tile accumulator.                                             LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Connect( const int shadowRayCount, Wavefront& wave ) const
+{
+	bvh.IsOccluded( wave.shadowRays.data(), shadowRayCount, wave.occluded );
+	for (int i = 0; i < shadowRayCount; i++) if (!wave.occluded[i])
+	{
+		const float4& E = wave.potentials[i];
+		wave.accumulator[__float_as_uint( E.w )] += make_float4( E.x, E.y, E.z, 0 );
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::GetShadingData                                                 |
+//  |  Material properties and normals at an intersection point, as in the        |
+//  |  GetShadingData of the CUDA cores. Returns false if the intersection is     |
+//  |  a transparent texel of an alpha-mapped material.                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool RenderCore::GetShadingData( const float3& D, const HostRay& hit, ShadingData& shadingData, float3& N, float3& iN, float3& T ) const
+{
+	const HostSceneBVH::Instance& instance = bvh.instances[hit.inst];
+	const CoreTri& tri = meshes[instance.mesh][hit.tri];
+	const CoreMaterial& mat = materials[tri.material];
+	const CoreMaterialEx& matEx = materialEx[tri.material];
+	const uint flags = mat.flags;
+	shadingData.color = make_float3( mat.diffuse_r, mat.diffuse_g, mat.diffuse_b );
+	shadingData.transmittance = make_float3( mat.transmittance_r, mat.transmittance_g, mat.transmittance_b );
+	shadingData.flags = 0;
+	shadingData.matID = tri.material;
+	shadingData.parameters = mat.parameters;
+	// initialize normals
+	const float u = hit.u, v = hit.v, w = 1 - (u + v);
+	N = iN = make_float3( tri.Nx, tri.Ny, tri.Nz );
+	if (MAT_HASSMOOTHNORMALS) iN = normalize( w * tri.vN0 + u * tri.vN1 + v * tri.vN2 );
+	// transform the normals for the current instance: multiply by the transposed inverse
+	const mat4& M = instance.inverse;
+	const float3 A = make_float3( M.cell[0], M.cell[1], M.cell[2] ), B = make_float3( M.cell[4], M.cell[5], M.cell[6] ), C = make_float3( M.cell[8], M.cell[9], M.cell[10] );
+	N = normalize( N.x * A + N.y * B + N.z * C ), iN = normalize( iN.x * A + iN.y * B + iN.z * C );
+	T = normalize( make_float3( instance.transform * make_float4( tri.T, 0 ) ) );
+	// texturing
+#ifndef NOTEXTURES
+	if (MAT_HASDIFFUSEMAP || MAT_HASNORMALMAP || MAT_HASROUGHNESSMAP)
+	{
+		const float2 uv = make_float2( w * tri.u0 + u * tri.u1 + v * tri.u2, w * tri.v0 + u * tri.v1 + v * tri.v2 );
+		if (MAT_HASDIFFUSEMAP)
+		{
+			const float2 uvscale = make_float2( mat.uscale0, mat.vscale0 ), uvoffs = make_float2( mat.uoffs0, mat.voffs0 );
+			const float4 texel = FetchTexel( matEx.texture[TEXTURE0], uvscale * (uvoffs + uv), mat.texwidth0, mat.texheight0 );
+			if (MAT_HASALPHA && texel.w < 0.5f)
+			{
+				shadingData.flags |= 1;
+				return false;
+			}
+			shadingData.color = shadingData.color * make_float3( texel );
+		}
+		// normal mapping
+		if (MAT_HASNORMALMAP)
+		{
+			const float3 Bt = normalize( make_float3( instance.transform * make_float4( tri.B, 0 ) ) );
+			const float2 uvscale = make_float2( mat.nuscale0, mat.nvscale0 ), uvoffs = make_float2( mat.nuoffs0, mat.nvoffs0 );
+			const float3 shadingNormal = normalize( (make_float3( FetchTexel( matEx.texture[NORMALMAP0], uvscale * (uvoffs + uv), mat.nmapwidth0, mat.nmapheight0 ) ) - make_float3( 0.5f )) * 2.0f );
+			iN = normalize( shadingNormal.x * T + shadingNormal.y * Bt + shadingNormal.z * iN );
+		}
+		// roughness map
+		if (MAT_HASROUGHNESSMAP)
+		{
+			const float2 uvscale = make_float2( mat.ruscale, mat.rvscale ), uvoffs = make_float2( mat.ruoffs, mat.rvoffs );
+			const float roughness = FetchTexel( matEx.texture[ROUGHNESS0], uvscale * (uvoffs + uv), mat.rmapwidth, mat.rmapheight ).x;
+			shadingData.parameters.x = (shadingData.parameters.x & 0xffffff) + ((uint)(roughness * 255.0f) << 24);
+		}
+	}
+#endif
+	return true;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::FetchTexel                                                     |
+//  |  Bilinear texel fetch from the first MIP level of a texture; ARGB32 and     |
+//  |  NRM32 texels are converted to float4.                                LH2'19|
+//  +-----------------------------------------------------------------------------+
+float4 RenderCore::FetchTexel( const int textureIdx, const float2 uv, const int w, const int h ) const
+{
+	if (textureIdx < 0 || textureIdx >= textures.size() || w <= 0 || h <= 0) return make_float4( 1 );
+	const Texture* tex = textures[textureIdx];
+	const float2 tc = make_float2( (max( uv.x + 1000, 0.0f ) * w) - 0.5f, (max( uv.y + 1000, 0.0f ) * h) - 0.5f );
+	const int iu = ((int)tc.x) % w, iv = ((int)tc.y) % h;
+	const int iu1 = (iu + 1) % w, iv1 = (iv + 1) % h;
+	const float fu = tc.x - floorf( tc.x ), fv = tc.y - floorf( tc.y );
+	const float w0 = (1 - fu) * (1 - fv), w1 = fu * (1 - fv), w2 = (1 - fu) * fv, w3 = 1 - (w0 + w1 + w2);
+	const int i0 = iu + iv * w, i1 = iu1 + iv * w, i2 = iu + iv1 * w, i3 = iu1 + iv1 * w;
+	if (tex->storage == ARGB128)
+	{
+		if (i3 >= tex->fdata.size()) return make_float4( 1 );
+		const float4* p = tex->fdata.data();
+		return p[i0] * w0 + p[i1] * w1 + p[i2] * w2 + p[i3] * w3;
+	}
+	if (i3 >= tex->idata.size()) return make_float4( 1 );
+	const uint* p = tex->idata.data();
+	float4 texel = make_float4( 0 );
+	const int idx[4] = { i0, i1, i2, i3 };
+	const float weight[4] = { w0, w1, w2, w3 };
+	for (int i = 0; i < 4; i++)
+	{
+		const uint t = p[idx[i]];
+		texel += weight[i] * make_float4( (float)(t & 255), (float)((t >> 8) & 255), (float)((t >> 16) & 255), (float)(t >> 24) ) * (1.0f / 256.0f);
+	}
+	return texel;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::RandomPointOnLight                                             |
+//  |  Selects a random point on a random light. Returns a position, the          |
+//  |  probability that this particular light would have been picked and the      |
+//  |  importance of the explicit connection.                               LH2'19|
+//  +-----------------------------------------------------------------------------+
+float3 RenderCore::RandomPointOnLight( float r0, const float r1, const float3& I, const float3& N, float& pickProb, float& lightPdf, float3& lightColor ) const
+{
+	const int areaLightCount = (int)areaLights.size(), pointLightCount = (int)pointLights.size();
+	const int spotLightCount = (int)spotLights.size(), directionalLightCount = (int)directionalLights.size();
+	const float lightCount = (float)(areaLightCount + pointLightCount + spotLightCount + directionalLightCount);
+	if (lightCount == 0)
+	{
+		lightPdf = 0;
+		return make_float3( 1 /* light direction; don't return 0 or nan */ );
+	}
+	// uniform random sampling of lights, pickProb is simply 1.0 / lightCount
+	pickProb = 1.0f / lightCount;
+	int lightIdx = (int)(r0 * lightCount);
+	r0 = (r0 - (float)lightIdx * (1.0f / lightCount)) * lightCount;
+	lightIdx = clamp( lightIdx, 0, (int)lightCount - 1 );
+	if (lightIdx < areaLightCount)
+	{
+		// pick an area light
+		const CoreLightTri& light = areaLights[lightIdx];
+		const float3 bary = RandomBarycentrics( r0 );
+		lightColor = light.radiance;
+		const float3 P = bary.x * light.vertex0 + bary.y * light.vertex1 + bary.z * light.vertex2;
+		float3 L = I - P; // reversed: from light to intersection point
+		const float sqDist = dot( L, L );
+		L = normalize( L );
+		const float LNdotL = dot( L, light.N );
+		lightPdf = (LNdotL > 0 && dot( L, N ) < 0) ? (sqDist / (light.area * LNdotL)) : 0;
+		return P;
+	}
+	else if (lightIdx < areaLightCount + pointLightCount)
+	{
+		// pick a pointlight
+		const CorePointLight& light = pointLights[lightIdx - areaLightCount];
+		lightColor = light.radiance;
+		const float3 L = I - light.position; // reversed
+		const float sqDist = dot( L, L );
+		lightPdf = dot( L, N ) < 0 ? sqDist : 0;
+		return light.position;
+	}
+	else if (lightIdx < areaLightCount + pointLightCount + spotLightCount)
+	{
+		// pick a spotlight
+		const CoreSpotLight& light = spotLights[lightIdx - (areaLightCount + pointLightCount)];
+		float3 L = I - light.position;
+		const float sqDist = dot( L, L );
+		L = normalize( L );
+		const float d = (max( 0.0f, dot( L, light.direction ) ) - light.cosOuter) / (light.cosInner - light.cosOuter);
+		const float LNdotL = min( 1.0f, d );
+		lightPdf = (LNdotL > 0 && dot( L, N ) < 0) ? (sqDist / LNdotL) : 0;
+		lightColor = light.radiance;
+		return light.position;
+	}
+	else
+	{
+		// pick a directional light
+		const CoreDirectionalLight& light = directionalLights[lightIdx - (areaLightCount + pointLightCount + spotLightCount)];
+		lightColor = light.radiance;
+		lightPdf = dot( light.direction, N ) < 0 ? 1.0f : 0.0f;
+		return I - 1000.0f * light.direction;
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SampleSkydome                                                  |
+//  |  Sky color for a ray that left the scene.                             LH2'19|
+//  +-----------------------------------------------------------------------------+
+float3 RenderCore::SampleSkydome( const float3& D ) const
+{
+	// formulas by Paul Debevec, http://www.pauldebevec.com/Probes
+	const uint u = (uint)(skywidth * 0.5f * (1.0f + atan2f( D.x, -D.z ) * INVPI));
+	const uint v = (uint)(skyheight * acosf( D.y ) * INVPI);
+	const uint idx = u + v * skywidth;
+	return idx < skyPixels.size() ? skyPixels[idx] : make_float3( 0 );
+}
+
+// EOF
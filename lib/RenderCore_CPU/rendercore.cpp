@@ -0,0 +1,380 @@
+/* rendercore.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   Scene data management and the frame loop of the CPU path tracer. The
+   screen is split in tiles of TILESIZE x TILESIZE pixels, which the job
+   system hands out to the worker threads. Each thread runs the wavefront
+   loop of PrimeRef (generate, extend, shade, connect) for the paths of
+   its tile, using its own buffers; the stages are in pathtracer.cpp.
+*/
+
+#include "core_settings.h"
+
+using namespace lh2core;
+
+// per-thread ray and path buffers
+static thread_local Wavefront threadWavefront;
+
+//  +-----------------------------------------------------------------------------+
+//  |  Wavefront::Reserve                                                         |
+//  |  Make sure the buffers can hold the specified number of paths.        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void Wavefront::Reserve( const int paths )
+{
+	if (paths <= capacity) return;
+	for (int i = 0; i < 2; i++) rays[i].resize( paths ), states[i].resize( paths );
+	shadowRays.resize( paths );
+	potentials.resize( paths );
+	delete[] occluded;
+	occluded = new bool[paths];
+	capacity = paths;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetProbePos                                                    |
+//  |  Set the pixel for which the triid will be captured.                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetProbePos( int2 pos )
+{
+	probePos = pos; // triangle id for this pixel will be stored in coreStats
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Init                                                           |
+//  |  Initialization.                                                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Init()
+{
+	coreStats.deviceName = new char[64];
+	sprintf( coreStats.deviceName, "CPU, %i threads", JobSystem::WorkerCount() + 1 );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetTarget                                                      |
+//  |  Set the OpenGL texture that serves as the render target.             LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetTarget( GLTexture* target, const uint spp )
+{
+	output.SetTarget( target );
+	scrspp = max( 1u, spp );
+	Resize( target->width, target->height );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetHostTarget                                                  |
+//  |  Set the host buffer that serves as the render target.                LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetHostTarget( Bitmap* target, const uint spp )
+{
+	output.SetHostTarget( target );
+	scrspp = max( 1u, spp );
+	Resize( target->width, target->height );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Resize                                                         |
+//  |  Adapt the accumulator to the size of the render target.              LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Resize( const int w, const int h )
+{
+	scrwidth = w;
+	scrheight = h;
+	accumulator.assign( w * h, make_float4( 0 ) );
+	samplesTaken = 0;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetGeometry                                                    |
+//  |  Set the geometry data for a model.                                   LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags )
+{
+	// copy the 'fat triangles' for shading; the vertices go to the bvh
+	assert( vertexCount == 3 * triangleCount );
+	if (meshIdx >= meshes.size()) meshes.resize( meshIdx + 1 );
+	meshes[meshIdx].assign( triangles, triangles + triangleCount );
+	Timer timer;
+	bvh.SetMesh( meshIdx, vertexData, triangleCount );
+	coreStats.bvhBuildTime = timer.elapsed();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::UpdateGeometry                                                 |
+//  |  Update the vertices of a mesh; the topology did not change, so the bvh is  |
+//  |  refitted.                                                            LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool RenderCore::UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount )
+{
+	if (meshIdx >= meshes.size() || meshes[meshIdx].size() != triangleCount) return false;
+	vector<CoreTri>& tris = meshes[meshIdx];
+	for (int i = 0; i < rangeCount; i++) memcpy( tris.data() + dirtyRanges[i].x, triangles + dirtyRanges[i].x, dirtyRanges[i].y * sizeof( CoreTri ) );
+	Timer timer;
+	bvh.RefitMesh( meshIdx, vertexData, triangleCount, dirtyRanges, rangeCount );
+	coreStats.bvhBuildTime = timer.elapsed();
+	return true;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetInstance                                                    |
+//  |  Set instance details.                                                LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetInstance( const int instanceIdx, const int meshIdx, const mat4& matrix )
+{
+	// meshIdx -1 marks the end of the instance list: instances beyond it were removed
+	if (meshIdx == -1)
+	{
+		if (instanceIdx < bvh.instances.size()) bvh.instances.resize( instanceIdx ), bvh.rebuildToplevel = true;
+		return;
+	}
+	bvh.SetInstance( instanceIdx, meshIdx, matrix );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetInstances                                                   |
+//  |  Update a batch of instances.                                         LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount )
+{
+	bvh.SetInstances( meshIds, transforms, instanceCount, dirtyRanges, rangeCount );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::UpdateToplevel                                                 |
+//  |  Rebuild or refit the top-level bvh over the instances.               LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::UpdateToplevel()
+{
+	Timer timer;
+	bvh.UpdateToplevel();
+	coreStats.bvhBuildTime = timer.elapsed();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CopyTexels                                                                 |
+//  |  Helper for SetTextures and SetTexture: replace the texels of a texture.    |
+//  |  Float textures are stored in fdata, all others in idata.             LH2'19|
+//  +-----------------------------------------------------------------------------+
+static void CopyTexels( Texture* t, const CoreTexDesc& tex )
+{
+	t->storage = tex.storage;
+	if (tex.storage == ARGB128)
+	{
+		if (tex.fdata) t->fdata.assign( tex.fdata, tex.fdata + tex.pixelCount ); else t->fdata.assign( tex.pixelCount, make_float4( 0 ) );
+		t->idata.clear();
+	}
+	else
+	{
+		if (tex.idata) t->idata.assign( (uint*)tex.idata, (uint*)tex.idata + tex.pixelCount ); else t->idata.assign( tex.pixelCount, 0 );
+		t->fdata.clear();
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetTextures                                                    |
+//  |  Set the texture data.                                                LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetTextures( const CoreTexDesc* tex, const int textureCount )
+{
+	for (int i = textureCount; i < textures.size(); i++) delete textures[i];
+	textures.resize( textureCount, 0 );
+	coreStats.argb32TexelCount = coreStats.argb128TexelCount = coreStats.nrm32TexelCount = 0;
+	for (int i = 0; i < textureCount; i++)
+	{
+		if (!textures[i]) textures[i] = new Texture();
+		CopyTexels( textures[i], tex[i] );
+		if (tex[i].storage == ARGB32) coreStats.argb32TexelCount += tex[i].pixelCount;
+		else if (tex[i].storage == ARGB128) coreStats.argb128TexelCount += tex[i].pixelCount;
+		else coreStats.nrm32TexelCount += tex[i].pixelCount;
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetTexture                                                     |
+//  |  Update the texel data of a single texture. Texture width and height are    |
+//  |  stored with the materials, so a resized texture is declined; the           |
+//  |  RenderSystem then sends all textures and materials.                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool RenderCore::SetTexture( const int textureIdx, const CoreTexDesc& tex )
+{
+	if (textureIdx < 0 || textureIdx >= textures.size()) return false;
+	Texture* t = textures[textureIdx];
+	if ((t->storage == ARGB128 ? t->fdata.size() : t->idata.size()) != tex.pixelCount) return false;
+	CopyTexels( t, tex );
+	return true;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetMaterials                                                   |
+//  |  Set the material data.                                               LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount )
+{
+	// the shading code finds texels via the texture ids in matEx, so no texture addresses need patching
+	materials.assign( mat, mat + materialCount );
+	materialEx.assign( matEx, matEx + materialCount );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetLights                                                      |
+//  |  Set the light data.                                                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetLights( const CoreLightTri* areaLights, const int areaLightCount,
+	const CorePointLight* pointLights, const int pointLightCount,
+	const CoreSpotLight* spotLights, const int spotLightCount,
+	const CoreDirectionalLight* directionalLights, const int directionalLightCount )
+{
+	this->areaLights.assign( areaLights, areaLights + areaLightCount );
+	this->pointLights.assign( pointLights, pointLights + pointLightCount );
+	this->spotLights.assign( spotLights, spotLights + spotLightCount );
+	this->directionalLights.assign( directionalLights, directionalLights + directionalLightCount );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetSkyData                                                     |
+//  |  Set the sky dome data.                                               LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetSkyData( const float3* pixels, const uint width, const uint height )
+{
+	skyPixels.assign( pixels, pixels + width * height );
+	skywidth = width;
+	skyheight = height;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Setting                                                        |
+//  |  Modify a render setting.                                             LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Setting( const char* name, const float value )
+{
+	if (!strcmp( name, "epsilon" ))
+	{
+		geometryEpsilon = value;
+	}
+	else if (!strcmp( name, "clampValue" ))
+	{
+		clampValue = value;
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::RenderTile                                                     |
+//  |  Run the wavefront loop for all paths of one tile, and add the result to    |
+//  |  the accumulator.                                                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::RenderTile( const int tileIdx, const ViewPyramid& view, const uint R0, Wavefront& wave, TileStats& stats )
+{
+	int pathCount = Generate( tileIdx, view, R0, wave );
+	for (int pathLength = 1; pathLength <= MAXPATHLENGTH && pathCount > 0; pathLength++)
+	{
+		// extend
+		Timer t;
+		Extend( wave.rays[0].data(), pathCount );
+		const int depth = min( pathLength - 1, 2 );
+		stats.rays[depth] += pathCount;
+		stats.traceTime[depth] += t.elapsed();
+		// shade
+		t.reset();
+		int shadowRayCount = 0;
+		pathCount = Shade( pathCount, pathLength, R0 + pathLength * 91771, wave, shadowRayCount );
+		stats.shadeTime += t.elapsed();
+		swap( wave.rays[0], wave.rays[1] );
+		swap( wave.states[0], wave.states[1] );
+		// connect
+		if (shadowRayCount > 0)
+		{
+			t.reset();
+			Connect( shadowRayCount, wave );
+			stats.shadowRays += shadowRayCount;
+			stats.shadowTraceTime += t.elapsed();
+		}
+	}
+	// tiles do not overlap: no synchronization needed
+	for (int y = 0; y < wave.h; y++) for (int x = 0; x < wave.w; x++)
+		accumulator[wave.x0 + x + (wave.y0 + y) * scrwidth] += wave.accumulator[x + y * wave.w];
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Render                                                         |
+//  |  Produce one image.                                                   LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast )
+{
+	if (scrwidth == 0 || scrheight == 0) return;
+	Timer timer;
+	// clean accumulator, if requested
+	if (converge == Restart || firstConvergingFrame)
+	{
+		memset( accumulator.data(), 0, accumulator.size() * sizeof( float4 ) );
+		samplesTaken = 0;
+		firstConvergingFrame = true; // if we switch to converging, it will be the first converging frame.
+		camRNGseed = 0x12345678; // same seed means same noise.
+	}
+	if (converge == Converge) firstConvergingFrame = false;
+	// render the tiles; each job takes a single tile, so threads that finish early steal the remaining ones
+	const int tileCount = ((scrwidth + TILESIZE - 1) / TILESIZE) * ((scrheight + TILESIZE - 1) / TILESIZE);
+	vector<TileStats> stats( tileCount );
+	const uint R0 = RandomUInt( camRNGseed );
+	coreStats.probedInstid = coreStats.probedTriid = NOHIT, coreStats.probedDist = 1e34f;
+	parallel_for( 0, tileCount, 1, [&]( const int tile ) { RenderTile( tile, view, R0, threadWavefront, stats[tile] ); } );
+	samplesTaken += scrspp;
+	// present accumulator to final buffer: brightness, contrast and gamma correction, as in finalizeRender
+	uint* pixels = output.Pixels(); // may be write-combined memory: no reads
+	if (pixels)
+	{
+		const float pixelValueScale = 1.0f / (float)samplesTaken;
+		const float contrastFactor = (259.0f * (contrast * 256.0f + 255.0f)) / (255.0f * (259.0f - 256.0f * contrast));
+		parallel_for( 0, scrheight, 16, [&]( const int y ) {
+			for (int x = 0; x < scrwidth; x++)
+			{
+				const float4 value = accumulator[x + y * scrwidth] * pixelValueScale;
+				const float r = sqrtf( max( 0.0f, (value.x - 0.5f) * contrastFactor + 0.5f + brightness ) );
+				const float g = sqrtf( max( 0.0f, (value.y - 0.5f) * contrastFactor + 0.5f + brightness ) );
+				const float b = sqrtf( max( 0.0f, (value.z - 0.5f) * contrastFactor + 0.5f + brightness ) );
+				pixels[x + y * scrwidth] = (uint)(min( 1.0f, r ) * 255.0f) + ((uint)(min( 1.0f, g ) * 255.0f) << 8) + ((uint)(min( 1.0f, b ) * 255.0f) << 16);
+			}
+		} );
+	}
+	output.Present();
+	// gather statistics; trace and shade times are summed over the threads
+	coreStats.primaryRayCount = coreStats.bounce1RayCount = coreStats.deepRayCount = coreStats.totalShadowRays = 0;
+	coreStats.traceTime0 = coreStats.traceTime1 = coreStats.traceTimeX = coreStats.shadowTraceTime = coreStats.shadeTime = 0;
+	for (const TileStats& s : stats)
+	{
+		coreStats.primaryRayCount += s.rays[0], coreStats.traceTime0 += s.traceTime[0];
+		coreStats.bounce1RayCount += s.rays[1], coreStats.traceTime1 += s.traceTime[1];
+		coreStats.deepRayCount += s.rays[2], coreStats.traceTimeX += s.traceTime[2];
+		coreStats.totalShadowRays += s.shadowRays, coreStats.shadowTraceTime += s.shadowTraceTime;
+		coreStats.shadeTime += s.shadeTime;
+	}
+	coreStats.totalExtensionRays = coreStats.primaryRayCount + coreStats.bounce1RayCount + coreStats.deepRayCount;
+	coreStats.totalRays = coreStats.totalExtensionRays + coreStats.totalShadowRays;
+	coreStats.renderTime = timer.elapsed();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Shutdown                                                       |
+//  |  Free all resources.                                                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Shutdown()
+{
+	output.Release();
+	for (Texture* t : textures) delete t;
+	textures.clear();
+	delete[] coreStats.deviceName;
+	coreStats.deviceName = 0;
+}
+
+// EOF
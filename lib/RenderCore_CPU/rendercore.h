@@ -0,0 +1,152 @@
+/* rendercore.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+namespace lh2core
+{
+
+struct ShadingData; // see bsdf.h
+
+//  +-----------------------------------------------------------------------------+
+//  |  Texture                                                                    |
+//  |  Copy of the texel data of a HostTexture, including the MIP levels.   LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct Texture
+{
+	TexelStorage storage = ARGB32;
+	vector<uint> idata;								// ARGB32 and NRM32 texels
+	vector<float4> fdata;							// ARGB128 texels
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  PathState                                                                  |
+//  |  Per-path data that travels with an extension ray through the stages of     |
+//  |  the wavefront loop.                                                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct PathState
+{
+	float3 throughput;								// path transport
+	uint data;										// path index within the tile << 8, flags in bits 0..7
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  Wavefront                                                                  |
+//  |  Ray and path buffers for the paths of a single tile. Each worker thread    |
+//  |  owns one, so the stages do not need to synchronize.                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct Wavefront
+{
+	~Wavefront() { delete[] occluded; }
+	void Reserve( const int paths );
+	vector<HostRay> rays[2];						// extension rays; in and out buffer
+	vector<PathState> states[2];					// path state for each extension ray
+	vector<HostRay> shadowRays;						// connections to the lights
+	vector<float4> potentials;						// contribution of each connection if unoccluded, pixel index in w
+	vector<float4> accumulator;						// radiance per pixel of the tile, for all samples of this frame
+	bool* occluded = 0;								// result of the shadow ray queries
+	int capacity = 0;								// paths the buffers can hold
+	int tileIdx = 0, x0 = 0, y0 = 0, w = 0, h = 0;	// the tile that is being rendered, in pixels
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  TileStats                                                                  |
+//  |  Ray counts and timings of a single tile, summed into CoreStats after the   |
+//  |  frame.                                                               LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct TileStats
+{
+	uint rays[3] = {};								// extension rays: primary, first bounce, deeper
+	float traceTime[3] = {};						// time spent tracing these
+	uint shadowRays = 0;
+	float shadowTraceTime = 0, shadeTime = 0;
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore                                                                 |
+//  |  Encapsulates device code.                                            LH2'19|
+//  +-----------------------------------------------------------------------------+
+class RenderCore
+{
+public:
+	// methods
+	void Init();
+	void Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast );
+	void Setting( const char* name, const float value );
+	void SetTarget( GLTexture* target, const uint spp );
+	void SetHostTarget( Bitmap* target, const uint spp );
+	void Shutdown();
+	// passing data. Note: RenderCore always copies what it needs; the passed data thus remains the
+	// property of the caller, and can be safely deleted or modified as soon as these calls return.
+	void SetTextures( const CoreTexDesc* tex, const int textureCount );
+	bool SetTexture( const int textureIdx, const CoreTexDesc& tex ); // in-place update of a single texture
+	void SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount ); // textures must be in sync when calling this
+	void SetLights( const CoreLightTri* areaLights, const int areaLightCount,
+		const CorePointLight* pointLights, const int pointLightCount,
+		const CoreSpotLight* spotLights, const int spotLightCount,
+		const CoreDirectionalLight* directionalLights, const int directionalLightCount );
+	void SetSkyData( const float3* pixels, const uint width, const uint height );
+	// geometry and instances:
+	// a scene is setup by first passing a number of meshes (geometry), then a number of instances.
+	// note that stored meshes can be used zero, one or multiple times in the scene.
+	void SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags = 0 );
+	bool UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount );
+	void SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform );
+	void SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount );
+	void UpdateToplevel();
+	void SetProbePos( const int2 pos );
+	// internal methods
+private:
+	void Resize( const int w, const int h );
+	void RenderTile( const int tileIdx, const ViewPyramid& view, const uint R0, Wavefront& wave, TileStats& stats );
+	// wavefront stages and shading helpers; implemented in pathtracer.cpp
+	int Generate( const int tileIdx, const ViewPyramid& view, const uint R0, Wavefront& wave ) const;
+	void Extend( HostRay* rays, const int count ) const;
+	int Shade( const int pathCount, const int pathLength, const uint R0, Wavefront& wave, int& shadowRayCount );
+	void Connect( const int shadowRayCount, Wavefront& wave ) const;
+	bool GetShadingData( const float3& D, const HostRay& hit, ShadingData& shadingData, float3& N, float3& iN, float3& T ) const;
+	float4 FetchTexel( const int textureIdx, const float2 uv, const int w, const int h ) const;
+	float3 RandomPointOnLight( float r0, const float r1, const float3& I, const float3& N, float& pickProb, float& lightPdf, float3& lightColor ) const;
+	float3 SampleSkydome( const float3& D ) const;
+	// data members
+	int scrwidth = 0, scrheight = 0;				// current screen width and height
+	int scrspp = 1;									// samples per pixel per frame
+	CPUTarget output;								// OpenGL texture or host buffer that receives the frames
+	vector<float4> accumulator;						// sum of all samples since the last restart, per pixel
+	uint samplesTaken = 0;							// number of accumulated samples per pixel
+	bool firstConvergingFrame = false;				// the next frame restarts accumulation
+	uint camRNGseed = 0x12345678;					// seed for the per-frame random numbers
+	int2 probePos = make_int2( 0 );					// triangle picking; primary ray hit for this pixel is reported in coreStats
+	float geometryEpsilon = 1e-4f;					// offset of ray origins from surfaces
+	float clampValue = 10.0f;						// contributions are clamped to this value
+	// scene
+	HostSceneBVH bvh;								// bvh per mesh, and a top-level bvh over the instances
+	vector<vector<CoreTri>> meshes;					// 'fat' triangles, per mesh
+	vector<CoreMaterial> materials;					// materials, as received from the RenderSystem
+	vector<CoreMaterialEx> materialEx;				// texture ids per material
+	vector<Texture*> textures;						// texel data
+	vector<CoreLightTri> areaLights;				// light data
+	vector<CorePointLight> pointLights;
+	vector<CoreSpotLight> spotLights;
+	vector<CoreDirectionalLight> directionalLights;
+	vector<float3> skyPixels;						// sky dome
+	int skywidth = 0, skyheight = 0;				// size of the skydome texture
+public:
+	CoreStats coreStats;							// rendering statistics
+};
+
+} // namespace lh2core
+
+// EOF
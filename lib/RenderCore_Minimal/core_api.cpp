@@ -57,6 +57,12 @@ void CoreAPI::SetTarget( GLTexture* target, const uint spp )
 	core->SetTarget( target /* ignore spp parameter */ );
 }
 
+void CoreAPI::SetHostTarget( Bitmap* target, const uint spp )
+{
+	// offscreen mode: frames are written to the supplied buffer.
+	core->SetHostTarget( target );
+}
+
 void CoreAPI::Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast )
 {
 	// forward the render request to the Render method in rendercore.cpp
@@ -87,7 +93,7 @@ void CoreAPI::SetGeometry( const int meshIdx, const float4* vertexData, const in
 
 void CoreAPI::SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform )
 {
-	// core->SetInstance( instanceIdx, modelIdx, transform ); // TODO; we will just render the meshes for now.
+	core->SetInstance( instanceIdx, modelIdx, transform );
 }
 
 // EOF
\ No newline at end of file
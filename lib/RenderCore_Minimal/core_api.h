@@ -33,6 +33,8 @@ public:
 	void SetProbePos( const int2 pos ) { /* not implemented for the minimal core. */ }
 	// SetTarget: specify an OpenGL texture as a render target for the path tracer.
 	void SetTarget( GLTexture* target, const uint spp );
+	// SetHostTarget: specify a host-side buffer as a render target, for headless operation without OpenGL.
+	void SetHostTarget( Bitmap* target, const uint spp );
 	// Setting: modify a render setting
 	void Setting( const char* name, float value ) { /* the minimal core ignores all settings. */ }
 	// Render: produce one frame. Convergence can be 'Converge' or 'Restart'.
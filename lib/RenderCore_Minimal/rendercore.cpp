@@ -30,13 +30,18 @@ void RenderCore::Init()
 //  |  RenderCore::SetTarget                                                      |
 //  |  Set the OpenGL texture that serves as the render target.             LH2'19|
 //  +-----------------------------------------------------------------------------+
-void RenderCore::SetTarget( GLTexture* target )
+void RenderCore::SetTarget( GLTexture* glTarget )
 {
-	// synchronize OpenGL viewport
-	targetTextureID = target->ID;
-	if (screen != 0 && target->width == screen->width && target->height == screen->height) return; // nothing changed
-	delete screen;
-	screen = new Bitmap( target->width, target->height );
+	target.SetTarget( glTarget ); // reallocates the pixel buffers if the size changed
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetHostTarget                                                  |
+//  |  Set the host buffer that serves as the render target.                LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetHostTarget( Bitmap* hostTarget )
+{
+	target.SetHostTarget( hostTarget );
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -45,36 +50,66 @@ void RenderCore::SetTarget( GLTexture* target )
 //  +-----------------------------------------------------------------------------+
 void RenderCore::SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangleData, const uint* alphaFlags )
 {
-	Mesh newMesh;
-	// copy the supplied vertices; we cannot assume that the render system does not modify
-	// the original data after we leave this function.
-	newMesh.vertices = new float4[vertexCount];
-	newMesh.vcount = vertexCount;
-	memcpy( newMesh.vertices, vertexData, vertexCount * sizeof( float4 ) );
-	// copy the supplied 'fat triangles'
-	newMesh.triangles = new CoreTri[vertexCount / 3];
-	memcpy( newMesh.triangles, triangleData, (vertexCount / 3) * sizeof( CoreTri ) );
-	meshes.push_back( newMesh );
+	// copy the supplied vertices and 'fat triangles'; we cannot assume that the render system
+	// does not modify the original data after we leave this function.
+	assert( vertexCount == 3 * triangleCount );
+	if (meshIdx >= meshes.size()) meshes.resize( meshIdx + 1 );
+	Mesh& mesh = meshes[meshIdx];
+	mesh.vertices.assign( vertexData, vertexData + vertexCount );
+	mesh.triangles.assign( triangleData, triangleData + triangleCount );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetInstance                                                    |
+//  |  Set instance details.                                                LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetInstance( const int instanceIdx, const int meshIdx, const mat4& transform )
+{
+	// meshIdx -1 marks the end of the instance list: instances beyond it were removed
+	if (meshIdx == -1)
+	{
+		if (instanceIdx < instances.size()) instances.resize( instanceIdx );
+		return;
+	}
+	if (instanceIdx >= instances.size()) instances.resize( instanceIdx + 1 );
+	instances[instanceIdx].mesh = meshIdx;
+	instances[instanceIdx].transform = transform;
 }
 
 //  +-----------------------------------------------------------------------------+
 //  |  RenderCore::Render                                                         |
-//  |  Produce one image.                                                   LH2'19|
+//  |  Produce one image: the vertices of all instances, as white points.   LH2'19|
 //  +-----------------------------------------------------------------------------+
 void RenderCore::Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast )
 {
-	// render
-	screen->Clear();
-	for( Mesh& mesh : meshes ) for( int i = 0; i < mesh.vcount; i++ )
+	Timer timer;
+	const int w = target.width, h = target.height;
+	uint* pixels = target.Pixels(); // may be write-combined memory: no reads
+	if (!pixels) return;
+	memset( pixels, 0, w * h * sizeof( uint ) );
+	// camera basis; the screen plane is spanned by p1 (top left), p2 (top right) and p3 (bottom left)
+	const float3 right = view.p2 - view.p1, down = view.p3 - view.p1;
+	const float3 center = view.p1 + 0.5f * (right + down), forward = normalize( center - view.pos );
+	const float dist = dot( center - view.pos, forward );
+	const float3 X = right * (1.0f / dot( right, right )), Y = down * (1.0f / dot( down, down ));
+	for (const Instance& instance : instances)
 	{
-		// convert a vertex position to a screen coordinate
-		int screenx = mesh.vertices[i].x / 80 * (float)screen->width + screen->width / 2;
-		int screeny = mesh.vertices[i].z / 80 * (float)screen->height + screen->height / 2;
-		screen->Plot( screenx, screeny, 0xffffff /* white */ );
+		const Mesh& mesh = meshes[instance.mesh];
+		for (const float4& v : mesh.vertices)
+		{
+			// project the world-space vertex on the screen plane
+			const float3 D = make_float3( instance.transform * make_float4( make_float3( v ), 1 ) ) - view.pos;
+			const float z = dot( D, forward );
+			if (z <= 0) continue;
+			const float3 P = D * (dist / z) + view.pos - view.p1;
+			const float sx = dot( P, X ), sy = dot( P, Y );
+			if (sx < 0 || sy < 0 || sx >= 1 || sy >= 1) continue;
+			pixels[(int)(sx * w) + (int)(sy * h) * w] = 0xffffff; /* white */
+		}
 	}
-	// copy pixel buffer to OpenGL render target texture
-	glBindTexture( GL_TEXTURE_2D, targetTextureID );
-	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, screen->width, screen->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, screen->pixels );
+	coreStats.renderTime = timer.elapsed();
+	// start the upload to the OpenGL render target; this overlaps the next frame
+	target.Present();
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -83,7 +118,7 @@ void RenderCore::Render( const ViewPyramid& view, const Convergence converge, co
 //  +-----------------------------------------------------------------------------+
 void RenderCore::Shutdown()
 {
-	delete screen;
+	target.Release();
 }
 
 // EOF
\ No newline at end of file
@@ -25,9 +25,19 @@ namespace lh2core
 class Mesh
 {
 public:
-	float4* vertices = 0;							// vertex data received via SetGeometry
-	int vcount = 0;									// vertex count
-	CoreTri* triangles = 0;							// 'fat' triangle data
+	vector<float4> vertices;						// vertex data received via SetGeometry, three per triangle
+	vector<CoreTri> triangles;						// 'fat' triangle data
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  Instance                                                                   |
+//  |  A mesh placed in the world.                                          LH2'19|
+//  +-----------------------------------------------------------------------------+
+class Instance
+{
+public:
+	int mesh = -1;									// index in RenderCore::meshes
+	mat4 transform;									// object-to-world transform
 };
 
 //  +-----------------------------------------------------------------------------+
@@ -40,15 +50,17 @@ public:
 	// methods
 	void Init();
 	void SetTarget( GLTexture* target );
+	void SetHostTarget( Bitmap* target );
 	void SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags = 0 );
+	void SetInstance( const int instanceIdx, const int meshIdx, const mat4& transform );
 	void Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast );
 	void Shutdown();
 	// internal methods
 private:
 	// data members
-	Bitmap* screen = 0;								// temporary storage of RenderCore output; will be copied to render target
-	int targetTextureID = 0;						// ID of the target OpenGL texture
+	CPUTarget target;								// OpenGL texture or host buffer that receives the frames
 	vector<Mesh> meshes;							// mesh data storage
+	vector<Instance> instances;						// flat instance list
 public:
 	CoreStats coreStats;							// rendering statistics
 };
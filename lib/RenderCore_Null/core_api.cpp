@@ -0,0 +1,185 @@
+/* core_api.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "core_settings.h"
+
+static CoreAPI_Base* coreInstance = NULL;
+
+extern "C" COREDLL_API CoreAPI_Base* CreateCore()
+{
+	assert( coreInstance == NULL );
+	// note: no gladLoadGL here; the null core does not use OpenGL, so it also works without a context.
+	coreInstance = new CoreAPI();
+	coreInstance->Init();
+	return coreInstance;
+}
+
+extern "C" COREDLL_API void DestroyCore()
+{
+	assert( coreInstance );
+	delete coreInstance;
+	coreInstance = NULL;
+}
+
+namespace lh2core {
+static lh2core::RenderCore* core = 0;
+};
+
+// each entry point records the number of bytes it received and the time it took.
+static size_t TexelBytes( const CoreTexDesc& tex ) { return tex.pixelCount * (tex.storage == TexelStorage::ARGB128 ? sizeof( float4 ) : sizeof( uint )); }
+
+void CoreAPI::Init()
+{
+	if (!core)
+	{
+		core = new RenderCore();
+		core->Init();
+	}
+}
+
+CoreStats CoreAPI::GetCoreStats()
+{
+	core->Record( RenderCore::GET_CORE_STATS, 0, 0 );
+	return core->coreStats;
+}
+
+void CoreAPI::SetProbePos( const int2 pos )
+{
+	core->Record( RenderCore::SET_PROBE_POS, sizeof( int2 ), 0 );
+}
+
+void CoreAPI::SetTarget( GLTexture* target, const uint spp )
+{
+	// the null core never touches the OpenGL texture.
+	core->Record( RenderCore::SET_TARGET, 0, 0 );
+}
+
+void CoreAPI::SetHostTarget( Bitmap* target, const uint spp )
+{
+	core->SetHostTarget( target );
+	core->Record( RenderCore::SET_HOST_TARGET, 0, 0 );
+}
+
+void CoreAPI::Setting( const char* name, float value )
+{
+	core->Record( RenderCore::SETTING, sizeof( float ), 0 );
+}
+
+void CoreAPI::Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast )
+{
+	Timer timer;
+	core->Render();
+	core->coreStats.renderTime = timer.elapsed();
+	core->Record( RenderCore::RENDER, sizeof( ViewPyramid ), core->coreStats.renderTime );
+}
+
+void CoreAPI::Shutdown()
+{
+	core->Shutdown();
+	delete core;
+	core = 0;
+}
+
+void CoreAPI::SetTextures( const CoreTexDesc* tex, const int textureCount )
+{
+	Timer timer;
+	size_t bytes = textureCount * sizeof( CoreTexDesc );
+	for (int i = 0; i < textureCount; i++) core->Upload( tex[i].idata, TexelBytes( tex[i] ) ), bytes += TexelBytes( tex[i] );
+	core->Record( RenderCore::SET_TEXTURES, bytes, timer.elapsed() );
+}
+
+bool CoreAPI::SetTexture( const int textureIdx, const CoreTexDesc& tex )
+{
+	Timer timer;
+	core->Upload( tex.idata, TexelBytes( tex ) );
+	core->Record( RenderCore::SET_TEXTURE, sizeof( CoreTexDesc ) + TexelBytes( tex ), timer.elapsed() );
+	return true;
+}
+
+void CoreAPI::SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount )
+{
+	Timer timer;
+	core->Upload( mat, materialCount * sizeof( CoreMaterial ) );
+	core->Record( RenderCore::SET_MATERIALS, materialCount * (sizeof( CoreMaterial ) + sizeof( CoreMaterialEx )), timer.elapsed() );
+}
+
+void CoreAPI::SetLights( const CoreLightTri* areaLights, const int areaLightCount,
+	const CorePointLight* pointLights, const int pointLightCount,
+	const CoreSpotLight* spotLights, const int spotLightCount,
+	const CoreDirectionalLight* directionalLights, const int directionalLightCount )
+{
+	Timer timer;
+	core->Upload( areaLights, areaLightCount * sizeof( CoreLightTri ) );
+	core->Upload( pointLights, pointLightCount * sizeof( CorePointLight ) );
+	core->Upload( spotLights, spotLightCount * sizeof( CoreSpotLight ) );
+	core->Upload( directionalLights, directionalLightCount * sizeof( CoreDirectionalLight ) );
+	const size_t bytes = areaLightCount * sizeof( CoreLightTri ) + pointLightCount * sizeof( CorePointLight ) +
+		spotLightCount * sizeof( CoreSpotLight ) + directionalLightCount * sizeof( CoreDirectionalLight );
+	core->Record( RenderCore::SET_LIGHTS, bytes, timer.elapsed() );
+}
+
+void CoreAPI::SetSkyData( const float3* pixels, const uint width, const uint height )
+{
+	Timer timer;
+	core->Upload( pixels, width * height * sizeof( float3 ) );
+	core->Record( RenderCore::SET_SKY_DATA, width * height * sizeof( float3 ), timer.elapsed() );
+}
+
+void CoreAPI::SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags )
+{
+	Timer timer;
+	core->Upload( vertexData, vertexCount * sizeof( float4 ) );
+	core->Upload( triangles, triangleCount * sizeof( CoreTri ) );
+	const size_t bytes = vertexCount * sizeof( float4 ) + triangleCount * (sizeof( CoreTri ) + (alphaFlags ? sizeof( uint ) : 0));
+	core->Record( RenderCore::SET_GEOMETRY, bytes, timer.elapsed() );
+}
+
+bool CoreAPI::UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount )
+{
+	Timer timer;
+	size_t bytes = 0;
+	for (int i = 0; i < rangeCount; i++)
+	{
+		core->Upload( vertexData + dirtyRanges[i].x * 3, dirtyRanges[i].y * 3 * sizeof( float4 ) );
+		core->Upload( triangles + dirtyRanges[i].x, dirtyRanges[i].y * sizeof( CoreTri ) );
+		bytes += dirtyRanges[i].y * (3 * sizeof( float4 ) + sizeof( CoreTri ));
+	}
+	core->Record( RenderCore::UPDATE_GEOMETRY, bytes, timer.elapsed() );
+	return true;
+}
+
+void CoreAPI::SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform )
+{
+	core->Record( RenderCore::SET_INSTANCE, sizeof( int ) + sizeof( mat4 ), 0 );
+}
+
+void CoreAPI::SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount )
+{
+	Timer timer;
+	size_t bytes = 0;
+	for (int i = 0; i < rangeCount; i++)
+	{
+		core->Upload( transforms + dirtyRanges[i].x, dirtyRanges[i].y * sizeof( mat4 ) );
+		bytes += dirtyRanges[i].y * (sizeof( int ) + sizeof( mat4 ));
+	}
+	core->Record( RenderCore::SET_INSTANCES, bytes, timer.elapsed() );
+}
+
+void CoreAPI::UpdateToplevel()
+{
+	core->Record( RenderCore::UPDATE_TOPLEVEL, 0, 0 );
+}
+
+// EOF
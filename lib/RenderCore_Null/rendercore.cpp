@@ -0,0 +1,101 @@
+/* rendercore.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "core_settings.h"
+
+using namespace lh2core;
+
+static const char* entryPointName[RenderCore::ENTRY_POINT_COUNT] = {
+	"GetCoreStats", "SetProbePos", "SetTarget", "SetHostTarget", "Setting", "Render",
+	"SetTextures", "SetTexture", "SetMaterials", "SetLights", "SetSkyData",
+	"SetGeometry", "UpdateGeometry", "SetInstance", "SetInstances", "UpdateToplevel"
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Init                                                           |
+//  |  Initialization.                                                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Init()
+{
+	for (int i = 0; i < ENTRY_POINT_COUNT; i++) callStats[i] = CallStats();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetHostTarget                                                  |
+//  |  Set the host buffer that serves as the render target.                LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetHostTarget( Bitmap* target )
+{
+	hostTarget = target;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Upload                                                         |
+//  |  Copy data to the scratch buffer, to simulate the cost of a transfer to     |
+//  |  the device.                                                          LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Upload( const void* data, const size_t bytes )
+{
+	if (data == 0 || bytes == 0) return;
+	if (scratch.size() < bytes) scratch.resize( bytes );
+	memcpy( scratch.data(), data, bytes );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Render                                                         |
+//  |  Produce one (blank) image.                                           LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Render()
+{
+	if (hostTarget) hostTarget->Clear();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Record                                                         |
+//  |  Add a call to the statistics of an entry point.                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Record( const int entryPoint, const size_t bytes, const float time )
+{
+	CallStats& s = callStats[entryPoint];
+	s.calls++;
+	s.bytes += bytes;
+	s.time += time;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::PrintStats                                                     |
+//  |  Report the per entry point statistics.                               LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::PrintStats()
+{
+	printf( "entry point         calls          MB        ms\n" );
+	for (int i = 0; i < ENTRY_POINT_COUNT; i++) if (callStats[i].calls > 0)
+	{
+		const CallStats& s = callStats[i];
+		printf( "%-16s %8i %11.3f %9.3f\n", entryPointName[i], s.calls, (double)s.bytes / (1024 * 1024), s.time * 1000 );
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Shutdown                                                       |
+//  |  Free all resources.                                                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Shutdown()
+{
+	PrintStats();
+	scratch.clear();
+}
+
+// EOF
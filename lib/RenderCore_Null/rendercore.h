@@ -0,0 +1,68 @@
+/* rendercore.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#pragma once
+
+namespace lh2core
+{
+
+//  +-----------------------------------------------------------------------------+
+//  |  CallStats                                                                  |
+//  |  Statistics for a single CoreAPI entry point.                         LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct CallStats
+{
+	uint calls = 0;									// number of calls
+	uint64_t bytes = 0;								// amount of data passed to the core
+	double time = 0;								// time spent in the core, in seconds
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore                                                                 |
+//  |  Null core: accepts all data but renders nothing. Counts calls, bytes and   |
+//  |  time per CoreAPI entry point, for benchmarking the host side without a     |
+//  |  GPU or a display. Data is copied to a scratch buffer, as a real core       |
+//  |  would copy it to the device.                                               |
+//  |  Started from the RenderCore_Minimal skeleton, but kept as a separate DLL:  |
+//  |  Minimal loads OpenGL and renders into a GL texture, which requires a       |
+//  |  context; the null core must run without one.                         LH2'19|
+//  +-----------------------------------------------------------------------------+
+class RenderCore
+{
+public:
+	enum
+	{
+		GET_CORE_STATS = 0, SET_PROBE_POS, SET_TARGET, SET_HOST_TARGET, SETTING, RENDER,
+		SET_TEXTURES, SET_TEXTURE, SET_MATERIALS, SET_LIGHTS, SET_SKY_DATA,
+		SET_GEOMETRY, UPDATE_GEOMETRY, SET_INSTANCE, SET_INSTANCES, UPDATE_TOPLEVEL, ENTRY_POINT_COUNT
+	};
+	// methods
+	void Init();
+	void SetHostTarget( Bitmap* target );
+	void Upload( const void* data, const size_t bytes );
+	void Render();
+	void Record( const int entryPoint, const size_t bytes, const float time );
+	void PrintStats();
+	void Shutdown();
+	// data members
+	Bitmap* hostTarget = 0;							// host-side render target, for headless operation
+	vector<uchar> scratch;							// stand-in for device memory
+	CallStats callStats[ENTRY_POINT_COUNT];			// per entry point statistics
+	CoreStats coreStats;							// rendering statistics
+};
+
+} // namespace lh2core
+
+// EOF
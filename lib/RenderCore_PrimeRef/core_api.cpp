@@ -84,6 +84,11 @@ void CoreAPI::SetTextures( const CoreTexDesc* tex, const int textureCount )
 	core->SetTextures( tex, textureCount );
 }
 
+bool CoreAPI::SetTexture( const int textureIdx, const CoreTexDesc& tex )
+{
+	return core->SetTexture( textureIdx, tex );
+}
+
 void CoreAPI::SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount )
 {
 	core->SetMaterials( mat, matEx, materialCount );
@@ -115,6 +120,11 @@ void CoreAPI::SetInstance( const int instanceIdx, const int modelIdx, const mat4
 	core->SetInstance( instanceIdx, modelIdx, transform );
 }
 
+void CoreAPI::SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount )
+{
+	core->SetInstances( meshIds, transforms, instanceCount, dirtyRanges, rangeCount );
+}
+
 void CoreAPI::UpdateToplevel()
 {
 	core->UpdateToplevel();
@@ -41,6 +41,8 @@ public:
 	void Shutdown();
 	// SetTextures: update the texture data in the RenderCore using the supplied data.
 	void SetTextures( const CoreTexDesc* tex, const int textureCount );
+	// SetTexture: update the texel data of a single texture.
+	bool SetTexture( const int textureIdx, const CoreTexDesc& tex );
 	// SetMaterials: update the material list used by the RenderCore. Textures referenced by the materials must be set in advance.
 	void SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount );
 	// SetLights: update the point lights, spot lights and directional lights.
@@ -54,6 +56,8 @@ public:
 	void SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags = 0 );
 	// SetInstance: update the data on a single instance.
 	void SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform = mat4::Identity() );
+	// SetInstances: update a batch of instances.
+	void SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount );
 	// UpdateTopLevel: trigger a top-level BVH update.
 	void UpdateToplevel();
 };
@@ -232,6 +232,25 @@ void RenderCore::SetInstance( const int instanceIdx, const int meshIdx, const ma
 	instances[instanceIdx]->transform = matrix;
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetInstances                                                   |
+//  |  Set instance details for a batch of instances. Only the dirty ranges are   |
+//  |  copied; the top-level structure is rebuilt in UpdateToplevel.        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount )
+{
+	// adjust the size of the instances vector
+	for (int s = (int)instances.size(), i = instanceCount; i < s; i++) delete instances[i];
+	while (instances.size() < instanceCount) instances.push_back( new CoreInstance() );
+	instances.resize( instanceCount );
+	// copy the changed instances
+	for (int i = 0; i < rangeCount; i++) for (int j = dirtyRanges[i].x; j < dirtyRanges[i].x + dirtyRanges[i].y; j++)
+	{
+		instances[j]->mesh = meshIds[j];
+		instances[j]->transform = transforms[j];
+	}
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderCore::UpdateToplevel                                                 |
 //  |  After changing meshes, instances or instance transforms, we need to        |
@@ -284,6 +303,35 @@ void RenderCore::SetTextures( const CoreTexDesc* tex, const int textures )
 	//   before allocating space for the next, thus reducing storage requirements.
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetTexture                                                     |
+//  |  Update the texels of a single texture. This is only possible if the        |
+//  |  layout of the continuous arrays does not change, i.e. if the texture keeps |
+//  |  its storage type and texel count. Otherwise we return false, and the       |
+//  |  RenderSystem will send the full set of textures instead.             LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool RenderCore::SetTexture( const int textureIdx, const CoreTexDesc& tex )
+{
+	if (textureIdx < 0 || textureIdx >= textureCount) return false;
+	CoreTexDesc& desc = texDescs[textureIdx];
+	if (desc.storage != tex.storage || desc.pixelCount != tex.pixelCount) return false;
+	desc.idata = tex.idata;
+	// copy the texels straight into the device-side continuous array
+	switch (tex.storage)
+	{
+	case TexelStorage::ARGB32:
+		CHK_CUDA( cudaMemcpy( texel32Buffer->DevPtr() + desc.firstPixel, tex.idata, tex.pixelCount * sizeof( uint ), cudaMemcpyHostToDevice ) );
+		break;
+	case TexelStorage::ARGB128:
+		CHK_CUDA( cudaMemcpy( texel128Buffer->DevPtr() + desc.firstPixel, tex.fdata, tex.pixelCount * sizeof( float4 ), cudaMemcpyHostToDevice ) );
+		break;
+	case TexelStorage::NRM32:
+		CHK_CUDA( cudaMemcpy( normal32Buffer->DevPtr() + desc.firstPixel, tex.idata, tex.pixelCount * sizeof( uint ), cudaMemcpyHostToDevice ) );
+		break;
+	}
+	return true;
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderCore::SyncStorageType                                                |
 //  |  Copies texel data for one storage type (argb32, argb128 or nrm32) to the   |
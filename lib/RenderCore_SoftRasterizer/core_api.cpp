@@ -62,6 +62,11 @@ void CoreAPI::SetTarget( GLTexture* target, const uint spp )
 	core->SetTarget( target, spp );
 }
 
+void CoreAPI::SetHostTarget( Bitmap* target, const uint spp )
+{
+	core->SetHostTarget( target, spp );
+}
+
 void CoreAPI::Setting( const char* name, float value )
 {
 	core->Setting( name, value );
@@ -77,6 +82,7 @@ void CoreAPI::Shutdown()
 	core->Shutdown();
 	delete core;
 	core = 0;
+	JobSystem::Shutdown(); // the job system of this DLL; the RenderSystem stops its own
 }
 
 void CoreAPI::SetTextures( const CoreTexDesc* tex, const int textureCount )
@@ -84,6 +90,11 @@ void CoreAPI::SetTextures( const CoreTexDesc* tex, const int textureCount )
 	core->SetTextures( tex, textureCount );
 }
 
+bool CoreAPI::SetTexture( const int textureIdx, const CoreTexDesc& tex )
+{
+	return core->SetTexture( textureIdx, tex );
+}
+
 void CoreAPI::SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount )
 {
 	core->SetMaterials( mat, matEx, materialCount );
@@ -33,6 +33,8 @@ public:
 	void SetProbePos( const int2 pos );
 	// SetTarget: specify an OpenGL texture as a render target for the path tracer.
 	void SetTarget( GLTexture* target, const uint spp );
+	// SetHostTarget: specify a host-side buffer as a render target, for headless operation without OpenGL.
+	void SetHostTarget( Bitmap* target, const uint spp );
 	// Setting: modify a render setting
 	void Setting( const char* name, float value );
 	// Render: produce one frame. Convergence can be 'Converge' or 'Restart'.
@@ -41,6 +43,8 @@ public:
 	void Shutdown();
 	// SetTextures: update the texture data in the RenderCore using the supplied data.
 	void SetTextures( const CoreTexDesc* tex, const int textureCount );
+	// SetTexture: update the texel data of a single texture.
+	bool SetTexture( const int textureIdx, const CoreTexDesc& tex );
 	// SetMaterials: update the material list used by the RenderCore. Textures referenced by the materials must be set in advance.
 	void SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount );
 	// SetLights: update the point lights, spot lights and directional lights.
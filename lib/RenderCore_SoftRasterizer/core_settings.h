@@ -22,6 +22,15 @@
 
 // core-specific settings
 // #define NOTEXTURES		// all texture reads will be white
+#define TILESIZE		64		// size of a screen tile in the binned rasterizer, in pixels
+#define BATCHSIZE		2048	// maximum number of triangles in a geometry batch
+#define CLUSTERSIZE		256		// triangles per occlusion-tested cluster; BATCHSIZE must be a multiple of this
+#define HIZ_SCALE		4		// size of a level 0 texel of the depth pyramid, in pixels
+#define OCCLUDERS		16		// maximum number of meshes in the depth pre-pass
+#define OCCLUDER_TRIS	32768	// maximum number of triangles in the depth pre-pass
+#define SUBPIXEL_BITS	4		// fixed-point precision of the screen-space vertex positions
+#define GUARDBAND		8192	// triangles are only clipped if they reach beyond this many pixels from the screen center;
+								// GUARDBAND << (2 * SUBPIXEL_BITS) must stay below 2^22 for the integer edge functions
 
 #include "platform.h"
 
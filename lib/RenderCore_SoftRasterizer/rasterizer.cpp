@@ -18,6 +18,16 @@
 
 #include "core_settings.h"
 
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_FUNCTION
+#else
+#define __popcnt __builtin_popcount
+#define AVX2_FUNCTION __attribute__(( target( "avx2" ) ))
+#endif
+
+static inline int Pad8( const int n ) { return (n + 7) & ~7; }
+
 uint ScaleColor( uint c, int scale )
 {
 	unsigned int rb = (((c & 0xff00ff) * scale) >> 8) & 0xff00ff;
@@ -26,22 +36,93 @@ uint ScaleColor( uint c, int scale )
 }
 
 // -----------------------------------------------------------
-// static data for the rasterizer
+// Lerp
+// blend two colors; weight in 0..256
+// -----------------------------------------------------------
+inline uint Lerp( const uint a, const uint b, const uint w )
+{
+	const uint rb = (((a & 0xff00ff) * (256 - w) + (b & 0xff00ff) * w) >> 8) & 0xff00ff;
+	const uint g = (((a & 0xff00) * (256 - w) + (b & 0xff00) * w) >> 8) & 0xff00;
+	return rb + g;
+}
+
+// -----------------------------------------------------------
+// Texture::SetSize
+// set the size of level 0, and locate the MIP levels
+// -----------------------------------------------------------
+void Texture::SetSize( int w, int h )
+{
+	width = w, height = h;
+	levelOffset[0] = 0, levelWidth[0] = w, levelHeight[0] = h, levels = 1;
+	uint offset = w * h;
+	while (levels < min( MIPlevels, MIPLEVELCOUNT ))
+	{
+		w >>= 1, h >>= 1;
+		if (w == 0 || h == 0 || offset + w * h > pixelCount) break;
+		levelOffset[levels] = offset, levelWidth[levels] = w, levelHeight[levels++] = h, offset += w * h;
+	}
+}
+
+// -----------------------------------------------------------
+// Gradients class
+// screen-space derivatives of 1/z, u/z and v/z
+// -----------------------------------------------------------
+struct Gradients { float dzdx, dudx, dvdx, dzdy, dudy, dvdy; };
+static Gradients TriangleGradients( const ScreenVertex* p )
+{
+	Gradients g;
+	const float dx1 = p[1].x - p[0].x, dy1 = p[1].y - p[0].y, dx2 = p[2].x - p[0].x, dy2 = p[2].y - p[0].y;
+	const float rarea = 1.0f / (dx1 * dy2 - dx2 * dy1);
+	const float dz1 = p[1].z - p[0].z, dz2 = p[2].z - p[0].z;
+	const float du1 = p[1].u - p[0].u, du2 = p[2].u - p[0].u;
+	const float dv1 = p[1].v - p[0].v, dv2 = p[2].v - p[0].v;
+	g.dzdx = (dz1 * dy2 - dz2 * dy1) * rarea, g.dzdy = (dz2 * dx1 - dz1 * dx2) * rarea;
+	g.dudx = (du1 * dy2 - du2 * dy1) * rarea, g.dudy = (du2 * dx1 - du1 * dx2) * rarea;
+	g.dvdx = (dv1 * dy2 - dv2 * dy1) * rarea, g.dvdy = (dv2 * dx1 - dv1 * dx2) * rarea;
+	return g;
+}
+
+// -----------------------------------------------------------
+// SelectLevel
+// MIP level for a texel footprint; rho2 is the squared length
+// of the largest texture coordinate derivative, in level 0
+// texels per pixel
+// -----------------------------------------------------------
+static int SelectLevel( const Texture& tex, const float rho2 )
+{
+	return rho2 <= 1 ? 0 : min( tex.levels - 1, (int)(0.5f * log2f( rho2 )) );
+}
+static int SelectLevel( const Texture& tex, const Gradients& g, const float z, const float u, const float v )
+{
+	// derivatives of (u/z) / (1/z)
+	if (tex.levels == 1) return 0;
+	const float rz2 = 1.0f / (z * z);
+	const float ux = (g.dudx * z - u * g.dzdx) * rz2 * tex.width, vx = (g.dvdx * z - v * g.dzdx) * rz2 * tex.height;
+	const float uy = (g.dudy * z - u * g.dzdy) * rz2 * tex.width, vy = (g.dvdy * z - v * g.dzdy) * rz2 * tex.height;
+	return SelectLevel( tex, max( ux * ux + vx * vx, uy * uy + vy * vy ) );
+}
+
+// -----------------------------------------------------------
+// SampleBilinear
+// bilinear texture lookup in a MIP level, with wrapping
 // -----------------------------------------------------------
-Surface* Mesh::screen = 0;
-float* Mesh::xleft, *Mesh::xright, *Mesh::uleft, *Mesh::uright;
-float* Mesh::vleft, *Mesh::vright, *Mesh::zleft, *Mesh::zright;
-Scene Rasterizer::scene;
-float* Rasterizer::zbuffer;
-float4 Rasterizer::frustum[5];
-static float3 raxis[3] = { make_float3( 1, 0, 0 ), make_float3( 0, 1, 0 ), make_float3( 0, 0, 1 ) };
+static uint SampleBilinear( const Texture& tex, const int level, const float u, const float v )
+{
+	const int w = tex.levelWidth[level], h = tex.levelHeight[level];
+	const uint* pixels = tex.pixels + tex.levelOffset[level];
+	const float x = (u - floorf( u )) * w - 0.5f, y = (v - floorf( v )) * h - 0.5f;
+	const int ix = clamp( (int)floorf( x ), -1, w - 1 ), iy = clamp( (int)floorf( y ), -1, h - 1 );
+	const uint fx = (uint)clamp( (x - ix) * 256, 0.0f, 256.0f ), fy = (uint)clamp( (y - iy) * 256, 0.0f, 256.0f );
+	const int x0 = ix < 0 ? w - 1 : ix, x1 = ix + 1 == w ? 0 : ix + 1;
+	const int y0 = (iy < 0 ? h - 1 : iy) * w, y1 = (iy + 1 == h ? 0 : iy + 1) * w;
+	return Lerp( Lerp( pixels[x0 + y0], pixels[x1 + y0], fx ), Lerp( pixels[x0 + y1], pixels[x1 + y1], fx ), fy );
+}
 
 // -----------------------------------------------------------
 // Mesh constructor
 // input: vertex count & face count
 // allocates room for mesh data:
-// - pos:  vertex positions
-// - tpos: transformed vertex positions
+// - px, py, pz: vertex positions (SoA)
 // - norm: vertex normals
 // - spos: vertex screen space positions
 // - uv:   vertex uv coordinates
@@ -50,180 +131,1077 @@ static float3 raxis[3] = { make_float3( 1, 0, 0 ), make_float3( 0, 1, 0 ), make_
 // -----------------------------------------------------------
 Mesh::Mesh( int vcount, int tcount ) : verts( vcount ), tris( tcount )
 {
-	pos = new float3[vcount * 3], tpos = pos + vcount, norm = pos + 2 * vcount;
+	const int stride = Pad8( vcount );
+	px = new float[stride * 3](), py = px + stride, pz = py + stride;
+	norm = new float3[vcount];
 	spos = new float2[vcount * 2], uv = spos + vcount, N = new float3[tcount];
 	tri = new int[tcount * 3];
 	material = new int[tcount];
 }
 
 // -----------------------------------------------------------
-// Mesh render function
-// input: final matrix for scene graph node
-// renders a mesh using software rasterization.
-// stages:
-// 1. mesh culling: checks the mesh against the view frustum
-// 2. vertex transform: calculates world space coordinates
-// 3. triangle rendering loop. substages:
-//    a) backface culling
-//    b) clipping (Sutherland-Hodgeman)
-//    c) shading (using pre-scaled palettes for speed)
-//    d) projection: world-space to 2D screen-space
-//    e) span construction
-//    f) span filling
+// Mesh::UpdateBounds
+// calculate the bounds of the mesh, and of each cluster of
+// CLUSTERSIZE triangles
+// -----------------------------------------------------------
+void Mesh::UpdateBounds()
+{
+	bounds[0] = make_float3( 1e34f ), bounds[1] = make_float3( -1e34f );
+	clusterBounds.resize( ((tris + CLUSTERSIZE - 1) / CLUSTERSIZE) * 2 );
+	for (int c = 0; c < (int)clusterBounds.size() / 2; c++)
+	{
+		float3 bmin = make_float3( 1e34f ), bmax = make_float3( -1e34f );
+		for (int i = c * CLUSTERSIZE * 3; i < min( tris, (c + 1) * CLUSTERSIZE ) * 3; i++)
+			bmin = fminf( bmin, Pos( tri[i] ) ), bmax = fmaxf( bmax, Pos( tri[i] ) );
+		clusterBounds[c * 2] = bmin, clusterBounds[c * 2 + 1] = bmax;
+		bounds[0] = fminf( bounds[0], bmin ), bounds[1] = fmaxf( bounds[1], bmax );
+	}
+}
+
+// -----------------------------------------------------------
+// TransformSoA
+// transform n points (w = 1) or directions (w = 0), stored
+// as separate x, y and z arrays, by the top three rows of a
+// matrix; n is a multiple of 8, and the output may overwrite
+// the input. the AVX2 version transforms 8 at a time, using
+// the same operations in the same order as the scalar code
+// -----------------------------------------------------------
+static void TransformScalar( const float* M, const float w, const float* x, const float* y, const float* z, float* ox, float* oy, float* oz, const int n )
+{
+	const float tx = M[3] * w, ty = M[7] * w, tz = M[11] * w;
+	for (int i = 0; i < n; i++)
+	{
+		const float X = x[i], Y = y[i], Z = z[i];
+		ox[i] = M[0] * X + M[1] * Y + M[2] * Z + tx;
+		oy[i] = M[4] * X + M[5] * Y + M[6] * Z + ty;
+		oz[i] = M[8] * X + M[9] * Y + M[10] * Z + tz;
+	}
+}
+AVX2_FUNCTION static void TransformAVX2( const float* M, const float w, const float* x, const float* y, const float* z, float* ox, float* oy, float* oz, const int n )
+{
+	__m256 m[12];
+	for (int i = 0; i < 12; i++) m[i] = _mm256_set1_ps( (i & 3) == 3 ? M[i] * w : M[i] );
+	for (int i = 0; i < n; i += 8)
+	{
+		const __m256 X = _mm256_loadu_ps( x + i ), Y = _mm256_loadu_ps( y + i ), Z = _mm256_loadu_ps( z + i );
+		__m256 r[3];
+		for (int j = 0; j < 3; j++) r[j] = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( m[j * 4], X ),
+			_mm256_mul_ps( m[j * 4 + 1], Y ) ), _mm256_mul_ps( m[j * 4 + 2], Z ) ), m[j * 4 + 3] );
+		_mm256_storeu_ps( ox + i, r[0] ), _mm256_storeu_ps( oy + i, r[1] ), _mm256_storeu_ps( oz + i, r[2] );
+	}
+}
+static void TransformSoA( const bool avx2, const float* M, const float w, const float* x, const float* y, const float* z, float* ox, float* oy, float* oz, const int n )
+{
+	if (avx2) TransformAVX2( M, w, x, y, z, ox, oy, oz, n ); else TransformScalar( M, w, x, y, z, ox, oy, oz, n );
+}
+
+// -----------------------------------------------------------
+// BackfaceMask
+// bit i is set if triangle first + i faces away from the
+// camera, for up to 8 triangles; uses the world-space
+// vertices and face normals of an instance, so normals are
+// not transformed per view
+// -----------------------------------------------------------
+static uint BackfaceScalar( const Mesh& m, const float* world, const float3& eye, const int first )
+{
+	const int stride = Pad8( m.verts ), nstride = Pad8( m.tris );
+	const float* nx = world + stride * 3, * ny = nx + nstride, * nz = ny + nstride;
+	uint mask = 0;
+	for (int t = first, i = 0; i < 8 && t < m.tris; i++, t++)
+	{
+		const int v = m.tri[t * 3];
+		const float X = world[v] - eye.x, Y = world[v + stride] - eye.y, Z = world[v + stride * 2] - eye.z;
+		if (nx[t] * X + ny[t] * Y + nz[t] * Z > 0) mask |= 1 << i;
+	}
+	return mask;
+}
+AVX2_FUNCTION static uint BackfaceAVX2( const Mesh& m, const float* world, const float3& eye, const int first )
+{
+	if (first + 8 > m.tris) return BackfaceScalar( m, world, eye, first );
+	const int stride = Pad8( m.verts ), nstride = Pad8( m.tris );
+	const float* nx = world + stride * 3, * ny = nx + nstride, * nz = ny + nstride;
+	const __m256i v = _mm256_i32gather_epi32( m.tri + first * 3, _mm256_setr_epi32( 0, 3, 6, 9, 12, 15, 18, 21 ), 4 );
+	const __m256 X = _mm256_sub_ps( _mm256_i32gather_ps( world, v, 4 ), _mm256_set1_ps( eye.x ) );
+	const __m256 Y = _mm256_sub_ps( _mm256_i32gather_ps( world + stride, v, 4 ), _mm256_set1_ps( eye.y ) );
+	const __m256 Z = _mm256_sub_ps( _mm256_i32gather_ps( world + stride * 2, v, 4 ), _mm256_set1_ps( eye.z ) );
+	const __m256 d = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_loadu_ps( nx + first ), X ),
+		_mm256_mul_ps( _mm256_loadu_ps( ny + first ), Y ) ), _mm256_mul_ps( _mm256_loadu_ps( nz + first ), Z ) );
+	return (uint)_mm256_movemask_ps( _mm256_cmp_ps( d, _mm256_setzero_ps(), _CMP_GT_OQ ) );
+}
+static uint BackfaceMask( const bool avx2, const Mesh& m, const float* world, const float3& eye, const int first )
+{
+	return avx2 ? BackfaceAVX2( m, world, eye, first ) : BackfaceScalar( m, world, eye, first );
+}
+
+// -----------------------------------------------------------
+// Instance::Set
+// store the mesh and the transform of an instance; the world-
+// space data is recalculated by Scene::Update
+// -----------------------------------------------------------
+void Instance::Set( const int meshIdx, const mat4& transform )
+{
+	mesh = meshIdx, dirty = true;
+	memcpy( T, transform.cell, sizeof( T ) );
+}
+
+// -----------------------------------------------------------
+// Instance::Update
+// transform the vertices and face normals of the mesh to
+// world space, and calculate the world-space bounds
 // -----------------------------------------------------------
-void Mesh::Render( const mat4& T )
+void Instance::Update( const Mesh& m, const bool avx2 )
+{
+	const int stride = Pad8( m.verts ), nstride = Pad8( m.tris );
+	world.resize( stride * 3 + nstride * 3 );
+	float* wx = world.data(), * wy = wx + stride, * wz = wy + stride;
+	float* nx = wz + stride, * ny = nx + nstride, * nz = ny + nstride;
+	for (int i = 0; i < m.tris; i++) nx[i] = m.N[i].x, ny[i] = m.N[i].y, nz[i] = m.N[i].z;
+	TransformSoA( avx2, T, 1, m.px, m.py, m.pz, wx, wy, wz, stride );
+	TransformSoA( avx2, T, 0, nx, ny, nz, nx, ny, nz, nstride );
+	bounds[0] = make_float3( 1e34f ), bounds[1] = make_float3( -1e34f );
+	for (int i = 0; i < m.verts; i++)
+		bounds[0] = fminf( bounds[0], make_float3( wx[i], wy[i], wz[i] ) ),
+		bounds[1] = fmaxf( bounds[1], make_float3( wx[i], wy[i], wz[i] ) );
+	dirty = false;
+}
+
+// -----------------------------------------------------------
+// Scene::Update
+// recalculate the world-space data of the changed instances;
+// call this before rendering, not while a view renders
+// -----------------------------------------------------------
+void Scene::Update()
+{
+	vector<int> changed;
+	for (int s = (int)instances.size(), i = 0; i < s; i++) if (instances[i].dirty && instances[i].mesh >= 0) changed.push_back( i );
+	const bool avx2 = Rasterizer::AVX2Supported();
+	parallel_for( 0, (int)changed.size(), 1, [&]( int i ) {
+		Instance& instance = instances[changed[i]];
+		instance.Update( *meshes[instance.mesh], avx2 );
+	} );
+}
+
+// -----------------------------------------------------------
+// Scene destructor
+// -----------------------------------------------------------
+Scene::~Scene()
+{
+	for (auto mesh : meshes) delete mesh;
+	for (auto tex : texList) delete tex;
+	for (auto mat : matList) delete mat;
+}
+
+// -----------------------------------------------------------
+// Rasterizer::Reinit
+// initialization that depends on screen size
+// input: screen size, surface to draw to
+// -----------------------------------------------------------
+void Rasterizer::Reinit( int w, int h, Surface* target )
+{
+	tilesX = (w + TILESIZE - 1) / TILESIZE;
+	tilesY = (h + TILESIZE - 1) / TILESIZE;
+	// calculate view frustum planes
+	float C = -1.0f, x1 = 0.5f, x2 = w - 1.5f, y1 = 0.5f, y2 = h - 1.5f;
+	float3 p0 = { 0, 0, 0 };
+	float3 p1 = { ((x1 - w * 0.5f) * C) / w, ((y1 - h * 0.5f) * C) / w, 1.0f };
+	float3 p2 = { ((x2 - w * 0.5f) * C) / w, ((y1 - h * 0.5f) * C) / w, 1.0f };
+	float3 p3 = { ((x2 - w * 0.5f) * C) / w, ((y2 - h * 0.5f) * C) / w, 1.0f };
+	float3 p4 = { ((x1 - w * 0.5f) * C) / w, ((y2 - h * 0.5f) * C) / w, 1.0f };
+	frustum[0] = { 0, 0, -1, 0.2f };
+	float3 a( normalize( cross( p1 - p0, p4 - p1 ) ) ); frustum[1] = make_float4( a, 0 ); // left plane
+	float3 b( normalize( cross( p2 - p0, p1 - p2 ) ) ); frustum[2] = make_float4( b, 0 ); // top plane
+	float3 c( normalize( cross( p3 - p0, p2 - p3 ) ) ); frustum[3] = make_float4( c, 0 ); // right plane
+	float3 d( normalize( cross( p4 - p0, p3 - p4 ) ) ); frustum[4] = make_float4( d, 0 ); // bottom plane
+	// clipping planes: near plane, and the guard band, where screen coordinates reach GUARDBAND pixels from the center
+	const float W = (float)w, G = GUARDBAND;
+	clipPlanes[0] = frustum[0];
+	clipPlanes[1] = make_float4( normalize( make_float3( -W, 0, -G ) ), 0 ), clipPlanes[2] = make_float4( normalize( make_float3( W, 0, -G ) ), 0 );
+	clipPlanes[3] = make_float4( normalize( make_float3( 0, -W, -G ) ), 0 ), clipPlanes[4] = make_float4( normalize( make_float3( 0, W, -G ) ), 0 );
+	// store screen pointer
+	screen = target;
+	hiz.Reinit( w, h );
+}
+
+// -----------------------------------------------------------
+// Rasterizer::ProjectBounds
+// calculate the screen rectangle and the nearest depth of a
+// bounding box
+// input: box, camera-space transform
+// output: false if the box is (partially) in front of the
+// near plane
+// -----------------------------------------------------------
+bool Rasterizer::ProjectBounds( const float3& bmin, const float3& bmax, const mat4& T, ScreenBounds& b ) const
+{
+	const int w = screen->width, h = screen->height;
+	b.x0 = b.y0 = 1e30f, b.x1 = b.y1 = -1e30f, b.z = 0;
+	for (int i = 0; i < 8; i++)
+	{
+		const float3 c = make_float3( T * make_float4( i & 1 ? bmax.x : bmin.x, i & 2 ? bmax.y : bmin.y, i & 4 ? bmax.z : bmin.z, 1 ) );
+		if ((dot( make_float3( frustum[0] ), c ) - frustum[0].w) < 0) return false;
+		const float x = ((c.x * w) / -c.z) + w / 2, y = ((c.y * w) / c.z) + h / 2;
+		b.x0 = min( b.x0, x ), b.x1 = max( b.x1, x ), b.y0 = min( b.y0, y ), b.y1 = max( b.y1, y );
+		b.z = min( b.z, 1.0f / c.z );
+	}
+	return true;
+}
+
+// -----------------------------------------------------------
+// Rasterizer::AddMesh
+// culls a mesh against the view frustum using its object-
+// space bounds; stores the instance if it is (partially)
+// visible
+// input: mesh, camera-space transform, core instance index
+// -----------------------------------------------------------
+void Rasterizer::AddMesh( const Mesh* mesh, const mat4& T, const int instanceIdx )
 {
 	// cull mesh
 	float3 c[8];
-	for (int i = 0; i < 8; i++) c[i] = make_float3( T * make_float4( bounds[i & 1].x, bounds[(i >> 1) & 1].y, bounds[i >> 2].z, 1 ) );
+	for (int i = 0; i < 8; i++) c[i] = make_float3( T * make_float4( mesh->bounds[i & 1].x, mesh->bounds[(i >> 1) & 1].y, mesh->bounds[i >> 2].z, 1 ) );
 	for (int i, p = 0; p < 5; p++)
 	{
-		for (i = 0; i < 8; i++) if ((dot( make_float3( Rasterizer::frustum[p] ), c[i] ) - Rasterizer::frustum[p].w) > 0) break;
+		for (i = 0; i < 8; i++) if ((dot( make_float3( frustum[p] ), c[i] ) - frustum[p].w) > 0) break;
 		if (i == 8) return;
 	}
-	// transform vertices
-	for (int i = 0; i < verts; i++) tpos[i] = make_float3( make_float4( pos[i], 1 ) * T );
-	// draw triangles
-	for (int i = 0; i < tris; i++)
-	{
-		Material* mat = Rasterizer::scene.matList[material[i]];
-		static uint p;
-		uint* src = mat->texture ? mat->texture->pixels : &p;
-		if (!mat->texture) p = mat->diffuse;
-		float* zbuffer = Rasterizer::zbuffer, f;
-		const float tw = mat->texture ? (float)mat->texture->width : 1;
-		const float th = mat->texture ? (float)mat->texture->height : 1;
-		const int umask = (int)tw - 1, vmask = (int)th - 1;
+	// store the instance; occlusion culling happens once the depth pyramid is ready
+	if (instanceCount == instances.size()) instances.push_back( VisibleInstance() );
+	VisibleInstance& instance = instances[instanceCount++];
+	instance.mesh = mesh, instance.T = T, instance.id = instanceIdx, instance.occluder = -1;
+	instance.projected = ProjectBounds( mesh->bounds[0], mesh->bounds[1], T, instance.bounds );
+}
+
+// -----------------------------------------------------------
+// DrawOccluder
+// conservative rasterization of an occluder triangle into
+// level 0 of the depth pyramid: a texel is only written if
+// the triangle covers all of its pixels, and it receives the
+// farthest depth of the triangle within the texel
+// input: triangle in texel coordinates, depth as 1/z; range
+// of texel rows to draw
+// -----------------------------------------------------------
+static void DrawOccluder( const float3* p, float* depth, const int2 size, const int rowMin, const int rowMax )
+{
+	// pixel centers of texel (x, y) span [x, x + 2 * half] in texel coordinates
+	const float half = (HIZ_SCALE - 1) * 0.5f / HIZ_SCALE;
+	float area = (p[1].x - p[0].x) * (p[2].y - p[0].y) - (p[2].x - p[0].x) * (p[1].y - p[0].y);
+	if (area == 0) return;
+	const float3 v[3] = { p[0], area > 0 ? p[1] : p[2], area > 0 ? p[2] : p[1] }; // counter-clockwise
+	area = fabs( area );
+	const float minx = min( v[0].x, min( v[1].x, v[2].x ) ), maxx = max( v[0].x, max( v[1].x, v[2].x ) );
+	const float miny = min( v[0].y, min( v[1].y, v[2].y ) ), maxy = max( v[0].y, max( v[1].y, v[2].y ) );
+	const int x0 = (int)ceilf( max( 0.0f, minx ) ), x1 = (int)floorf( min( (float)(size.x - 1), maxx - 2 * half ) );
+	const int y0 = (int)ceilf( max( (float)rowMin, miny ) ), y1 = (int)floorf( min( (float)rowMax, maxy - 2 * half ) );
+	if (x0 > x1 || y0 > y1) return;
+	// edge functions, moved inwards so that they test the corner of the texel that is farthest out
+	float a[3], b[3], c[3];
+	for (int i = 0; i < 3; i++)
+	{
+		const float3& A = v[i], & B = v[(i + 1) % 3];
+		a[i] = A.y - B.y, b[i] = B.x - A.x, c[i] = -(a[i] * A.x + b[i] * A.y) + (a[i] + b[i]) * half - (fabs( a[i] ) + fabs( b[i] )) * half;
+	}
+	// depth plane at the texel origin, plus the largest depth increase within the texel
+	const float rarea = 1.0f / area;
+	const float dx1 = v[1].x - v[0].x, dy1 = v[1].y - v[0].y, dx2 = v[2].x - v[0].x, dy2 = v[2].y - v[0].y;
+	const float dz1 = v[1].z - v[0].z, dz2 = v[2].z - v[0].z;
+	const float dzdx = (dz1 * dy2 - dz2 * dy1) * rarea, dzdy = (dz2 * dx1 - dz1 * dx2) * rarea;
+	const float z0 = v[0].z - dzdx * v[0].x - dzdy * v[0].y + (dzdx + dzdy) * half + (fabs( dzdx ) + fabs( dzdy )) * half;
+	for (int y = y0; y <= y1; y++)
+	{
+		float* row = depth + y * size.x;
+		for (int x = x0; x <= x1; x++)
+		{
+			const float fx = (float)x, fy = (float)y;
+			if (a[0] * fx + b[0] * fy + c[0] < 0 || a[1] * fx + b[1] * fy + c[1] < 0 || a[2] * fx + b[2] * fy + c[2] < 0) continue;
+			row[x] = min( row[x], z0 + dzdx * fx + dzdy * fy );
+		}
+	}
+}
+
+// -----------------------------------------------------------
+// Rasterizer::RenderOccluders
+// depth pre-pass: the meshes that cover the largest part of
+// the screen are rendered into the depth pyramid
+// -----------------------------------------------------------
+void Rasterizer::RenderOccluders()
+{
+	// select the occluders
+	const int w = screen->width, h = screen->height;
+	vector<std::pair<float, int>> candidates( instanceCount );
+	for (int i = 0; i < instanceCount; i++)
+	{
+		const VisibleInstance& instance = instances[i];
+		const ScreenBounds& b = instance.bounds;
+		const float area = instance.projected ? max( 0.0f, min( (float)w, b.x1 ) - max( 0.0f, b.x0 ) ) * max( 0.0f, min( (float)h, b.y1 ) - max( 0.0f, b.y0 ) ) : (float)(w * h);
+		candidates[i] = std::make_pair( area, i );
+	}
+	std::sort( candidates.begin(), candidates.end(), []( const std::pair<float, int>& a, const std::pair<float, int>& b ) { return a.first > b.first; } );
+	vector<int> occluders;
+	int budget = OCCLUDER_TRIS;
+	for (int i = 0; i < instanceCount && occluders.size() < OCCLUDERS; i++)
+	{
+		const int tris = instances[candidates[i].second].mesh->tris;
+		if (tris <= budget) occluders.push_back( candidates[i].second ), budget -= tris;
+	}
+	// transform, cull, clip and project the occluder triangles; the camera-space vertices are kept for the batches
+	occluderTris.resize( occluders.size() );
+	occluderVerts.resize( occluders.size() );
+	for (int o = 0; o < (int)occluders.size(); o++) instances[occluders[o]].occluder = o;
+	parallel_for( 0, (int)occluders.size(), 1, [&]( int o ) {
+		const Mesh* mesh = instances[occluders[o]].mesh;
+		const float* world = scene->instances[instances[occluders[o]].id].world.data();
+		const int stride = Pad8( mesh->verts );
+		vector<float>& cam = occluderVerts[o];
+		cam.resize( stride * 3 );
+		float* cx = cam.data(), * cy = cx + stride, * cz = cy + stride;
+		TransformSoA( avx2, view.cell, 1, world, world + stride, world + stride * 2, cx, cy, cz, stride );
+		const float rscale = 1.0f / HIZ_SCALE;
+		vector<float3>& tris = occluderTris[o];
+		tris.clear();
+		uint backfaces = 0;
+		for (int i = 0; i < mesh->tris; i++)
+		{
+			if ((i & 7) == 0) backfaces = BackfaceMask( avx2, *mesh, world, eye, i );
+			if (backfaces & (1 << (i & 7))) continue; // backfaces are not drawn, so they do not occlude
+			float3 tpos[3];
+			for (int v = 0; v < 3; v++) { const int k = mesh->tri[i * 3 + v]; tpos[v] = make_float3( cx[k], cy[k], cz[k] ); }
+			// clip against the near plane
+			float3 cpos[4], spos[4];
+			int n = 0;
+			for (int v = 0; v < 3; v++)
+			{
+				const float3 A = tpos[v], B = tpos[(v + 1) % 3];
+				const float t1 = dot( make_float3( frustum[0] ), A ) - frustum[0].w, t2 = dot( make_float3( frustum[0] ), B ) - frustum[0].w;
+				if (t1 >= 0) cpos[n++] = A;
+				if ((t1 >= 0) != (t2 >= 0)) cpos[n++] = A + (t1 / (t1 - t2)) * (B - A);
+			}
+			// project to level 0 texels, and emit a triangle fan
+			for (int v = 0; v < n; v++)
+				spos[v] = make_float3( (((cpos[v].x * w) / -cpos[v].z) + w / 2) * rscale, (((cpos[v].y * w) / cpos[v].z) + h / 2) * rscale, 1.0f / cpos[v].z );
+			for (int v = 1; v < n - 1; v++) tris.push_back( spos[0] ), tris.push_back( spos[v] ), tris.push_back( spos[v + 1] );
+		}
+	} );
+	// rasterize the occluders in bands of texel rows, and build the pyramid
+	hiz.Clear();
+	const int2 size = hiz.size[0];
+	parallel_for( 0, (size.y + 15) / 16, 1, [&]( int band ) {
+		for (const vector<float3>& tris : occluderTris) for (size_t i = 0; i < tris.size(); i += 3)
+			DrawOccluder( &tris[i], hiz.level[0].data(), size, band * 16, min( size.y - 1, band * 16 + 15 ) );
+	} );
+	hiz.Build();
+}
+
+// -----------------------------------------------------------
+// Rasterizer::ProcessBatch
+// geometry stage for a range of triangles:
+// -) occlusion culling of triangle clusters
+// a) vertex transform: calculates camera space coordinates,
+//    8 vertices at a time, per cluster of triangles; skipped
+//    if the depth pre-pass transformed the mesh already
+// b) backface culling, 8 triangles at a time
+// c) clipping (Sutherland-Hodgeman), only for triangles that
+//    cross the near plane or reach beyond the guard band; the
+//    rasterizer scissors the others to the screen tiles
+// d) shading (using pre-scaled palettes for speed)
+// e) projection: camera-space to 2D screen-space; in
+//    visibility mode, barycentrics replace the texture
+//    coordinates
+// f) binning: counts the triangles per screen tile
+// -----------------------------------------------------------
+void Rasterizer::ProcessBatch( GeometryBatch& batch )
+{
+	const Mesh* mesh = batch.mesh;
+	const mat4& T = batch.T;
+	const int w = screen->width, h = screen->height;
+	const bool testClusters = occlusionCulling && mesh->clusterBounds.size() > 2;
+	batch.tris.clear();
+	batch.tileCount.assign( tilesX * tilesY, 0 );
+	batch.culledTris = batch.clippedTris = 0;
+	const float* world = scene->instances[batch.instance].world.data();
+	const int stride = Pad8( mesh->verts );
+	const float* cx = batch.shared, * cy = 0, * cz = 0;
+	if (cx) cy = cx + stride, cz = cy + stride;
+	int firstVert = 0;
+	uint backfaces = 0;
+	for (int i = batch.firstTri; i < batch.lastTri; i++)
+	{
+		if ((i % CLUSTERSIZE) == 0)
+		{
+			// skip occluded clusters
+			const int c = i / CLUSTERSIZE, last = min( batch.lastTri, i + CLUSTERSIZE );
+			ScreenBounds b;
+			if (testClusters && ProjectBounds( mesh->clusterBounds[c * 2], mesh->clusterBounds[c * 2 + 1], T, b ) && hiz.Occluded( b ))
+			{
+				batch.culledTris += last - i, i = last - 1;
+				continue;
+			}
+			// transform the vertices of the cluster
+			if (!batch.shared)
+			{
+				int vmin = mesh->verts, vmax = 0;
+				for (int j = i * 3; j < last * 3; j++) vmin = min( vmin, mesh->tri[j] ), vmax = max( vmax, mesh->tri[j] );
+				const int n = Pad8( vmax + 1 - (firstVert = vmin & ~7) );
+				batch.cam.resize( n * 3 );
+				float* out = batch.cam.data();
+				TransformSoA( avx2, view.cell, 1, world + firstVert, world + stride + firstVert, world + stride * 2 + firstVert, out, out + n, out + n * 2, n );
+				cx = out, cy = out + n, cz = out + n * 2;
+			}
+		}
 		// cull triangle
-		float3 Nt = make_float3( make_float4( N[i], 0 ) * T );
-		if (dot( tpos[tri[i * 3 + 0]], Nt ) > 0) continue;
-		// clip
+		if ((i & 7) == 0) backfaces = BackfaceMask( avx2, *mesh, world, eye, i );
+		if (backfaces & (1 << (i & 7))) continue;
+		// fetch the transformed vertices
+		float3 tpos[3];
+		for (int v = 0; v < 3; v++) { const int k = mesh->tri[i * 3 + v] - firstVert; tpos[v] = make_float3( cx[k], cy[k], cz[k] ); }
+		// outcodes: one bit per clipping plane that a vertex is outside of
+		uint outcode[3] = { 0, 0, 0 };
+		for (int v = 0; v < 3; v++) for (int p = 0; p < 5; p++)
+			if (dot( make_float3( clipPlanes[p] ), tpos[v] ) - clipPlanes[p].w < 0) outcode[v] |= 1 << p;
+		if (outcode[0] & outcode[1] & outcode[2]) continue; // entirely outside the near plane or the guard band
+		const uint clipCode = outcode[0] | outcode[1] | outcode[2];
+		// clip, against the crossed planes only
 		float3 cpos[2][8], *pos;
 		float2 cuv[2][8], *tuv;
-		int nin = 3, nout = 0, from = 0, to = 1, miny = screen->height - 1, maxy = 0, h;
-		for (int v = 0; v < 3; v++) cpos[0][v] = tpos[tri[i * 3 + v]], cuv[0][v] = uv[tri[i * 3 + v]];
-		for (int p = 0; p < 2; p++, from = 1 - from, to = 1 - to, nin = nout, nout = 0) for (int v = 0; v < nin; v++)
-		{
-			const float3 A = cpos[from][v], B = cpos[from][(v + 1) % nin];
-			const float2 Auv = cuv[from][v], Buv = cuv[from][(v + 1) % nin];
-			const float4 plane = Rasterizer::frustum[p];
-			const float t1 = dot( make_float3( plane ), A ) - plane.w, t2 = dot( make_float3( plane ), B ) - plane.w;
-			if ((t1 < 0) && (t2 >= 0))
-				f = t1 / (t1 - t2),
-				cuv[to][nout] = Auv + (Buv - Auv) * f, cpos[to][nout++] = A + f * (B - A),
-				cuv[to][nout] = Buv, cpos[to][nout++] = B;
-			else if ((t1 >= 0) && (t2 >= 0)) cuv[to][nout] = Buv, cpos[to][nout++] = B;
-			else if ((t1 >= 0) && (t2 < 0))
-				f = t1 / (t1 - t2),
-				cuv[to][nout] = Auv + (Buv - Auv) * f, cpos[to][nout++] = A + f * (B - A);
-		}
-		if (nin == 0) continue;
+		int nin = 3, from = 0;
+		float f;
+		for (int v = 0; v < 3; v++) cpos[0][v] = tpos[v], cuv[0][v] = mesh->uv[mesh->tri[i * 3 + v]];
+		if (visibility) cuv[0][0] = make_float2( 0, 0 ), cuv[0][1] = make_float2( 1, 0 ), cuv[0][2] = make_float2( 0, 1 ); // barycentrics
+		if (clipCode) batch.clippedTris++;
+		for (int p = 0; p < 5; p++) if (clipCode & (1 << p))
+		{
+			const int to = 1 - from;
+			int nout = 0;
+			for (int v = 0; v < nin; v++)
+			{
+				const float3 A = cpos[from][v], B = cpos[from][(v + 1) % nin];
+				const float2 Auv = cuv[from][v], Buv = cuv[from][(v + 1) % nin];
+				const float4 plane = clipPlanes[p];
+				const float t1 = dot( make_float3( plane ), A ) - plane.w, t2 = dot( make_float3( plane ), B ) - plane.w;
+				if ((t1 < 0) && (t2 >= 0))
+					f = t1 / (t1 - t2),
+					cuv[to][nout] = Auv + (Buv - Auv) * f, cpos[to][nout++] = A + f * (B - A),
+					cuv[to][nout] = Buv, cpos[to][nout++] = B;
+				else if ((t1 >= 0) && (t2 >= 0)) cuv[to][nout] = Buv, cpos[to][nout++] = B;
+				else if ((t1 >= 0) && (t2 < 0))
+					f = t1 / (t1 - t2),
+					cuv[to][nout] = Auv + (Buv - Auv) * f, cpos[to][nout++] = A + f * (B - A);
+			}
+			from = to, nin = nout;
+		}
+		if (nin < 3) continue;
 		// project
 		pos = cpos[from], tuv = cuv[from];
+		ScreenVertex sv[8];
 		for (int v = 0; v < nin; v++)
-			pos[v].x = ((pos[v].x * screen->width) / -pos[v].z) + screen->width / 2,
-			pos[v].y = ((pos[v].y * screen->width) / pos[v].z) + screen->height / 2;
-		// draw
-		uint shade = (uint)((N[i].z + 1) * 64.0f + 127.9f);
-		for (int j = 0; j < nin; j++)
-		{
-			int vert0 = j, vert1 = (j + 1) % nin;
-			if (pos[vert0].y > pos[vert1].y) h = vert0, vert0 = vert1, vert1 = h;
-			const float y0 = pos[vert0].y, y1 = pos[vert1].y, rydiff = 1.0f / (y1 - y0);
-			if ((y0 == y1) || (y0 >= screen->height) || (y1 < 1)) continue;
-			const int iy0 = max( 1, (int)y0 + 1 ), iy1 = min( screen->height - 2, (int)y1 );
-			float x0 = pos[vert0].x, dx = (pos[vert1].x - x0) * rydiff;
-			float z0 = 1.0f / pos[vert0].z, z1 = 1.0f / pos[vert1].z, dz = (z1 - z0) * rydiff;
-			float u0 = tuv[vert0].x * z0, du = (tuv[vert1].x * z1 - u0) * rydiff;
-			float v0 = tuv[vert0].y * z0, dv = (tuv[vert1].y * z1 - v0) * rydiff;
-			const float f = (float)iy0 - y0;
-			x0 += dx * f, u0 += du * f, v0 += dv * f, z0 += dz * f;
-			for (int y = iy0; y <= iy1; y++)
+		{
+			const float z = 1.0f / pos[v].z;
+			sv[v].x = ((pos[v].x * w) / -pos[v].z) + w / 2;
+			sv[v].y = ((pos[v].y * w) / pos[v].z) + h / 2;
+			sv[v].z = z, sv[v].u = tuv[v].x * z, sv[v].v = tuv[v].y * z;
+		}
+		// shade
+		const Material* mat = scene->matList[mesh->material[i]];
+		const uint shade = (uint)((mesh->N[i].z + 1) * 64.0f + 127.9f);
+		// emit the clipped polygon as a triangle fan, and count the triangles per tile
+		for (int v = 1; v < nin - 1; v++)
+		{
+			ScreenTri t;
+			t.vert[0] = sv[0], t.vert[1] = sv[v], t.vert[2] = sv[v + 1];
+			const float minx = min( t.vert[0].x, min( t.vert[1].x, t.vert[2].x ) ), maxx = max( t.vert[0].x, max( t.vert[1].x, t.vert[2].x ) );
+			const float miny = min( t.vert[0].y, min( t.vert[1].y, t.vert[2].y ) ), maxy = max( t.vert[0].y, max( t.vert[1].y, t.vert[2].y ) );
+			if (maxx < 0 || maxy < 0 || minx >= w || miny >= h) continue;
+			t.tileX0 = (int)max( 0.0f, minx ) / TILESIZE, t.tileX1 = min( tilesX - 1, (int)min( (float)w, maxx ) / TILESIZE );
+			t.tileY0 = (int)max( 0.0f, miny ) / TILESIZE, t.tileY1 = min( tilesY - 1, (int)min( (float)h, maxy ) / TILESIZE );
+			t.texture = mat->texture, t.color = mat->diffuse, t.shade = shade;
+			t.instance = batch.instance, t.triangle = i;
+			for (int y = t.tileY0; y <= t.tileY1; y++) for (int x = t.tileX0; x <= t.tileX1; x++) batch.tileCount[x + y * tilesX]++;
+			batch.tris.push_back( t );
+		}
+	}
+}
+
+// -----------------------------------------------------------
+// Tile class
+// state of the tile that is being rasterized
+// -----------------------------------------------------------
+struct Tile
+{
+	int x0, y0, x1, y1;				// tile rectangle, inclusive
+	int rowMin, rowMax, colMin, colMax;	// drawable part of the tile; the one-pixel screen border stays clear
+	uint* pixels;					// screen pixels
+	int pitch;						// screen width
+	uint fragments;					// covered pixels, before the depth test
+	VisibilityBuffer* vbuffer;		// 0, unless rendering in visibility mode
+	bool filtering;					// MIP-mapped bilinear texture sampling
+	float zbuffer[TILESIZE * TILESIZE];
+	float xleft[TILESIZE], xright[TILESIZE], uleft[TILESIZE], uright[TILESIZE];	// outline tables,
+	float vleft[TILESIZE], vright[TILESIZE], zleft[TILESIZE], zright[TILESIZE];	// indexed by tile row
+};
+
+// -----------------------------------------------------------
+// DrawScanline
+// scanline rasterization of a triangle within a tile:
+// a) span construction, using the outline tables
+// b) span filling; the MIP level is selected per span
+// -----------------------------------------------------------
+static void DrawScanline( const ScreenTri& t, Tile& tile )
+{
+	const ScreenVertex* pos = t.vert;
+	const uint* src = t.texture ? t.texture->pixels : &t.color;
+	const float tw = t.texture ? (float)t.texture->width : 1;
+	const float th = t.texture ? (float)t.texture->height : 1;
+	const int umask = (int)tw - 1, vmask = (int)th - 1;
+	const bool bilinear = tile.filtering && t.texture;
+	const Gradients g = bilinear ? TriangleGradients( pos ) : Gradients();
+	int miny = tile.rowMax, maxy = tile.rowMin, tmp;
+	for (int j = 0; j < 3; j++)
+	{
+		int vert0 = j, vert1 = (j + 1) % 3;
+		if (pos[vert0].y > pos[vert1].y) tmp = vert0, vert0 = vert1, vert1 = tmp;
+		const float y0 = pos[vert0].y, y1 = pos[vert1].y, rydiff = 1.0f / (y1 - y0);
+		if ((y0 == y1) || (y0 > tile.rowMax) || (y1 < tile.rowMin)) continue;
+		const int iy0 = max( tile.rowMin, (int)y0 + 1 ), iy1 = min( tile.rowMax, (int)y1 );
+		if (iy0 > iy1) continue;
+		float x0 = pos[vert0].x, dx = (pos[vert1].x - x0) * rydiff;
+		float z0 = pos[vert0].z, dz = (pos[vert1].z - z0) * rydiff;
+		float u0 = pos[vert0].u, du = (pos[vert1].u - u0) * rydiff;
+		float v0 = pos[vert0].v, dv = (pos[vert1].v - v0) * rydiff;
+		const float f = (float)iy0 - y0;
+		x0 += dx * f, u0 += du * f, v0 += dv * f, z0 += dz * f;
+		for (int y = iy0 - tile.y0; y <= iy1 - tile.y0; y++)
+		{
+			if (x0 < tile.xleft[y]) tile.xleft[y] = x0, tile.uleft[y] = u0, tile.vleft[y] = v0, tile.zleft[y] = z0;
+			if (x0 > tile.xright[y]) tile.xright[y] = x0, tile.uright[y] = u0, tile.vright[y] = v0, tile.zright[y] = z0;
+			x0 += dx, u0 += du, v0 += dv, z0 += dz;
+		}
+		miny = min( miny, iy0 ), maxy = max( maxy, iy1 );
+	}
+	for (int y = miny - tile.y0; y <= maxy - tile.y0; tile.xleft[y] = 1e30f, tile.xright[y++] = -1e30f)
+	{
+		float x0 = tile.xleft[y], x1 = tile.xright[y], rxdiff = 1.0f / (x1 - x0);
+		float u0 = tile.uleft[y], du = (tile.uright[y] - u0) * rxdiff;
+		float v0 = tile.vleft[y], dv = (tile.vright[y] - v0) * rxdiff;
+		float z0 = tile.zleft[y], dz = (tile.zright[y] - z0) * rxdiff;
+		const int ix0 = max( tile.colMin, (int)max( -1.0f, x0 ) + 1 ), ix1 = min( tile.colMax, (int)min( (float)tile.pitch, x1 ) );
+		const float f = (float)ix0 - x0;
+		u0 += f * du, v0 += f * dv, z0 += f * dz;
+		uint* dest = tile.pixels + (y + tile.y0) * tile.pitch;
+		float* zbuf = tile.zbuffer + y * TILESIZE - tile.x0;
+		if (ix1 >= ix0) tile.fragments += ix1 - ix0 + 1;
+		if (bilinear)
+		{
+			const float m = (ix1 - ix0) * 0.5f;
+			const int level = SelectLevel( *t.texture, g, z0 + m * dz, u0 + m * du, v0 + m * dv );
+			for (int x = ix0; x <= ix1; x++, u0 += du, v0 += dv, z0 += dz) if (z0 < zbuf[x])
 			{
-				if (x0 < xleft[y]) xleft[y] = x0, uleft[y] = u0, vleft[y] = v0, zleft[y] = z0;
-				if (x0 > xright[y]) xright[y] = x0, uright[y] = u0, vright[y] = v0, zright[y] = z0;
-				x0 += dx, u0 += du, v0 += dv, z0 += dz;
+				const float z = 1.0f / z0;
+				dest[x] = ScaleColor( SampleBilinear( *t.texture, level, u0 * z, v0 * z ), t.shade ), zbuf[x] = z0;
 			}
-			miny = min( miny, iy0 ), maxy = max( maxy, iy1 );
-		}
-		for (int y = miny; y <= maxy; xleft[y] = screen->width - 1, xright[y++] = 0)
-		{
-			float x0 = xleft[y], x1 = xright[y], rxdiff = 1.0f / (x1 - x0);
-			float u0 = uleft[y], du = (uright[y] - u0) * rxdiff;
-			float v0 = vleft[y], dv = (vright[y] - v0) * rxdiff;
-			float z0 = zleft[y], dz = (zright[y] - z0) * rxdiff;
-			const int ix0 = (int)x0 + 1, ix1 = min( screen->width - 2, (int)x1 );
-			const float f = (float)ix0 - x0;
-			u0 += f * du, v0 += f * dv, z0 += f * dz;
-			uint* dest = screen->pixels + y * screen->width;
-			float* zbuf = zbuffer + y * screen->width;
-			for (int x = ix0; x <= ix1; x++, u0 += du, v0 += dv, z0 += dz) // plot span
+			continue;
+		}
+		for (int x = ix0; x <= ix1; x++, u0 += du, v0 += dv, z0 += dz) // plot span
+		{
+			if (z0 >= zbuf[x]) continue;
+			const float z = 1.0f / z0;
+			const int u = (int)(u0 * z * tw) & umask, v = (int)(v0 * z * th) & vmask;
+			dest[x] = ScaleColor( src[u + v * (umask + 1)], t.shade ), zbuf[x] = z0;
+		}
+	}
+}
+
+// -----------------------------------------------------------
+// EdgeSetup class
+// half-space rasterization: a pixel (x,y) is inside the
+// triangle if the three edge functions e = a * x + b * y + c
+// are not negative. vertices are snapped to SUBPIXEL_BITS
+// fixed point and the edge functions are exact integers, so
+// triangles that share an edge leave no gaps; a bias in c
+// implements the top-left fill rule, so pixels on a shared
+// edge are drawn once. z, u and v are planes in screen space.
+// -----------------------------------------------------------
+struct EdgeSetup
+{
+	int a[3];						// edge functions; a is the step per pixel, below 2^23 within the guard band
+	int64_t b[3], c[3];
+	float z0, dzdx, dzdy;			// attribute planes, relative to (x0, y0)
+	float u0, dudx, dudy;
+	float v0, dvdx, dvdy;
+	float x0, y0;
+	int xmin, xmax, ymin, ymax;		// pixel bounds, clamped to the drawable part of the tile
+};
+static bool SetupEdges( const ScreenTri& t, const Tile& tile, EdgeSetup& e )
+{
+	const ScreenVertex* p[3] = { &t.vert[0], &t.vert[1], &t.vert[2] };
+	const float scale = (float)(1 << SUBPIXEL_BITS);
+	int X[3], Y[3];
+	for (int i = 0; i < 3; i++) X[i] = (int)floorf( p[i]->x * scale + 0.5f ), Y[i] = (int)floorf( p[i]->y * scale + 0.5f );
+	int64_t area = (int64_t)(X[1] - X[0]) * (Y[2] - Y[0]) - (int64_t)(X[2] - X[0]) * (Y[1] - Y[0]);
+	if (area == 0) return false;
+	if (area < 0) Swap( p[1], p[2] ), Swap( X[1], X[2] ), Swap( Y[1], Y[2] ), area = -area; // counter-clockwise, so that inside is positive
+	// bounds
+	const int round = (1 << SUBPIXEL_BITS) - 1;
+	e.xmin = max( tile.colMin, (min( X[0], min( X[1], X[2] ) ) + round) >> SUBPIXEL_BITS );
+	e.xmax = min( tile.colMax, max( X[0], max( X[1], X[2] ) ) >> SUBPIXEL_BITS );
+	e.ymin = max( tile.rowMin, (min( Y[0], min( Y[1], Y[2] ) ) + round) >> SUBPIXEL_BITS );
+	e.ymax = min( tile.rowMax, max( Y[0], max( Y[1], Y[2] ) ) >> SUBPIXEL_BITS );
+	if (e.xmin > e.xmax || e.ymin > e.ymax) return false;
+	// edge functions; edge i runs from vertex i to vertex i + 1
+	for (int i = 0; i < 3; i++)
+	{
+		const int j = (i + 1) % 3, dy = Y[i] - Y[j], dx = X[j] - X[i];
+		const bool topLeft = dy > 0 || (dy == 0 && dx > 0);
+		e.a[i] = dy << SUBPIXEL_BITS, e.b[i] = (int64_t)dx << SUBPIXEL_BITS;
+		e.c[i] = -((int64_t)dy * X[i] + (int64_t)dx * Y[i]) - (topLeft ? 0 : 1);
+	}
+	// attribute planes, over the snapped triangle
+	const float rscale = 1.0f / scale;
+	const float dx1 = (X[1] - X[0]) * rscale, dy1 = (Y[1] - Y[0]) * rscale, dx2 = (X[2] - X[0]) * rscale, dy2 = (Y[2] - Y[0]) * rscale;
+	const float rarea = 1.0f / (dx1 * dy2 - dx2 * dy1);
+	const float dz1 = p[1]->z - p[0]->z, dz2 = p[2]->z - p[0]->z;
+	const float du1 = p[1]->u - p[0]->u, du2 = p[2]->u - p[0]->u;
+	const float dv1 = p[1]->v - p[0]->v, dv2 = p[2]->v - p[0]->v;
+	e.x0 = X[0] * rscale, e.y0 = Y[0] * rscale;
+	e.z0 = p[0]->z, e.dzdx = (dz1 * dy2 - dz2 * dy1) * rarea, e.dzdy = (dz2 * dx1 - dz1 * dx2) * rarea;
+	e.u0 = p[0]->u, e.dudx = (du1 * dy2 - du2 * dy1) * rarea, e.dudy = (du2 * dx1 - du1 * dx2) * rarea;
+	e.v0 = p[0]->v, e.dvdx = (dv1 * dy2 - dv2 * dy1) * rarea, e.dvdy = (dv2 * dx1 - dv1 * dx2) * rarea;
+	return true;
+}
+
+// -----------------------------------------------------------
+// EdgeRow4 / EdgeRow8
+// edge function i for 4 or 8 pixels, starting at (x, y). the
+// exact value is clamped to 2^30: within a tile row, stepping
+// by a at most 72 times can not change its sign.
+// -----------------------------------------------------------
+static inline int EdgeValue( const EdgeSetup& e, const int i, const int x, const int y )
+{
+	const int64_t E = e.a[i] * (int64_t)x + e.b[i] * y + e.c[i];
+	return E < -(1 << 30) ? -(1 << 30) : E > (1 << 30) ? (1 << 30) : (int)E;
+}
+static inline __m128i EdgeRow4( const EdgeSetup& e, const int i, const int x, const int y )
+{
+	const int E = EdgeValue( e, i, x, y ), a = e.a[i];
+	return _mm_setr_epi32( E, E + a, E + 2 * a, E + 3 * a );
+}
+AVX2_FUNCTION static inline __m256i EdgeRow8( const EdgeSetup& e, const int i, const int x, const int y )
+{
+	const int E = EdgeValue( e, i, x, y ), a = e.a[i];
+	return _mm256_setr_epi32( E, E + a, E + 2 * a, E + 3 * a, E + 4 * a, E + 5 * a, E + 6 * a, E + 7 * a );
+}
+
+// -----------------------------------------------------------
+// DrawEdgeSSE
+// half-space rasterization, 4 pixels at a time; edge tests,
+// interpolation and the depth test are vectorized, texels
+// are fetched per pixel, from a MIP level selected per row
+// -----------------------------------------------------------
+static void DrawEdgeSSE( const ScreenTri& t, Tile& tile )
+{
+	EdgeSetup e;
+	if (!SetupEdges( t, tile, e )) return;
+	const uint* src = t.texture ? t.texture->pixels : &t.color;
+	const float tw = t.texture ? (float)t.texture->width : 1, th = t.texture ? (float)t.texture->height : 1;
+	const int umask = (int)tw - 1, vmask = (int)th - 1;
+	const bool bilinear = tile.filtering && t.texture;
+	const Gradients g = { e.dzdx, e.dudx, e.dvdx, e.dzdy, e.dudy, e.dvdy };
+	const __m128 lane4 = _mm_set_ps( 3, 2, 1, 0 );
+	const __m128i step0 = _mm_set1_epi32( e.a[0] * 4 ), step1 = _mm_set1_epi32( e.a[1] * 4 ), step2 = _mm_set1_epi32( e.a[2] * 4 );
+	const __m128 dzdx4 = _mm_set1_ps( e.dzdx ), dudx4 = _mm_set1_ps( e.dudx ), dvdx4 = _mm_set1_ps( e.dvdx );
+	const __m128i xmin4 = _mm_set1_epi32( e.xmin - 1 ), xmax4 = _mm_set1_epi32( e.xmax + 1 );
+	const int xstart = tile.x0 + ((e.xmin - tile.x0) & ~3);
+	for (int y = e.ymin; y <= e.ymax; y++)
+	{
+		const float ry = (float)y - e.y0;
+		__m128i E0 = EdgeRow4( e, 0, xstart, y ), E1 = EdgeRow4( e, 1, xstart, y ), E2 = EdgeRow4( e, 2, xstart, y );
+		const __m128 zr = _mm_set1_ps( e.z0 + e.dzdy * ry - e.dzdx * e.x0 );
+		const __m128 ur = _mm_set1_ps( e.u0 + e.dudy * ry - e.dudx * e.x0 );
+		const __m128 vr = _mm_set1_ps( e.v0 + e.dvdy * ry - e.dvdx * e.x0 );
+		uint* dest = tile.pixels + y * tile.pitch;
+		float* zbuf = tile.zbuffer + (y - tile.y0) * TILESIZE - tile.x0;
+		const float xm = (e.xmin + e.xmax) * 0.5f;
+		const int level = bilinear ? SelectLevel( *t.texture, g, _mm_cvtss_f32( zr ) + e.dzdx * xm, _mm_cvtss_f32( ur ) + e.dudx * xm, _mm_cvtss_f32( vr ) + e.dvdx * xm ) : 0;
+		for (int x = xstart; x <= e.xmax; x += 4, E0 = _mm_add_epi32( E0, step0 ), E1 = _mm_add_epi32( E1, step1 ), E2 = _mm_add_epi32( E2, step2 ))
+		{
+			const __m128 fx = _mm_add_ps( _mm_set1_ps( (float)x ), lane4 );
+			const __m128i ix = _mm_add_epi32( _mm_set1_epi32( x ), _mm_set_epi32( 3, 2, 1, 0 ) );
+			// coverage: no edge function is negative
+			const __m128i outside = _mm_srai_epi32( _mm_or_si128( _mm_or_si128( E0, E1 ), E2 ), 31 );
+			const __m128 inside = _mm_castsi128_ps( _mm_andnot_si128( outside, _mm_and_si128( _mm_cmpgt_epi32( ix, xmin4 ), _mm_cmplt_epi32( ix, xmax4 ) ) ) );
+			const int coverage = _mm_movemask_ps( inside );
+			if (!coverage) continue;
+			tile.fragments += __popcnt( coverage );
+			// depth test
+			const __m128 z = _mm_add_ps( _mm_mul_ps( dzdx4, fx ), zr ), zb = _mm_loadu_ps( zbuf + x );
+			const __m128 pass = _mm_and_ps( inside, _mm_cmplt_ps( z, zb ) );
+			const int passMask = _mm_movemask_ps( pass );
+			if (!passMask) continue;
+			_mm_storeu_ps( zbuf + x, _mm_or_ps( _mm_and_ps( pass, z ), _mm_andnot_ps( pass, zb ) ) );
+			// perspective-correct texture coordinates
+			const __m128 rz = _mm_div_ps( _mm_set1_ps( 1.0f ), z );
+			const __m128 uf = _mm_mul_ps( _mm_add_ps( _mm_mul_ps( dudx4, fx ), ur ), rz );
+			const __m128 vf = _mm_mul_ps( _mm_add_ps( _mm_mul_ps( dvdx4, fx ), vr ), rz );
+			if (bilinear)
 			{
-				if (z0 >= zbuf[x]) continue;
-				const float z = 1.0f / z0;
-				const int u = (int)(u0 * z * tw) & umask, v = (int)(v0 * z * th) & vmask;
-				dest[x] = ScaleColor( src[u + v * (umask + 1)], shade ), zbuf[x] = z0;
+				ALIGN( 16 ) float fu[4], fv[4];
+				_mm_store_ps( fu, uf ), _mm_store_ps( fv, vf );
+				for (int i = 0; i < 4; i++) if (passMask & (1 << i))
+					dest[x + i] = ScaleColor( SampleBilinear( *t.texture, level, fu[i], fv[i] ), t.shade );
+				continue;
 			}
+			const __m128 u = _mm_mul_ps( uf, _mm_set1_ps( tw ) ), v = _mm_mul_ps( vf, _mm_set1_ps( th ) );
+			ALIGN( 16 ) int iu[4], iv[4];
+			_mm_store_si128( (__m128i*)iu, _mm_cvttps_epi32( u ) );
+			_mm_store_si128( (__m128i*)iv, _mm_cvttps_epi32( v ) );
+			for (int i = 0; i < 4; i++) if (passMask & (1 << i))
+				dest[x + i] = ScaleColor( src[(iu[i] & umask) + (iv[i] & vmask) * (umask + 1)], t.shade );
 		}
 	}
 }
 
 // -----------------------------------------------------------
-// Scene destructor
+// Lerp8
+// blend eight pairs of colors; weights in 0..256
 // -----------------------------------------------------------
-Scene::~Scene()
+AVX2_FUNCTION static inline __m256i Lerp8( const __m256i a, const __m256i b, const __m256i w )
 {
-	delete root;
-	for (auto tex : texList) delete tex;
-	for (auto mat : matList) delete mat;
+	const __m256i rbmask8 = _mm256_set1_epi32( 0xff00ff ), gmask8 = _mm256_set1_epi32( 0xff00 ), w0 = _mm256_sub_epi32( _mm256_set1_epi32( 256 ), w );
+	const __m256i rb = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_and_si256( a, rbmask8 ), w0 ), _mm256_mullo_epi32( _mm256_and_si256( b, rbmask8 ), w ) );
+	const __m256i g = _mm256_add_epi32( _mm256_mullo_epi32( _mm256_and_si256( a, gmask8 ), w0 ), _mm256_mullo_epi32( _mm256_and_si256( b, gmask8 ), w ) );
+	return _mm256_add_epi32( _mm256_and_si256( _mm256_srli_epi32( rb, 8 ), rbmask8 ), _mm256_and_si256( _mm256_srli_epi32( g, 8 ), gmask8 ) );
 }
 
 // -----------------------------------------------------------
-// SGNode::Render
-// recursive rendering of a scene graph node and its child nodes
-// input: (inverse) camera transform
+// DrawEdgeAVX2
+// half-space rasterization, 8 pixels at a time, including
+// texel gathers, bilinear filtering and shading; the MIP
+// level is selected per row
 // -----------------------------------------------------------
-void SGNode::Render( const mat4& transform )
+AVX2_FUNCTION static void DrawEdgeAVX2( const ScreenTri& t, Tile& tile )
 {
-	mat4 M = transform * localTransform;
-	if (GetType() == SG_MESH) ((Mesh*)this)->Render( M );
-	for (uint s = (uint)child.size(), i = 0; i < s; i++) child[i]->Render( M );
+	EdgeSetup e;
+	if (!SetupEdges( t, tile, e )) return;
+	const int* src = t.texture ? (const int*)t.texture->pixels : (const int*)&t.color;
+	const float tw = t.texture ? (float)t.texture->width : 1, th = t.texture ? (float)t.texture->height : 1;
+	const int umask = (int)tw - 1, vmask = (int)th - 1;
+	const __m256 lane8 = _mm256_set_ps( 7, 6, 5, 4, 3, 2, 1, 0 );
+	const __m256i step0 = _mm256_set1_epi32( e.a[0] * 8 ), step1 = _mm256_set1_epi32( e.a[1] * 8 ), step2 = _mm256_set1_epi32( e.a[2] * 8 );
+	const __m256 dzdx8 = _mm256_set1_ps( e.dzdx ), dudx8 = _mm256_set1_ps( e.dudx ), dvdx8 = _mm256_set1_ps( e.dvdx );
+	const __m256 tw8 = _mm256_set1_ps( tw ), th8 = _mm256_set1_ps( th ), one8 = _mm256_set1_ps( 1.0f );
+	const __m256i umask8 = _mm256_set1_epi32( umask ), vmask8 = _mm256_set1_epi32( vmask ), pitch8 = _mm256_set1_epi32( umask + 1 );
+	const __m256i rbmask8 = _mm256_set1_epi32( 0xff00ff ), gmask8 = _mm256_set1_epi32( 0xff00 ), shade8 = _mm256_set1_epi32( t.shade );
+	const __m256i xmin8 = _mm256_set1_epi32( e.xmin - 1 ), xmax8 = _mm256_set1_epi32( e.xmax + 1 );
+	const __m256 half8 = _mm256_set1_ps( 0.5f ), scale8 = _mm256_set1_ps( 256.0f );
+	const __m256i one8i = _mm256_set1_epi32( 1 ), minus8 = _mm256_set1_epi32( -1 );
+	const int xstart = tile.x0 + ((e.xmin - tile.x0) & ~7);
+	const bool bilinear = tile.filtering && t.texture;
+	const Gradients g = { e.dzdx, e.dudx, e.dvdx, e.dzdy, e.dudy, e.dvdy };
+	for (int y = e.ymin; y <= e.ymax; y++)
+	{
+		const float ry = (float)y - e.y0;
+		__m256i E0 = EdgeRow8( e, 0, xstart, y ), E1 = EdgeRow8( e, 1, xstart, y ), E2 = EdgeRow8( e, 2, xstart, y );
+		const float zrow = e.z0 + e.dzdy * ry - e.dzdx * e.x0, urow = e.u0 + e.dudy * ry - e.dudx * e.x0, vrow = e.v0 + e.dvdy * ry - e.dvdx * e.x0;
+		const __m256 zr = _mm256_set1_ps( zrow ), ur = _mm256_set1_ps( urow ), vr = _mm256_set1_ps( vrow );
+		uint* dest = tile.pixels + y * tile.pitch;
+		float* zbuf = tile.zbuffer + (y - tile.y0) * TILESIZE - tile.x0;
+		// MIP level for this row
+		const int* texels = src;
+		__m256i lw8 = one8i, lh8 = one8i;
+		if (bilinear)
+		{
+			const float xm = (e.xmin + e.xmax) * 0.5f;
+			const int level = SelectLevel( *t.texture, g, zrow + e.dzdx * xm, urow + e.dudx * xm, vrow + e.dvdx * xm );
+			texels = src + t.texture->levelOffset[level];
+			lw8 = _mm256_set1_epi32( t.texture->levelWidth[level] ), lh8 = _mm256_set1_epi32( t.texture->levelHeight[level] );
+		}
+		const __m256 lwf8 = _mm256_cvtepi32_ps( lw8 ), lhf8 = _mm256_cvtepi32_ps( lh8 );
+		for (int x = xstart; x <= e.xmax; x += 8, E0 = _mm256_add_epi32( E0, step0 ), E1 = _mm256_add_epi32( E1, step1 ), E2 = _mm256_add_epi32( E2, step2 ))
+		{
+			const __m256 fx = _mm256_add_ps( _mm256_set1_ps( (float)x ), lane8 );
+			const __m256i ix = _mm256_add_epi32( _mm256_set1_epi32( x ), _mm256_set_epi32( 7, 6, 5, 4, 3, 2, 1, 0 ) );
+			// coverage: no edge function is negative
+			const __m256i outside = _mm256_srai_epi32( _mm256_or_si256( _mm256_or_si256( E0, E1 ), E2 ), 31 );
+			const __m256 inside = _mm256_castsi256_ps( _mm256_andnot_si256( outside, _mm256_and_si256( _mm256_cmpgt_epi32( ix, xmin8 ), _mm256_cmpgt_epi32( xmax8, ix ) ) ) );
+			const int coverage = _mm256_movemask_ps( inside );
+			if (!coverage) continue;
+			tile.fragments += __popcnt( coverage );
+			// depth test
+			const __m256 z = _mm256_add_ps( _mm256_mul_ps( dzdx8, fx ), zr );
+			const __m256 pass = _mm256_and_ps( inside, _mm256_cmp_ps( z, _mm256_loadu_ps( zbuf + x ), _CMP_LT_OQ ) );
+			if (!_mm256_movemask_ps( pass )) continue;
+			const __m256i passi = _mm256_castps_si256( pass );
+			_mm256_maskstore_ps( zbuf + x, passi, z );
+			// perspective-correct texture coordinates
+			const __m256 rz = _mm256_div_ps( one8, z );
+			const __m256 uf = _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( dudx8, fx ), ur ), rz );
+			const __m256 vf = _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( dvdx8, fx ), vr ), rz );
+			__m256i texel;
+			if (bilinear)
+			{
+				// texel coordinates of the top-left texel in the 2x2 footprint, wrapped
+				const __m256 tx = _mm256_sub_ps( _mm256_mul_ps( _mm256_sub_ps( uf, _mm256_floor_ps( uf ) ), lwf8 ), half8 );
+				const __m256 ty = _mm256_sub_ps( _mm256_mul_ps( _mm256_sub_ps( vf, _mm256_floor_ps( vf ) ), lhf8 ), half8 );
+				const __m256 txf = _mm256_floor_ps( tx ), tyf = _mm256_floor_ps( ty );
+				const __m256i ix = _mm256_min_epi32( _mm256_max_epi32( _mm256_cvttps_epi32( txf ), minus8 ), _mm256_sub_epi32( lw8, one8i ) );
+				const __m256i iy = _mm256_min_epi32( _mm256_max_epi32( _mm256_cvttps_epi32( tyf ), minus8 ), _mm256_sub_epi32( lh8, one8i ) );
+				const __m256i wx = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_sub_ps( tx, txf ), scale8 ) );
+				const __m256i wy = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_sub_ps( ty, tyf ), scale8 ) );
+				const __m256i x0 = _mm256_add_epi32( ix, _mm256_and_si256( _mm256_cmpgt_epi32( _mm256_setzero_si256(), ix ), lw8 ) );
+				const __m256i x1 = _mm256_and_si256( _mm256_add_epi32( ix, one8i ), _mm256_cmpgt_epi32( lw8, _mm256_add_epi32( ix, one8i ) ) );
+				const __m256i y0 = _mm256_mullo_epi32( _mm256_add_epi32( iy, _mm256_and_si256( _mm256_cmpgt_epi32( _mm256_setzero_si256(), iy ), lh8 ) ), lw8 );
+				const __m256i y1 = _mm256_mullo_epi32( _mm256_and_si256( _mm256_add_epi32( iy, one8i ), _mm256_cmpgt_epi32( lh8, _mm256_add_epi32( iy, one8i ) ) ), lw8 );
+				// fetch and filter
+				const __m256i t00 = _mm256_mask_i32gather_epi32( _mm256_setzero_si256(), texels, _mm256_add_epi32( x0, y0 ), passi, 4 );
+				const __m256i t10 = _mm256_mask_i32gather_epi32( _mm256_setzero_si256(), texels, _mm256_add_epi32( x1, y0 ), passi, 4 );
+				const __m256i t01 = _mm256_mask_i32gather_epi32( _mm256_setzero_si256(), texels, _mm256_add_epi32( x0, y1 ), passi, 4 );
+				const __m256i t11 = _mm256_mask_i32gather_epi32( _mm256_setzero_si256(), texels, _mm256_add_epi32( x1, y1 ), passi, 4 );
+				texel = Lerp8( Lerp8( t00, t10, wx ), Lerp8( t01, t11, wx ), wy );
+			}
+			else
+			{
+				const __m256i u = _mm256_and_si256( _mm256_cvttps_epi32( _mm256_mul_ps( uf, tw8 ) ), umask8 );
+				const __m256i v = _mm256_and_si256( _mm256_cvttps_epi32( _mm256_mul_ps( vf, th8 ) ), vmask8 );
+				texel = _mm256_mask_i32gather_epi32( _mm256_setzero_si256(), src, _mm256_add_epi32( u, _mm256_mullo_epi32( v, pitch8 ) ), passi, 4 );
+			}
+			// shade
+			const __m256i rb = _mm256_and_si256( _mm256_srli_epi32( _mm256_mullo_epi32( _mm256_and_si256( texel, rbmask8 ), shade8 ), 8 ), rbmask8 );
+			const __m256i g = _mm256_and_si256( _mm256_srli_epi32( _mm256_mullo_epi32( _mm256_and_si256( texel, gmask8 ), shade8 ), 8 ), gmask8 );
+			_mm256_maskstore_epi32( (int*)dest + x, passi, _mm256_add_epi32( rb, g ) );
+		}
+	}
 }
 
 // -----------------------------------------------------------
-// Rasterizer::Init
-// initialization of the rasterizer
-// input: surface to draw to
+// DrawVisibility
+// half-space rasterization into the visibility buffer, 4
+// pixels at a time; u and v are the barycentrics of vertex 1
+// and 2 of the original triangle
 // -----------------------------------------------------------
-void Rasterizer::Init()
+static void DrawVisibility( const ScreenTri& t, Tile& tile )
 {
-	// setup outline tables & zbuffer
-	Mesh::xleft = new float[8192], Mesh::xright = new float[8192]; // that should do for pretty much any resolution
-	Mesh::uleft = new float[8192], Mesh::uright = new float[8192];
-	Mesh::vleft = new float[8192], Mesh::vright = new float[8192];
-	Mesh::zleft = new float[8192], Mesh::zright = new float[8192];
+	EdgeSetup e;
+	if (!SetupEdges( t, tile, e )) return;
+	VisibilityBuffer& vb = *tile.vbuffer;
+	const __m128 lane4 = _mm_set_ps( 3, 2, 1, 0 );
+	const __m128i step0 = _mm_set1_epi32( e.a[0] * 4 ), step1 = _mm_set1_epi32( e.a[1] * 4 ), step2 = _mm_set1_epi32( e.a[2] * 4 );
+	const __m128 dzdx4 = _mm_set1_ps( e.dzdx ), dudx4 = _mm_set1_ps( e.dudx ), dvdx4 = _mm_set1_ps( e.dvdx );
+	const __m128i xmin4 = _mm_set1_epi32( e.xmin - 1 ), xmax4 = _mm_set1_epi32( e.xmax + 1 );
+	const int xstart = tile.x0 + ((e.xmin - tile.x0) & ~3);
+	for (int y = e.ymin; y <= e.ymax; y++)
+	{
+		const float ry = (float)y - e.y0;
+		__m128i E0 = EdgeRow4( e, 0, xstart, y ), E1 = EdgeRow4( e, 1, xstart, y ), E2 = EdgeRow4( e, 2, xstart, y );
+		const __m128 zr = _mm_set1_ps( e.z0 + e.dzdy * ry - e.dzdx * e.x0 );
+		const __m128 ur = _mm_set1_ps( e.u0 + e.dudy * ry - e.dudx * e.x0 );
+		const __m128 vr = _mm_set1_ps( e.v0 + e.dvdy * ry - e.dvdx * e.x0 );
+		const int row = y * tile.pitch;
+		float* zbuf = tile.zbuffer + (y - tile.y0) * TILESIZE - tile.x0;
+		for (int x = xstart; x <= e.xmax; x += 4, E0 = _mm_add_epi32( E0, step0 ), E1 = _mm_add_epi32( E1, step1 ), E2 = _mm_add_epi32( E2, step2 ))
+		{
+			const __m128 fx = _mm_add_ps( _mm_set1_ps( (float)x ), lane4 );
+			const __m128i ix = _mm_add_epi32( _mm_set1_epi32( x ), _mm_set_epi32( 3, 2, 1, 0 ) );
+			// coverage: no edge function is negative
+			const __m128i outside = _mm_srai_epi32( _mm_or_si128( _mm_or_si128( E0, E1 ), E2 ), 31 );
+			const __m128 inside = _mm_castsi128_ps( _mm_andnot_si128( outside, _mm_and_si128( _mm_cmpgt_epi32( ix, xmin4 ), _mm_cmplt_epi32( ix, xmax4 ) ) ) );
+			const int coverage = _mm_movemask_ps( inside );
+			if (!coverage) continue;
+			tile.fragments += __popcnt( coverage );
+			// depth test
+			const __m128 z = _mm_add_ps( _mm_mul_ps( dzdx4, fx ), zr ), zb = _mm_loadu_ps( zbuf + x );
+			const __m128 pass = _mm_and_ps( inside, _mm_cmplt_ps( z, zb ) );
+			const int passMask = _mm_movemask_ps( pass );
+			if (!passMask) continue;
+			_mm_storeu_ps( zbuf + x, _mm_or_ps( _mm_and_ps( pass, z ), _mm_andnot_ps( pass, zb ) ) );
+			// perspective-correct barycentrics
+			const __m128 rz = _mm_div_ps( _mm_set1_ps( 1.0f ), z );
+			ALIGN( 16 ) float b1[4], b2[4];
+			_mm_store_ps( b1, _mm_mul_ps( _mm_add_ps( _mm_mul_ps( dudx4, fx ), ur ), rz ) );
+			_mm_store_ps( b2, _mm_mul_ps( _mm_add_ps( _mm_mul_ps( dvdx4, fx ), vr ), rz ) );
+			for (int i = 0; i < 4; i++) if (passMask & (1 << i))
+			{
+				const int idx = row + x + i;
+				vb.instance[idx] = t.instance, vb.triangle[idx] = t.triangle, vb.bary[idx] = make_float2( b1[i], b2[i] );
+			}
+		}
+	}
 }
 
-void Rasterizer::Reinit( int w, int h, Surface* screen )
+// -----------------------------------------------------------
+// Rasterizer::RasterizeTile
+// raster stage for a single screen tile: renders the binned
+// triangles in submission order, using a depth buffer for the
+// tile only
+// -----------------------------------------------------------
+void Rasterizer::RasterizeTile( const int tileIdx )
 {
-	// initialization that depends on screen size
-	for (int y = 0; y < h; y++) Mesh::xleft[y] = w - 1, Mesh::xright[y] = 0;
-	delete zbuffer;
-	zbuffer = new float[w * h];
-	// calculate view frustum planes
-	float C = -1.0f, x1 = 0.5f, x2 = w - 1.5f, y1 = 0.5f, y2 = h - 1.5f;
-	float3 p0 = { 0, 0, 0 };
-	float3 p1 = { ((x1 - w * 0.5f) * C) / w, ((y1 - h * 0.5f) * C) / w, 1.0f };
-	float3 p2 = { ((x2 - w * 0.5f) * C) / w, ((y1 - h * 0.5f) * C) / w, 1.0f };
-	float3 p3 = { ((x2 - w * 0.5f) * C) / w, ((y2 - h * 0.5f) * C) / w, 1.0f };
-	float3 p4 = { ((x1 - w * 0.5f) * C) / w, ((y2 - h * 0.5f) * C) / w, 1.0f };
-	frustum[0] = { 0, 0, -1, 0.2f };
-	float3 a( normalize( cross( p1 - p0, p4 - p1 ) ) ); frustum[1] = make_float4( a, 0 ); // left plane
-	float3 b( normalize( cross( p2 - p0, p1 - p2 ) ) ); frustum[2] = make_float4( b, 0 ); // top plane
-	float3 c( normalize( cross( p3 - p0, p2 - p3 ) ) ); frustum[3] = make_float4( c, 0 ); // right plane
-	float3 d( normalize( cross( p4 - p0, p3 - p4 ) ) ); frustum[4] = make_float4( d, 0 ); // bottom plane
-	// store screen pointer
-	Mesh::screen = screen;
+	Tile tile;
+	const int w = screen->width, h = screen->height;
+	tile.x0 = (tileIdx % tilesX) * TILESIZE, tile.y0 = (tileIdx / tilesX) * TILESIZE;
+	tile.x1 = min( w, tile.x0 + TILESIZE ) - 1, tile.y1 = min( h, tile.y0 + TILESIZE ) - 1;
+	tile.rowMin = max( 1, tile.y0 ), tile.rowMax = min( h - 2, tile.y1 ), tile.colMin = max( 1, tile.x0 ), tile.colMax = min( w - 2, tile.x1 );
+	tile.pixels = screen->pixels, tile.pitch = w, tile.fragments = 0;
+	tile.vbuffer = visibility ? &vbuffer : 0, tile.filtering = filtering;
+	// clear the tile
+	memset( tile.zbuffer, 0, sizeof( tile.zbuffer ) );
+	for (int y = tile.y0; y <= tile.y1; y++)
+		if (visibility) std::fill( &vbuffer.instance[y * w + tile.x0], &vbuffer.instance[y * w + tile.x1] + 1, (uint)VisibilityBuffer::NOHIT );
+		else memset( screen->pixels + y * w + tile.x0, 0, (tile.x1 - tile.x0 + 1) * sizeof( uint ) );
+	for (int y = 0; y < TILESIZE; y++) tile.xleft[y] = 1e30f, tile.xright[y] = -1e30f;
+	// draw the triangles
+	const uint first = tileStart[tileIdx], last = tileStart[tileIdx + 1];
+	if (visibility) for (uint i = first; i < last; i++) DrawVisibility( *binned[i], tile );
+	else if (mode == EDGE_AVX2) for (uint i = first; i < last; i++) DrawEdgeAVX2( *binned[i], tile );
+	else if (mode == EDGE_SSE) for (uint i = first; i < last; i++) DrawEdgeSSE( *binned[i], tile );
+	else for (uint i = first; i < last; i++) DrawScanline( *binned[i], tile );
+	fragmentCount += tile.fragments;
+	// store camera-space depth in the visibility buffer
+	if (visibility) for (int y = tile.y0; y <= tile.y1; y++) for (int x = tile.x0; x <= tile.x1; x++)
+	{
+		const float z = tile.zbuffer[(y - tile.y0) * TILESIZE + x - tile.x0];
+		vbuffer.depth[x + y * w] = z == 0 ? 1e34f : (-1.0f / z);
+	}
+}
+
+// -----------------------------------------------------------
+// Rasterizer::ShadeTile
+// deferred shading of a screen tile, using the visibility
+// buffer: every pixel is shaded once, regardless of overdraw.
+// texture coordinate derivatives are taken from neighbouring
+// pixels on the same triangle
+// -----------------------------------------------------------
+void Rasterizer::ShadeTile( const int tileIdx )
+{
+	const int w = screen->width, h = screen->height;
+	const int x0 = (tileIdx % tilesX) * TILESIZE, y0 = (tileIdx / tilesX) * TILESIZE;
+	const int x1 = min( w, x0 + TILESIZE ), y1 = min( h, y0 + TILESIZE );
+	for (int y = y0; y < y1; y++) for (int x = x0; x < x1; x++)
+	{
+		const int idx = x + y * w;
+		const uint instance = vbuffer.instance[idx];
+		if (instance == VisibilityBuffer::NOHIT) { screen->pixels[idx] = 0; continue; }
+		const Mesh* mesh = instanceMesh[instance];
+		const int tri = vbuffer.triangle[idx];
+		const Material* mat = scene->matList[mesh->material[tri]];
+		const uint shade = (uint)((mesh->N[tri].z + 1) * 64.0f + 127.9f);
+		uint color = mat->diffuse;
+		if (mat->texture)
+		{
+			const int* vidx = mesh->tri + tri * 3;
+			const float2 uv0 = mesh->uv[vidx[0]], uv1 = mesh->uv[vidx[1]], uv2 = mesh->uv[vidx[2]];
+			auto texCoord = [&]( const int i ) { const float2 b = vbuffer.bary[i]; return (1 - b.x - b.y) * uv0 + b.x * uv1 + b.y * uv2; };
+			auto sameTri = [&]( const int i ) { return vbuffer.instance[i] == instance && vbuffer.triangle[i] == (uint)tri; };
+			const Texture* tex = mat->texture;
+			const float2 uv = texCoord( idx );
+			if (filtering)
+			{
+				float2 dx = make_float2( 0 ), dy = make_float2( 0 );
+				if (x + 1 < w && sameTri( idx + 1 )) dx = texCoord( idx + 1 ) - uv; else if (x > 0 && sameTri( idx - 1 )) dx = uv - texCoord( idx - 1 );
+				if (y + 1 < h && sameTri( idx + w )) dy = texCoord( idx + w ) - uv; else if (y > 0 && sameTri( idx - w )) dy = uv - texCoord( idx - w );
+				dx *= make_float2( (float)tex->width, (float)tex->height ), dy *= make_float2( (float)tex->width, (float)tex->height );
+				color = SampleBilinear( *tex, SelectLevel( *tex, max( dot( dx, dx ), dot( dy, dy ) ) ), uv.x, uv.y );
+			}
+			else
+			{
+				const int u = (int)(uv.x * tex->width) & (tex->width - 1), v = (int)(uv.y * tex->height) & (tex->height - 1);
+				color = tex->pixels[u + v * tex->width];
+			}
+		}
+		screen->pixels[idx] = ScaleColor( color, shade );
+	}
+}
+
+// -----------------------------------------------------------
+// VisibilityBuffer::Reinit
+// allocate the buffer for a screen size
+// -----------------------------------------------------------
+void VisibilityBuffer::Reinit( int w, int h )
+{
+	width = w, height = h;
+	instance.assign( w * h, NOHIT ), triangle.resize( w * h ), bary.resize( w * h ), depth.assign( w * h, 1e34f );
+}
+
+// -----------------------------------------------------------
+// Rasterizer::SetMode
+// select the span fill algorithm; falls back to SSE if the
+// CPU does not support AVX2
+// -----------------------------------------------------------
+void Rasterizer::SetMode( const int newMode )
+{
+	mode = clamp( newMode, (int)SCANLINE, (int)EDGE_AVX2 );
+	if (mode == EDGE_AVX2 && !AVX2Supported()) mode = EDGE_SSE;
+}
+
+// -----------------------------------------------------------
+// Rasterizer::AVX2Supported
+// check if the CPU and the OS support AVX2
+// -----------------------------------------------------------
+bool Rasterizer::AVX2Supported()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 0 );
+	if (info[0] < 7) return false;
+	__cpuid( info, 1 );
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false; // OSXSAVE, AVX
+	if ((_xgetbv( 0 ) & 6) != 6) return false; // OS saves the YMM registers
+	__cpuidex( info, 7, 0 );
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports( "avx2" );
+#endif
+}
+
+// -----------------------------------------------------------
+// DepthPyramid::Reinit
+// allocate the levels for a screen size
+// -----------------------------------------------------------
+void DepthPyramid::Reinit( int w, int h )
+{
+	screenWidth = w, screenHeight = h;
+	size.clear(), level.clear();
+	int2 s = make_int2( (w + HIZ_SCALE - 1) / HIZ_SCALE, (h + HIZ_SCALE - 1) / HIZ_SCALE );
+	while (1)
+	{
+		size.push_back( s ), level.push_back( vector<float>( s.x * s.y, 0.0f ) );
+		if (s.x == 1 && s.y == 1) break;
+		s = make_int2( (s.x + 1) / 2, (s.y + 1) / 2 );
+	}
+}
+
+// -----------------------------------------------------------
+// DepthPyramid::Build
+// calculate levels 1 and up from level 0
+// -----------------------------------------------------------
+void DepthPyramid::Build()
+{
+	for (size_t l = 1; l < level.size(); l++)
+	{
+		const int2 src = size[l - 1], dst = size[l];
+		const float* s = level[l - 1].data();
+		float* d = level[l].data();
+		for (int y = 0; y < dst.y; y++) for (int x = 0; x < dst.x; x++)
+		{
+			const int x0 = x * 2, x1 = min( x0 + 1, src.x - 1 ), y0 = y * 2 * src.x, y1 = min( y * 2 + 1, src.y - 1 ) * src.x;
+			d[x + y * dst.x] = max( max( s[x0 + y0], s[x1 + y0] ), max( s[x0 + y1], s[x1 + y1] ) );
+		}
+	}
+}
+
+// -----------------------------------------------------------
+// DepthPyramid::Occluded
+// check if a projected bounding box is behind the occluders:
+// the level is chosen so that the rectangle overlaps at most
+// 2x2 texels
+// -----------------------------------------------------------
+bool DepthPyramid::Occluded( const ScreenBounds& b ) const
+{
+	int x0 = (int)max( 0.0f, b.x0 ) / HIZ_SCALE, x1 = (int)min( (float)(screenWidth - 1), b.x1 ) / HIZ_SCALE;
+	int y0 = (int)max( 0.0f, b.y0 ) / HIZ_SCALE, y1 = (int)min( (float)(screenHeight - 1), b.y1 ) / HIZ_SCALE;
+	if (x0 > x1 || y0 > y1) return false;
+	size_t l = 0;
+	while (x1 - x0 > 1 || y1 - y0 > 1) x0 >>= 1, x1 >>= 1, y0 >>= 1, y1 >>= 1, l++;
+	const float* d = level[l].data();
+	const int pitch = size[l].x;
+	float farthest = d[x0 + y0 * pitch];
+	farthest = max( farthest, max( d[x1 + y0 * pitch], max( d[x0 + y1 * pitch], d[x1 + y1 * pitch] ) ) );
+	return b.z > farthest;
 }
 
 // -----------------------------------------------------------
@@ -233,9 +1211,90 @@ void Rasterizer::Reinit( int w, int h, Surface* screen )
 // -----------------------------------------------------------
 void Rasterizer::Render( const mat4& transform )
 {
-	memset( Mesh::screen->pixels, 0, Mesh::screen->width * Mesh::screen->height * sizeof( uint ) );
-	memset( zbuffer, 0, Mesh::screen->width * Mesh::screen->height * sizeof( float ) );
-	scene.root->Render( transform.Inverted() );
+	// visibility: frustum culling of the world-space instance bounds, then of the mesh bounds
+	const mat4 V = view = transform.Inverted();
+	eye = make_float3( transform.cell[3], transform.cell[7], transform.cell[11] );
+	float4 worldFrustum[5];
+	for (int p = 0; p < 5; p++)
+	{
+		// dot( N, V * x ) - d = dot( transpose( V ) * N, x ) - (d - dot( N, V translation ))
+		const float3 N = make_float3( frustum[p] );
+		const float* M = V.cell;
+		worldFrustum[p] = make_float4( N.x * M[0] + N.y * M[4] + N.z * M[8], N.x * M[1] + N.y * M[5] + N.z * M[9],
+			N.x * M[2] + N.y * M[6] + N.z * M[10], frustum[p].w - (N.x * M[3] + N.y * M[7] + N.z * M[11]) );
+	}
+	instanceCount = 0;
+	for (int s = (int)scene->instances.size(), i = 0; i < s; i++)
+	{
+		const Instance& instance = scene->instances[i];
+		if (instance.mesh < 0 || instance.dirty) continue; // dirty: missing Scene::Update
+		const float3 c = (instance.bounds[0] + instance.bounds[1]) * 0.5f, e = (instance.bounds[1] - instance.bounds[0]) * 0.5f;
+		int p = 0;
+		while (p < 5 && (dot( make_float3( worldFrustum[p] ), c ) + dot( fabs( make_float3( worldFrustum[p] ) ), e ) - worldFrustum[p].w) > 0) p++;
+		if (p == 5) AddMesh( scene->meshes[instance.mesh], V * instance.Transform(), i );
+	}
+	// occlusion culling
+	culledMeshes = culledTris = 0;
+	if (occlusionCulling) RenderOccluders();
+	batchCount = 0;
+	for (int i = 0; i < instanceCount; i++)
+	{
+		const VisibleInstance& instance = instances[i];
+		const Mesh* mesh = instance.mesh;
+		if (occlusionCulling && instance.projected && hiz.Occluded( instance.bounds ))
+		{
+			culledMeshes++, culledTris += mesh->tris;
+			continue;
+		}
+		// create batches
+		for (int first = 0; first < mesh->tris; first += BATCHSIZE)
+		{
+			if (batchCount == batches.size()) batches.push_back( GeometryBatch() );
+			GeometryBatch& batch = batches[batchCount++];
+			batch.mesh = mesh, batch.T = instance.T, batch.instance = instance.id;
+			batch.firstTri = first, batch.lastTri = min( mesh->tris, first + BATCHSIZE );
+			batch.shared = instance.occluder >= 0 ? occluderVerts[instance.occluder].data() : 0;
+		}
+	}
+	// geometry stage: batches are processed in parallel
+	parallel_for( 0, batchCount, 1, [this]( int b ) { ProcessBatch( batches[b] ); } );
+	clippedTris = 0;
+	for (int b = 0; b < batchCount; b++) culledTris += batches[b].culledTris, clippedTris += batches[b].clippedTris;
+	// binning: turn the per-batch counts into write offsets, so every tile lists its triangles in submission order
+	const int tileCount = tilesX * tilesY;
+	tileStart.resize( tileCount + 1 );
+	uint binnedCount = 0;
+	for (int t = 0; t < tileCount; t++)
+	{
+		tileStart[t] = binnedCount;
+		for (int b = 0; b < batchCount; b++)
+		{
+			const uint count = batches[b].tileCount[t];
+			batches[b].tileCount[t] = binnedCount;
+			binnedCount += count;
+		}
+	}
+	tileStart[tileCount] = binnedCount;
+	binned.resize( binnedCount );
+	parallel_for( 0, batchCount, 1, [this]( int b ) {
+		GeometryBatch& batch = batches[b];
+		for (const ScreenTri& t : batch.tris) for (int y = t.tileY0; y <= t.tileY1; y++) for (int x = t.tileX0; x <= t.tileX1; x++)
+			binned[batch.tileCount[x + y * tilesX]++] = &t;
+	} );
+	// raster stage: tiles are independent
+	if (visibility && (vbuffer.width != screen->width || vbuffer.height != screen->height)) vbuffer.Reinit( screen->width, screen->height );
+	fragmentCount = 0;
+	parallel_for( 0, tileCount, 1, [this]( int t ) { RasterizeTile( t ); } );
+	fragments = fragmentCount;
+	// deferred shading
+	if (!visibility) return;
+	instanceMesh.clear();
+	for (int i = 0; i < instanceCount; i++)
+	{
+		if (instances[i].id >= (int)instanceMesh.size()) instanceMesh.resize( instances[i].id + 1, 0 );
+		instanceMesh[instances[i].id] = instances[i].mesh;
+	}
+	parallel_for( 0, tileCount, 1, [this]( int t ) { ShadeTile( t ); } );
 }
 
-// EOF
\ No newline at end of file
+// EOF
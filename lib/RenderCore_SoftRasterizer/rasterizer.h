@@ -21,6 +21,8 @@
 namespace lh2core
 {
 
+class Rasterizer;
+
 // -----------------------------------------------------------
 // Surface class
 // bare minimum
@@ -36,19 +38,26 @@ public:
 
 // -----------------------------------------------------------
 // Texture class
-// encapsulates a palettized pixel surface with pre-scaled
-// palettes for fast shading
+// a 32-bit texture, optionally followed by a chain of MIP
+// levels (as produced by HostTexture::ConstructMIPmaps); the
+// size does not have to be a power of two
 // -----------------------------------------------------------
 class Texture
 {
 public:
 	// constructor / destructor
 	Texture() = default;
-	Texture( int w, int h ) : width( w ), height( h ) { pixels = (uint*)MALLOC64( w * h * sizeof( uint ) ); }
+	Texture( int w, int h ) : pixelCount( w * h ) { pixels = (uint*)MALLOC64( w * h * sizeof( uint ) ); SetSize( w, h ); }
 	~Texture() { FREE64( pixels ); }
+	// methods
+	void SetSize( int w, int h );
 	// data members
-	int width = 0, height = 0;
+	int width = 0, height = 0;		// size of level 0
+	uint pixelCount = 0;			// allocated texels, including MIP levels
 	uint* pixels = 0;
+	int MIPlevels = 1;				// number of levels stored in pixels
+	int levels = 1;					// number of usable levels; levels smaller than a texel are ignored
+	int levelOffset[MIPLEVELCOUNT], levelWidth[MIPLEVELCOUNT], levelHeight[MIPLEVELCOUNT];
 };
 
 // -----------------------------------------------------------
@@ -65,51 +74,22 @@ public:
 	Texture* texture = 0;			// texture
 };
 
-// -----------------------------------------------------------
-// SGNode class
-// scene graph node, with convenience functions for translate
-// and transform; base class for Mesh
-// -----------------------------------------------------------
-class SGNode
-{
-public:
-	enum { SG_TRANSFORM = 0, SG_MESH };
-	// constructor / destructor
-	~SGNode()
-	{
-		for (int s = (int)child.size(), i = 0; i < s; i++)
-		{
-			for (int j = i + 1; j < s; j++) if (child[j] == child[i]) child[j] = 0;
-			delete child[i];
-		}
-	}
-	// methods
-	void SetPosition( float3& pos ) { mat4& M = localTransform; M[3] = pos.x, M[7] = pos.y, M[11] = pos.z; }
-	float3 GetPosition() { mat4& M = localTransform; return make_float3( M[3], M[7], M[11] ); }
-	void Render( const mat4& transform );
-	virtual int GetType() { return SG_TRANSFORM; }
-	// data members
-	mat4 localTransform;
-	vector<SGNode*> child;
-};
-
 // -----------------------------------------------------------
 // Mesh class
-// represents a mesh
+// represents a mesh; shared by all instances of the mesh
 // -----------------------------------------------------------
-class Mesh : public SGNode
+class Mesh
 {
 public:
 	// constructor / destructor
-	Mesh() : verts( 0 ), tris( 0 ), pos( 0 ), uv( 0 ), spos( 0 ) {}
 	Mesh( int vcount, int tcount );
-	~Mesh() { delete pos; delete N; delete spos; delete tri; }
+	~Mesh() { delete[] px; delete[] norm; delete[] N; delete[] spos; delete[] tri; delete[] material; }
 	// methods
-	void Render( const mat4& transform );
-	virtual int GetType() { return SG_MESH; }
+	void UpdateBounds();
+	float3 Pos( const int i ) const { return make_float3( px[i], py[i], pz[i] ); }
+	void SetPos( const int i, const float3& p ) { px[i] = p.x, py[i] = p.y, pz[i] = p.z; }
 	// data members
-	float3* pos = 0;				// object-space vertex positions
-	float3* tpos = 0;				// world-space positions
+	float* px = 0, * py = 0, * pz = 0;	// object-space vertex positions (SoA), padded to a multiple of 8
 	float2* uv = 0;					// vertex uv coordinates
 	float2* spos = 0;				// screen positions
 	float3* norm = 0;				// vertex normals
@@ -118,17 +98,35 @@ public:
 	int verts = 0, tris = 0;		// vertex & triangle count
 	int* material = 0;				// per-face material ID
 	float3 bounds[2];				// mesh bounds
-	static Surface* screen;
-	static float* xleft, *xright;	// outline tables for rasterization
-	static float* uleft, *uright;
-	static float* vleft, *vright;
-	static float* zleft, *zright;
+	vector<float3> clusterBounds;	// bounds per CLUSTERSIZE triangles (min, max), for occlusion culling
+};
+
+// -----------------------------------------------------------
+// Instance class
+// a mesh placed in the world: mesh index, 3x4 transform and
+// the world-space bounds of the instance, plus its vertices
+// and face normals in world space; these are shared by all
+// views, and only recalculated when the instance changes
+// -----------------------------------------------------------
+class Instance
+{
+public:
+	// methods
+	void Set( const int meshIdx, const mat4& transform );
+	void Update( const Mesh& mesh, const bool avx2 );
+	mat4 Transform() const { mat4 M; memcpy( M.cell, T, sizeof( T ) ); return M; }
+	// data members
+	int mesh = -1;					// index in Scene::meshes
+	float T[12];					// object-to-world transform, top three rows
+	float3 bounds[2];				// world-space bounds
+	vector<float> world;			// world-space vertex positions, then face normals; SoA, padded to a multiple of 8
+	bool dirty = true;				// transform or mesh changed; Scene::Update recalculates bounds and world
 };
 
 // -----------------------------------------------------------
 // Scene class
-// owner of the scene graph;
-// owner of the material and texture list
+// owner of the meshes, the flat instance list, and the
+// material and texture lists
 // -----------------------------------------------------------
 class Scene
 {
@@ -136,31 +134,182 @@ public:
 	// constructor / destructor
 	Scene() = default;
 	~Scene();
+	// methods
+	void Update();
 	// data members
 public:
-	SGNode* root = 0;
+	vector<Mesh*> meshes;
+	vector<Instance> instances;
 	vector<Material*> matList;
 	vector<Texture*> texList;
 };
 
+// -----------------------------------------------------------
+// ScreenTri class
+// a clipped and projected triangle, ready for rasterization;
+// z, u and v are divided by camera-space z, so they can be
+// interpolated linearly in screen space
+// -----------------------------------------------------------
+struct ScreenVertex { float x, y, z, u, v; };
+class ScreenTri
+{
+public:
+	ScreenVertex vert[3];
+	const Texture* texture;			// 0 for untextured triangles
+	uint color;						// diffuse color, used if texture is 0
+	uint shade;						// scale for the texel color
+	uint instance, triangle;		// core instance index and mesh triangle index, for the visibility buffer
+	int tileX0, tileY0, tileX1, tileY1;	// range of tiles overlapped by the triangle
+};
+
+// -----------------------------------------------------------
+// ScreenBounds class
+// screen rectangle of a projected bounding box, and the
+// nearest depth (as 1/z) of the box
+// -----------------------------------------------------------
+struct ScreenBounds { float x0, y0, x1, y1, z; };
+
+// -----------------------------------------------------------
+// VisibleInstance class
+// an instance that survived frustum culling
+// -----------------------------------------------------------
+class VisibleInstance
+{
+public:
+	const Mesh* mesh;
+	mat4 T;							// camera-space transform of the instance
+	int id;							// core instance index
+	bool projected;					// false if the bounds intersect the near plane
+	ScreenBounds bounds;			// valid if projected
+	int occluder;					// index in Rasterizer::occluderVerts; -1 if not drawn in the depth pre-pass
+};
+
+// -----------------------------------------------------------
+// DepthPyramid class
+// hierarchical depth buffer for occlusion culling; a texel of
+// level 0 covers HIZ_SCALE x HIZ_SCALE pixels and stores the
+// farthest occluder depth in that square, every next level
+// stores the farthest depth of 2x2 texels of the previous one
+// -----------------------------------------------------------
+class DepthPyramid
+{
+public:
+	void Reinit( int w, int h );
+	void Clear() { memset( level[0].data(), 0, level[0].size() * sizeof( float ) ); }
+	void Build();
+	bool Occluded( const ScreenBounds& b ) const;
+	// data members
+	int screenWidth = 0, screenHeight = 0;
+	vector<int2> size;				// texels per level
+	vector<vector<float>> level;	// depth as 1/z; 0 where there is no occluder
+};
+
+// -----------------------------------------------------------
+// VisibilityBuffer class
+// per pixel: the nearest triangle, the barycentrics of the
+// pixel on that triangle, and its depth; written instead of
+// shaded colors in visibility mode
+// -----------------------------------------------------------
+class VisibilityBuffer
+{
+public:
+	enum { NOHIT = 0xffffffff };
+	void Reinit( int w, int h );
+	// data members
+	int width = 0, height = 0;
+	vector<uint> instance;			// core instance index; NOHIT for empty pixels
+	vector<uint> triangle;			// triangle index in the mesh of the instance
+	vector<float2> bary;			// barycentric coordinates of vertex 1 and 2
+	vector<float> depth;			// camera-space depth; 1e34f for empty pixels
+};
+
+// -----------------------------------------------------------
+// GeometryBatch class
+// a range of triangles of a mesh instance, processed by a
+// single job in the geometry stage
+// -----------------------------------------------------------
+class GeometryBatch
+{
+public:
+	const Mesh* mesh;
+	mat4 T;							// camera-space transform of the instance
+	int instance;					// core instance index
+	int firstTri, lastTri;
+	const float* shared;			// camera-space vertices of the mesh, from the depth pre-pass; 0 if not available
+	vector<float> cam;				// camera-space vertices of the batch (SoA), if there were none to share
+	vector<ScreenTri> tris;			// output: clipped and projected triangles
+	vector<uint> tileCount;			// output: number of triangles per tile; later: write offset per tile
+	uint culledTris;				// output: number of triangles in occluded clusters
+	uint clippedTris;				// output: number of triangles that were clipped geometrically
+};
+
 // -----------------------------------------------------------
 // Rasterizer class
 // rasterizer
 // implements a basic, but fast & accurate software rasterizer
+// sort-middle: triangles are transformed, clipped and binned
+// into screen tiles in parallel, after which the tiles are
+// rasterized in parallel, each with its own depth buffer.
+// meshes and triangle clusters are tested against a depth
+// pyramid, built from a depth pre-pass of the largest meshes.
+// a rasterizer holds the state for a single view; several
+// rasterizers can render the same scene concurrently.
+// in visibility mode, tiles are rasterized into a visibility
+// buffer, and shaded afterwards, once per pixel
 // -----------------------------------------------------------
 class Rasterizer
 {
 public:
+	// span fill algorithms
+	enum { SCANLINE = 0, EDGE_SSE, EDGE_AVX2 };
 	// constructor / destructor
 	Rasterizer() = default;
+	Rasterizer( const Scene* scene ) : scene( scene ) {}
 	// methods
-	void Init();
 	void Reinit( int w, int h, Surface* screen );
 	void Render( const mat4& transform );
+	void SetMode( const int mode );
+	int GetMode() const { return mode; }
+	static bool AVX2Supported();
+	// settings
+	const Scene* scene = 0;			// scene to render; not owned, may be shared with other rasterizers
+	bool occlusionCulling = true;	// test meshes and clusters against the depth pyramid
+	bool visibility = false;		// write the visibility buffer; shade in a deferred pass
+	bool filtering = true;			// MIP-mapped bilinear texture sampling; nearest level 0 texel otherwise
+	// output
+	VisibilityBuffer vbuffer;		// valid after rendering in visibility mode
+	// statistics for the last frame
+	uint64_t fragments = 0;			// number of covered pixels, before the depth test
+	uint culledMeshes = 0;			// mesh instances skipped by occlusion culling
+	uint culledTris = 0;			// triangles skipped by occlusion culling, including those of culled meshes
+	uint clippedTris = 0;			// triangles clipped against the near plane or the guard band
+private:
+	void AddMesh( const Mesh* mesh, const mat4& T, const int instanceIdx );
+	bool ProjectBounds( const float3& bmin, const float3& bmax, const mat4& T, ScreenBounds& b ) const;
+	void RenderOccluders();
+	void ProcessBatch( GeometryBatch& batch );
+	void RasterizeTile( const int tileIdx );
+	void ShadeTile( const int tileIdx );
 	// data members
-	static Scene scene;
-	static float* zbuffer;
-	static float4 frustum[5];
+	int mode = SCANLINE;			// span fill algorithm
+	vector<VisibleInstance> instances;	// visible instances of the current frame
+	int instanceCount = 0;
+	vector<const Mesh*> instanceMesh;	// mesh per core instance index, for deferred shading
+	DepthPyramid hiz;				// occluder depth pyramid
+	vector<vector<float3>> occluderTris;	// per occluder: projected triangles, in level 0 texels and 1/z
+	vector<vector<float>> occluderVerts;	// per occluder: camera-space vertices (SoA), reused by its batches
+	mat4 view;						// world-to-camera transform of the current frame
+	float3 eye;						// camera position of the current frame
+	bool avx2 = AVX2Supported();	// transform and cull 8 vertices / triangles at a time
+	std::atomic<uint64_t> fragmentCount = { 0 };
+	Surface* screen = 0;
+	int tilesX = 0, tilesY = 0;		// screen size in tiles
+	vector<GeometryBatch> batches;	// geometry batches; kept between frames to reuse memory
+	int batchCount = 0;				// number of batches used in the current frame
+	vector<uint> tileStart;			// per tile: first entry in binned; one extra entry for the end
+	vector<const ScreenTri*> binned;	// triangles sorted per tile, in submission order
+	float4 frustum[5];				// view frustum planes, in camera space
+	float4 clipPlanes[5];			// near plane and guard band planes, in camera space
 };
 
 } // namespace lh2core
@@ -32,9 +32,7 @@ void RenderCore::SetProbePos( int2 pos )
 //  +-----------------------------------------------------------------------------+
 void RenderCore::Init()
 {
-	// initialize scene
-	rasterizer.Init();
-	rasterizer.scene.root = new SGNode();
+	rasterizer.scene = &scene;
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -43,11 +41,29 @@ void RenderCore::Init()
 //  +-----------------------------------------------------------------------------+
 void RenderCore::SetTarget( GLTexture* target, const uint spp )
 {
-	// synchronize OpenGL viewport
-	scrwidth = target->width;
-	scrheight = target->height;
+	output.SetTarget( target );
+	Resize( target->width, target->height );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetHostTarget                                                  |
+//  |  Set the host buffer that serves as the render target.                LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::SetHostTarget( Bitmap* target, const uint spp )
+{
+	output.SetHostTarget( target );
+	Resize( target->width, target->height );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Resize                                                         |
+//  |  Adapt the render buffers to the size of the render target.           LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Resize( const int w, const int h )
+{
+	scrwidth = w;
+	scrheight = h;
 	// see if we need to reallocate our buffers
-	bool reallocate = false;
 	if (scrwidth * scrheight > maxPixels)
 	{
 		maxPixels = scrwidth * scrheight;
@@ -58,7 +74,6 @@ void RenderCore::SetTarget( GLTexture* target, const uint spp )
 	}
 	renderTarget->width = scrwidth;
 	renderTarget->height = scrheight;
-	targetTextureID = target->ID;
 	// inform rasterizer
 	rasterizer.Reinit( scrwidth, scrheight, renderTarget );
 }
@@ -74,16 +89,13 @@ void RenderCore::SetGeometry( const int meshIdx, const float4* vertexData, const
 	// Subsequent mesh changes will be applied to existing Meshes. This is deliberately
 	// minimalistic; RenderSystem is responsible for a proper (fault-tolerant) interface.
 	assert( vertexCount == 3 * triangleCount );
-	Mesh* mesh;
-	if (meshIdx >= meshes.size()) meshes.push_back( mesh = new Mesh( vertexCount, triangleCount ) );
-	else mesh = meshes[meshIdx]; // overwrite geometry data; assume vertex/face count does not change
-	float3 bmin = make_float3( 1e34f ), bmax = -bmin;
-	for (int i = 0; i < vertexCount; i++)
-		mesh->pos[i] = make_float3( vertexData[i] ),
-		bmin.x = min( bmin.x, vertexData[i].x ), bmin.y = min( bmin.y, vertexData[i].y ), bmin.z = min( bmin.z, vertexData[i].z ),
-		bmax.x = max( bmax.x, vertexData[i].x ), bmax.y = max( bmax.y, vertexData[i].y ), bmax.z = max( bmax.z, vertexData[i].z );
-	mesh->bounds[0] = bmin, mesh->bounds[1] = bmax;
+	if (meshIdx >= scene.meshes.size()) scene.meshes.push_back( 0 );
+	Mesh*& mesh = scene.meshes[meshIdx];
+	if (mesh && mesh->tris != triangleCount) delete mesh, mesh = 0; // topology changed
+	if (!mesh) mesh = new Mesh( vertexCount, triangleCount );
+	for (int i = 0; i < vertexCount; i++) mesh->SetPos( i, make_float3( vertexData[i] ) );
 	for (int i = 0; i < triangleCount * 3; i++) mesh->tri[i] = i;
+	mesh->UpdateBounds();
 	for (int i = 0; i < triangleCount; i++)
 		mesh->norm[i * 3 + 0] = triangles[i].vN0, mesh->norm[i * 3 + 1] = triangles[i].vN1, mesh->norm[i * 3 + 2] = triangles[i].vN2,
 		mesh->uv[i * 3 + 0] = make_float2( triangles[i].u0, triangles[i].v0 ),
@@ -91,6 +103,8 @@ void RenderCore::SetGeometry( const int meshIdx, const float4* vertexData, const
 		mesh->uv[i * 3 + 2] = make_float2( triangles[i].u2, triangles[i].v2 ),
 		mesh->N[i] = make_float3( triangles[i].Nx, triangles[i].Ny, triangles[i].Nz ),
 		mesh->material[i] = triangles[i].material;
+	// instances of a changed mesh need new world-space data
+	for (Instance& instance : scene.instances) if (instance.mesh == meshIdx) instance.dirty = true;
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -99,16 +113,15 @@ void RenderCore::SetGeometry( const int meshIdx, const float4* vertexData, const
 //  +-----------------------------------------------------------------------------+
 void RenderCore::SetInstance( const int instanceIdx, const int meshIdx, const mat4& matrix )
 {
-	if (instanceIdx >= rasterizer.scene.root->child.size())
+	// meshIdx -1 marks the end of the instance list: instances beyond it were removed
+	if (meshIdx == -1)
 	{
-		// Note: for first-time setup, meshes are expected to be passed in sequential order.
-		// This will result in new CoreInstance pointers being pushed into the instances vector.
-		// Subsequent instance changes (typically: transforms) will be applied to existing CoreInstances.
-		assert( instanceIdx == rasterizer.scene.root->child.size() );
-		rasterizer.scene.root->child.push_back( meshes[meshIdx] );
+		if (instanceIdx < scene.instances.size()) scene.instances.resize( instanceIdx );
+		return;
 	}
-	else rasterizer.scene.root->child[instanceIdx] = meshes[meshIdx];
-	rasterizer.scene.root->child[instanceIdx]->localTransform = matrix;
+	// only the changed instances are passed; others keep their transform and world-space data
+	if (instanceIdx >= scene.instances.size()) scene.instances.resize( instanceIdx + 1 );
+	scene.instances[instanceIdx].Set( meshIdx, matrix );
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -121,15 +134,32 @@ void RenderCore::SetTextures( const CoreTexDesc* tex, const int textures )
 	for (int i = 0; i < textures; i++)
 	{
 		Texture* t;
-		if (i < rasterizer.scene.texList.size()) t = rasterizer.scene.texList[i];
-		else rasterizer.scene.texList.push_back( t = new Texture() );
+		if (i < scene.texList.size()) t = scene.texList[i];
+		else scene.texList.push_back( t = new Texture() );
+		FREE64( t->pixels );
 		t->pixels = (uint*)MALLOC64( tex[i].pixelCount * sizeof( uint ) );
+		t->pixelCount = tex[i].pixelCount, t->MIPlevels = tex[i].MIPlevels;
 		if (tex[i].idata) memcpy( t->pixels, tex[i].idata, tex[i].pixelCount * sizeof( uint ) );
-		else memcpy( t->pixels, 0, tex[i].pixelCount * sizeof( uint ) /* assume integer textures */ );
+		else memset( t->pixels, 0, tex[i].pixelCount * sizeof( uint ) /* assume integer textures */ );
 		// Note: texture width and height are not known yet, will be set when we get the materials.
 	}
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::SetTexture                                                     |
+//  |  Update the texel data of a single texture.                           LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool RenderCore::SetTexture( const int textureIdx, const CoreTexDesc& tex )
+{
+	if (textureIdx < 0 || textureIdx >= scene.texList.size()) return false;
+	if (!tex.idata) return false; // we only handle integer textures
+	Texture* t = scene.texList[textureIdx];
+	if (t->pixelCount != tex.pixelCount) return false; // resized; SetTextures and SetMaterials handle this
+	t->MIPlevels = tex.MIPlevels;
+	memcpy( t->pixels, tex.idata, tex.pixelCount * sizeof( uint ) );
+	return true;
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderCore::SetMaterials                                                   |
 //  |  Set the material data.                                               LH2'19|
@@ -140,8 +170,8 @@ void RenderCore::SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, c
 	for (int i = 0; i < materialCount; i++)
 	{
 		Material* m;
-		if (i < rasterizer.scene.matList.size()) m = rasterizer.scene.matList[i];
-		else rasterizer.scene.matList.push_back( m = new Material() );
+		if (i < scene.matList.size()) m = scene.matList[i];
+		else scene.matList.push_back( m = new Material() );
 		m->texture = 0;
 		int texID = matEx[i].texture[TEXTURE0];
 		if (texID == -1)
@@ -151,9 +181,8 @@ void RenderCore::SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, c
 		}
 		else
 		{
-			m->texture = rasterizer.scene.texList[texID];
-			m->texture->width = mat[i].texwidth0; // we know this only now, so set it properly
-			m->texture->height = mat[i].texheight0;
+			m->texture = scene.texList[texID];
+			m->texture->SetSize( mat[i].texwidth0, mat[i].texheight0 ); // we know this only now, so set it properly
 		}
 	}
 }
@@ -185,7 +214,31 @@ void RenderCore::SetSkyData( const float3* pixels, const uint width, const uint
 //  +-----------------------------------------------------------------------------+
 void RenderCore::Setting( const char* name, const float value )
 {
-	// we have no settings yet
+	if (!strcmp( name, "rasterizer" ))
+	{
+		// 0: scanline, 1: half-space SSE, 2: half-space AVX2
+		rasterizer.SetMode( (int)value );
+	}
+	else if (!strcmp( name, "benchmark" ))
+	{
+		// render the next frame, and two benchmark scenes, this many times with each span fill algorithm
+		benchmarkFrames = (int)value;
+	}
+	else if (!strcmp( name, "occlusion" ))
+	{
+		// 0: frustum culling only, 1: occlusion culling using a depth pre-pass
+		rasterizer.occlusionCulling = value != 0;
+	}
+	else if (!strcmp( name, "visibility" ))
+	{
+		// 0: forward shading, 1: visibility buffer with deferred shading; enables picking
+		rasterizer.visibility = value != 0;
+	}
+	else if (!strcmp( name, "filtering" ))
+	{
+		// 0: nearest texel of level 0, 1: MIP-mapped bilinear filtering
+		rasterizer.filtering = value != 0;
+	}
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -201,10 +254,109 @@ void RenderCore::Render( const ViewPyramid& view, const Convergence converge, co
 	transform[0] = X.x, transform[4] = X.y, transform[8] = X.z;
 	transform[1] = Y.x, transform[5] = Y.y, transform[9] = Y.z;
 	transform[2] = Z.x, transform[6] = Z.y, transform[10] = Z.z;
+	scene.Update(); // world-space data of the instances that changed
+	if (benchmarkFrames > 0) Benchmark( mat4::Translate( view.pos ) * transform, benchmarkFrames ), benchmarkFrames = 0;
+	Timer timer;
 	rasterizer.Render( mat4::Translate( view.pos ) * transform );
-	// copy cpu surface to OpenGL render target texture
-	glBindTexture( GL_TEXTURE_2D, targetTextureID );
-	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, scrwidth, scrheight, 0, GL_RGBA, GL_UNSIGNED_BYTE, renderTarget->pixels );
+	coreStats.renderTime = timer.elapsed();
+	coreStats.culledMeshes = rasterizer.culledMeshes;
+	coreStats.culledTriangles = rasterizer.culledTris;
+	// triangle picking, using the visibility buffer
+	coreStats.probedInstid = coreStats.probedTriid = -1, coreStats.probedDist = 1e34f;
+	if (rasterizer.visibility && probePos.x >= 0 && probePos.y >= 0 && probePos.x < scrwidth && probePos.y < scrheight)
+	{
+		const VisibilityBuffer& vb = rasterizer.vbuffer;
+		const int idx = probePos.x + probePos.y * scrwidth;
+		if (vb.instance[idx] != VisibilityBuffer::NOHIT)
+		{
+			// distance along the primary ray through the pixel
+			const float d = vb.depth[idx], x = (probePos.x - scrwidth / 2) * d / scrwidth, y = (probePos.y - scrheight / 2) * d / scrwidth;
+			coreStats.probedInstid = vb.instance[idx], coreStats.probedTriid = vb.triangle[idx], coreStats.probedDist = sqrtf( x * x + y * y + d * d );
+		}
+	}
+	// copy cpu surface to the render target; the upload to OpenGL overlaps the next frame
+	output.Present( renderTarget->pixels );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  BenchmarkScene                                                             |
+//  |  Synthetic scenes for the benchmark: large triangles that reach beyond the  |
+//  |  screen, the guard band and the near plane, or a dense grid of tiny         |
+//  |  triangles in front of the camera.                                    LH2'19|
+//  +-----------------------------------------------------------------------------+
+static void BenchmarkScene( Scene& scene, const bool tiny )
+{
+	const int N = 512, tris = tiny ? N * N * 2 : 256;
+	Mesh* mesh = new Mesh( tris * 3, tris );
+	uint seed = 0x12345;
+	for (int i = 0; i < tris; i++)
+	{
+		float3 v[3];
+		if (tiny)
+		{
+			// cells of w / N pixels, at z = -1
+			const int cell = i / 2, x = cell % N, y = cell / N;
+			const float x0 = (float)x / N - 0.5f, y0 = (float)y / N - 0.5f, d = 1.0f / N;
+			if (i & 1) v[0] = make_float3( x0 + d, y0, -1 ), v[1] = make_float3( x0 + d, y0 + d, -1 ), v[2] = make_float3( x0, y0 + d, -1 );
+			else v[0] = make_float3( x0, y0, -1 ), v[1] = make_float3( x0 + d, y0, -1 ), v[2] = make_float3( x0, y0 + d, -1 );
+		}
+		else for (int j = 0; j < 3; j++)
+			v[j] = make_float3( (RandomFloat( seed ) - 0.5f) * 40, (RandomFloat( seed ) - 0.5f) * 40, 5 - RandomFloat( seed ) * 35 );
+		for (int j = 0; j < 3; j++)
+			mesh->SetPos( i * 3 + j, v[j] ), mesh->tri[i * 3 + j] = i * 3 + j,
+			mesh->uv[i * 3 + j] = make_float2( 0 ), mesh->norm[i * 3 + j] = make_float3( 0, 0, 1 );
+		// face the camera, which looks along -z from the origin
+		float3 n = normalize( cross( v[1] - v[0], v[2] - v[0] ) );
+		mesh->N[i] = dot( n, v[0] ) > 0 ? -n : n, mesh->material[i] = 0;
+	}
+	mesh->UpdateBounds();
+	Material* material = new Material();
+	material->diffuse = 0xffffff;
+	scene.meshes.push_back( mesh );
+	scene.matList.push_back( material );
+	scene.instances.push_back( Instance() );
+	scene.instances[0].Set( 0, mat4::Identity() );
+	scene.Update();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::Benchmark                                                      |
+//  |  Render the current view with each span fill algorithm, followed by the     |
+//  |  large-triangle and the tiny-triangle benchmark scenes.               LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderCore::Benchmark( const mat4& transform, const int frames )
+{
+	static const char* modeName[] = { "scanline", "half-space SSE", "half-space AVX2" };
+	static const char* sceneName[] = { "current view", "large triangles", "tiny triangles" };
+	const int modeCount = Rasterizer::AVX2Supported() ? 3 : 2;
+	printf( "rasterizer benchmark, %ix%i, %i frames\n", scrwidth, scrheight, frames );
+	for (int s = 0; s < 3; s++)
+	{
+		Scene* testScene = 0;
+		Rasterizer* r = &rasterizer;
+		if (s > 0)
+		{
+			testScene = new Scene();
+			BenchmarkScene( *testScene, s == 2 );
+			r = new Rasterizer( testScene );
+			r->Reinit( scrwidth, scrheight, renderTarget );
+			r->occlusionCulling = rasterizer.occlusionCulling, r->visibility = rasterizer.visibility, r->filtering = rasterizer.filtering;
+		}
+		const mat4 T = s > 0 ? mat4::Identity() : transform;
+		const int currentMode = r->GetMode();
+		for (int mode = 0; mode < modeCount; mode++)
+		{
+			r->SetMode( mode );
+			r->Render( T ); // warm-up
+			Timer timer;
+			uint64_t fragments = 0;
+			for (int i = 0; i < frames; i++) r->Render( T ), fragments += r->fragments;
+			const float time = timer.elapsed();
+			printf( "%-16s %-16s %8.3fms/frame %9.1f Mpixels/s %8u clipped\n", sceneName[s], modeName[mode], time * 1000 / frames, fragments / (time * 1e6f), r->clippedTris );
+		}
+		r->SetMode( currentMode );
+		if (s > 0) delete r, delete testScene;
+	}
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -213,6 +365,7 @@ void RenderCore::Render( const ViewPyramid& view, const Convergence converge, co
 //  +-----------------------------------------------------------------------------+
 void RenderCore::Shutdown()
 {
+	output.Release();
 	delete renderTarget;
 }
 
@@ -45,12 +45,14 @@ public:
 	void Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast );
 	void Setting( const char* name, const float value );
 	void SetTarget( GLTexture* target, const uint spp );
+	void SetHostTarget( Bitmap* target, const uint spp );
 	void Shutdown();
 	void KeyDown( const uint key ) {}
 	void KeyUp( const uint key ) {}
 	// passing data. Note: RenderCore always copies what it needs; the passed data thus remains the
 	// property of the caller, and can be safely deleted or modified as soon as these calls return.
 	void SetTextures( const CoreTexDesc* tex, const int textureCount );
+	bool SetTexture( const int textureIdx, const CoreTexDesc& tex ); // in-place update of a single texture
 	void SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount ); // textures must be in sync when calling this
 	void SetLights( const CoreLightTri* areaLights, const int areaLightCount,
 		const CorePointLight* pointLights, const int pointLightCount,
@@ -67,16 +69,19 @@ public:
 	void SetProbePos( const int2 pos );
 	// internal methods
 private:
+	void Resize( const int w, const int h );
+	void Benchmark( const mat4& transform, const int frames );
 	// data members
 	int scrwidth = 0, scrheight = 0;				// current screen width and height
 	Surface* renderTarget = 0;						// screen pixels
-	int targetTextureID = 0;						// ID of the target OpenGL texture
+	CPUTarget output;								// OpenGL texture or host buffer that receives the frames
 	int skywidth = 0, skyheight = 0;				// size of the skydome texture
 	int maxPixels = 0;								// max screen size buffers can accomodate without a realloc
-	int2 probePos = make_int2( 0 );					// triangle picking; primary ray for this pixel copies its triid to coreStats.probedTriid
+	int2 probePos = make_int2( 0 );					// triangle picking; in visibility mode, the triangle at this pixel is reported in coreStats
 	int textureCount = 0;							// size of texture descriptor array
-	Rasterizer rasterizer;							// rasterization functionality
-	vector<Mesh*> meshes;							// list of meshes, for easy access in SetGeometry
+	Scene scene;									// meshes, instances, materials and textures
+	Rasterizer rasterizer;							// rasterization functionality; renders scene
+	int benchmarkFrames = 0;						// if not zero: compare the span fill algorithms in the next Render
 public:
 	CoreStats coreStats;							// rendering statistics
 };
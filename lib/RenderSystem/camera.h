@@ -54,7 +54,7 @@ private:
 	// private data
 private:
 	string xmlFile = "camera.dat";					// file the camera was loaded from, used for dtor
-	TRACKCHANGES;									// add Changed(), MarkAsDirty() methods, see system.h
+	TRACKCHANGES_CRC64;								// add Changed(), MarkAsDirty() methods, see system.h
 };
 
 } // namespace lighthouse2
@@ -58,6 +58,7 @@
 #define BINTEXFILEVERSION	0x10001001
 
 // tools
+// #define VERIFYCHANGES			// cross-check change tracking against a crc64 of each object (slow)
 
 // nan chasing
 #ifndef __OPENCLCC__
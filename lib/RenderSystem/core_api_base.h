@@ -54,6 +54,8 @@ struct CoreStats
 	float shadowTraceTime;				// time spent tracing shadow rays
 	float shadeTime;					// time spent in shading code
 	float filterTime = 0;				// time spent in filter code
+	uint culledMeshes = 0;				// mesh instances skipped by occlusion culling
+	uint culledTriangles = 0;			// triangles skipped by occlusion culling
 	// probe
 	int probedInstid;					// id of the instance at probe position
 	int probedTriid;					// id of triangle at probe position
@@ -69,6 +71,10 @@ struct SystemStats
 {
 	// scene
 	float sceneUpdateTime = 0;			// time spent updating the scene graph
+	float transformTime = 0;			// part of sceneUpdateTime: node transforms and instance array
+	float poseTime = 0;					// part of sceneUpdateTime: morph targets and skinning
+	float lightUpdateTime = 0;			// part of sceneUpdateTime: light triangles of moved instances
+	float hostBVHTime = 0;				// time spent updating the host-side scene BVH, if enabled
 };
 
 //  +-----------------------------------------------------------------------------+
@@ -88,6 +94,8 @@ public:
 	virtual void SetProbePos( const int2 pos ) = 0;
 	// SetTarget: specify an OpenGL texture as a render target for the path tracer.
 	virtual void SetTarget( GLTexture* target, const uint spp ) = 0;
+	// SetHostTarget: specify a host-side buffer as a render target, for headless operation without OpenGL.
+	virtual void SetHostTarget( Bitmap* target, const uint spp ) { FATALERROR( "Core does not support host render targets." ); }
 	// Setting: modify a render setting
 	virtual void Setting( const char* name, float value ) = 0;
 	// Render: produce one frame. Convergence can be 'Converge' or 'Restart'.
@@ -96,6 +104,9 @@ public:
 	virtual void Shutdown() = 0;
 	// SetTextures: update the texture data in the RenderCore using the supplied data.
 	virtual void SetTextures( const CoreTexDesc* tex, const int textureCount ) = 0;
+	// SetTexture: update the texel data of a single texture previously passed via SetTextures. Returns false if the
+	// core can't do this (e.g. because the texel count changed); the RenderSystem then falls back to SetTextures.
+	virtual bool SetTexture( const int textureIdx, const CoreTexDesc& tex ) { return false; }
 	// SetMaterials: update the material list used by the RenderCore. Textures referenced by the materials must be set in advance.
 	virtual void SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount ) = 0;
 	// SetLights: update the point lights, spot lights and directional lights.
@@ -107,8 +118,22 @@ public:
 	virtual void SetSkyData( const float3* pixels, const uint width, const uint height ) = 0;
 	// SetGeometry: update the geometry for a single mesh.
 	virtual void SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags = 0 ) = 0;
+	// UpdateGeometry: update the vertices of a mesh previously passed via SetGeometry; the topology is unchanged. vertexData
+	// and triangles contain the full mesh; dirtyRanges lists the rangeCount (first, count) triangle ranges that changed, along
+	// with their vertices (three per triangle). The core may refit its acceleration structure rather than rebuild it.
+	// Returns false if the core can't do this; the RenderSystem then falls back to SetGeometry.
+	virtual bool UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount ) { return false; }
 	// SetInstance: update the data on a single instance.
 	virtual void SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform = mat4::Identity() ) = 0;
+	// SetInstances: update a batch of instances. meshIds and transforms contain data for all instanceCount instances;
+	// dirtyRanges lists the rangeCount (first, count) pairs that changed since the previous call. Instances beyond
+	// instanceCount are removed. The default implementation forwards the dirty ranges to SetInstance.
+	virtual void SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount )
+	{
+		for (int i = 0; i < rangeCount; i++) for (int j = dirtyRanges[i].x; j < dirtyRanges[i].x + dirtyRanges[i].y; j++)
+			SetInstance( j, meshIds[j], transforms[j] );
+		SetInstance( instanceCount, -1 );
+	}
 	// UpdateTopLevel: trigger a top-level BVH update.
 	virtual void UpdateToplevel() = 0;
 };
@@ -0,0 +1,417 @@
+/* core_api_recorder.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file contains the implementation of the core API recorder and the
+   trace player.
+*/
+
+#include "rendersystem.h"
+
+static const char traceMagic[8] = { 'L', 'H', '2', 'T', 'R', 'A', 'C', 'E' };
+static inline size_t Padded( const size_t size ) { return (size + 15) & ~(size_t)15; }
+static inline size_t TexelBytes( const CoreTexDesc& tex ) { return tex.pixelCount * (tex.storage == ARGB128 ? sizeof( float4 ) : sizeof( uint )); }
+
+// fixed-size arguments of the recorded calls
+struct SettingArgs { float value; int nameLength; };
+struct RenderArgs { int converge; float brightness, contrast; };
+struct LightArgs { int areaLightCount, pointLightCount, spotLightCount, directionalLightCount; };
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreAPI_Recorder::CoreAPI_Recorder                                         |
+//  |  Constructor.                                                         LH2'19|
+//  +-----------------------------------------------------------------------------+
+CoreAPI_Recorder::CoreAPI_Recorder( CoreAPI_Base* recordedCore, const char* fileName ) : core( recordedCore )
+{
+	file = fopen( fileName, "wb" );
+	FATALERROR_IF( !file, "Could not open trace file %s", fileName );
+	const uint header[2] = { TRACE_VERSION, 0 };
+	fwrite( traceMagic, 1, sizeof( traceMagic ), file );
+	fwrite( header, 1, sizeof( header ), file );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreAPI_Recorder::~CoreAPI_Recorder                                        |
+//  |  Destructor.                                                          LH2'19|
+//  +-----------------------------------------------------------------------------+
+CoreAPI_Recorder::~CoreAPI_Recorder()
+{
+	if (file) fclose( file );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreAPI_Recorder::Write                                                    |
+//  |  Write a record to the trace. Each chunk is padded to 16 bytes.       LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CoreAPI_Recorder::Write( const TraceOpcode opcode, const vector<Chunk>& chunks )
+{
+	static const uchar zeroes[16] = {};
+	TraceRecord record = { (uint)opcode, 0, 0 };
+	for (const Chunk& c : chunks) record.size += Padded( c.size );
+	fwrite( &record, 1, sizeof( TraceRecord ), file );
+	for (const Chunk& c : chunks)
+	{
+		if (c.size > 0) fwrite( c.data, 1, c.size, file );
+		fwrite( zeroes, 1, Padded( c.size ) - c.size, file );
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreAPI_Recorder - recorded calls                                          |
+//  |  Each call is written to the trace, then forwarded to the core.       LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CoreAPI_Recorder::SetProbePos( const int2 pos )
+{
+	Write( TRACE_SET_PROBE_POS, { { &pos, sizeof( int2 ) } } );
+	core->SetProbePos( pos );
+}
+
+void CoreAPI_Recorder::SetTarget( GLTexture* target, const uint spp )
+{
+	const uint4 args = make_uint4( target->width, target->height, spp, 0 );
+	Write( TRACE_SET_TARGET, { { &args, sizeof( uint4 ) } } );
+	core->SetTarget( target, spp );
+}
+
+void CoreAPI_Recorder::SetHostTarget( Bitmap* target, const uint spp )
+{
+	const uint4 args = make_uint4( target->width, target->height, spp, 0 );
+	Write( TRACE_SET_HOST_TARGET, { { &args, sizeof( uint4 ) } } );
+	core->SetHostTarget( target, spp );
+}
+
+void CoreAPI_Recorder::Setting( const char* name, float value )
+{
+	const SettingArgs args = { value, (int)strlen( name ) };
+	Write( TRACE_SETTING, { { &args, sizeof( SettingArgs ) }, { name, (size_t)args.nameLength + 1 } } );
+	core->Setting( name, value );
+}
+
+void CoreAPI_Recorder::Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast )
+{
+	const RenderArgs args = { (int)converge, brightness, contrast };
+	Write( TRACE_RENDER, { { &view, sizeof( ViewPyramid ) }, { &args, sizeof( RenderArgs ) } } );
+	core->Render( view, converge, brightness, contrast );
+}
+
+void CoreAPI_Recorder::Shutdown()
+{
+	Write( TRACE_SHUTDOWN, {} );
+	fclose( file );
+	file = nullptr;
+	core->Shutdown();
+}
+
+void CoreAPI_Recorder::SetTextures( const CoreTexDesc* tex, const int textureCount )
+{
+	vector<Chunk> chunks = { { &textureCount, sizeof( int ) }, { tex, textureCount * sizeof( CoreTexDesc ) } };
+	for (int i = 0; i < textureCount; i++) chunks.push_back( { tex[i].idata, TexelBytes( tex[i] ) } );
+	Write( TRACE_SET_TEXTURES, chunks );
+	core->SetTextures( tex, textureCount );
+}
+
+bool CoreAPI_Recorder::SetTexture( const int textureIdx, const CoreTexDesc& tex )
+{
+	// record only if the core accepted the texture; otherwise the RenderSystem falls back to SetTextures
+	if (!core->SetTexture( textureIdx, tex )) return false;
+	Write( TRACE_SET_TEXTURE, { { &textureIdx, sizeof( int ) }, { &tex, sizeof( CoreTexDesc ) }, { tex.idata, TexelBytes( tex ) } } );
+	return true;
+}
+
+void CoreAPI_Recorder::SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount )
+{
+	Write( TRACE_SET_MATERIALS, { { &materialCount, sizeof( int ) }, { mat, materialCount * sizeof( CoreMaterial ) }, { matEx, materialCount * sizeof( CoreMaterialEx ) } } );
+	core->SetMaterials( mat, matEx, materialCount );
+}
+
+void CoreAPI_Recorder::SetLights( const CoreLightTri* areaLights, const int areaLightCount,
+	const CorePointLight* pointLights, const int pointLightCount,
+	const CoreSpotLight* spotLights, const int spotLightCount,
+	const CoreDirectionalLight* directionalLights, const int directionalLightCount )
+{
+	const LightArgs args = { areaLightCount, pointLightCount, spotLightCount, directionalLightCount };
+	Write( TRACE_SET_LIGHTS, { { &args, sizeof( LightArgs ) },
+		{ areaLights, areaLightCount * sizeof( CoreLightTri ) }, { pointLights, pointLightCount * sizeof( CorePointLight ) },
+		{ spotLights, spotLightCount * sizeof( CoreSpotLight ) }, { directionalLights, directionalLightCount * sizeof( CoreDirectionalLight ) } } );
+	core->SetLights( areaLights, areaLightCount, pointLights, pointLightCount, spotLights, spotLightCount, directionalLights, directionalLightCount );
+}
+
+void CoreAPI_Recorder::SetSkyData( const float3* pixels, const uint width, const uint height )
+{
+	const uint4 args = make_uint4( width, height, 0, 0 );
+	Write( TRACE_SET_SKY_DATA, { { &args, sizeof( uint4 ) }, { pixels, width * height * sizeof( float3 ) } } );
+	core->SetSkyData( pixels, width, height );
+}
+
+void CoreAPI_Recorder::SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags )
+{
+	const int4 args = make_int4( meshIdx, vertexCount, triangleCount, alphaFlags ? 1 : 0 );
+	Write( TRACE_SET_GEOMETRY, { { &args, sizeof( int4 ) }, { vertexData, vertexCount * sizeof( float4 ) },
+		{ triangles, triangleCount * sizeof( CoreTri ) }, { alphaFlags, alphaFlags ? triangleCount * sizeof( uint ) : 0 } } );
+	core->SetGeometry( meshIdx, vertexData, vertexCount, triangleCount, triangles, alphaFlags );
+}
+
+bool CoreAPI_Recorder::UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount )
+{
+	// record only if the core accepted the update; otherwise the RenderSystem falls back to SetGeometry
+	if (!core->UpdateGeometry( meshIdx, vertexData, vertexCount, triangleCount, triangles, dirtyRanges, rangeCount )) return false;
+	const int4 args = make_int4( meshIdx, vertexCount, triangleCount, rangeCount );
+	vector<Chunk> chunks = { { &args, sizeof( int4 ) }, { dirtyRanges, rangeCount * sizeof( int2 ) } };
+	for (int i = 0; i < rangeCount; i++)
+	{
+		chunks.push_back( { vertexData + dirtyRanges[i].x * 3, dirtyRanges[i].y * 3 * sizeof( float4 ) } );
+		chunks.push_back( { triangles + dirtyRanges[i].x, dirtyRanges[i].y * sizeof( CoreTri ) } );
+	}
+	Write( TRACE_UPDATE_GEOMETRY, chunks );
+	return true;
+}
+
+void CoreAPI_Recorder::SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform )
+{
+	const int2 args = make_int2( instanceIdx, modelIdx );
+	Write( TRACE_SET_INSTANCE, { { &args, sizeof( int2 ) }, { &transform, sizeof( mat4 ) } } );
+	core->SetInstance( instanceIdx, modelIdx, transform );
+}
+
+void CoreAPI_Recorder::SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount )
+{
+	// only the dirty ranges are stored; the player keeps track of the full instance arrays
+	const int2 args = make_int2( instanceCount, rangeCount );
+	vector<Chunk> chunks = { { &args, sizeof( int2 ) }, { dirtyRanges, rangeCount * sizeof( int2 ) } };
+	for (int i = 0; i < rangeCount; i++)
+	{
+		chunks.push_back( { meshIds + dirtyRanges[i].x, dirtyRanges[i].y * sizeof( int ) } );
+		chunks.push_back( { transforms + dirtyRanges[i].x, dirtyRanges[i].y * sizeof( mat4 ) } );
+	}
+	Write( TRACE_SET_INSTANCES, chunks );
+	core->SetInstances( meshIds, transforms, instanceCount, dirtyRanges, rangeCount );
+}
+
+void CoreAPI_Recorder::UpdateToplevel()
+{
+	Write( TRACE_UPDATE_TOPLEVEL, {} );
+	core->UpdateToplevel();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreTracePlayer::Load                                                      |
+//  |  Read a trace file into memory.                                       LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool CoreTracePlayer::Load( const char* fileName )
+{
+	FILE* f = fopen( fileName, "rb" );
+	if (!f) return false;
+	fseek( f, 0, SEEK_END );
+	const long fileSize = ftell( f );
+	fseek( f, 0, SEEK_SET );
+	if (fileSize < 16) { fclose( f ); return false; }
+	trace.resize( Padded( fileSize ) / sizeof( uint4 ) );
+	traceSize = fread( trace.data(), 1, fileSize, f );
+	fclose( f );
+	const uint version = ((uint*)trace.data())[2];
+	if (traceSize != (size_t)fileSize || memcmp( trace.data(), traceMagic, sizeof( traceMagic ) ) != 0) return false;
+	FATALERROR_IF( version != TRACE_VERSION, "Trace file %s has version %i; expected %i", fileName, version, TRACE_VERSION );
+	// count frames
+	frameCount = 0;
+	for (size_t pos = 16; pos + sizeof( TraceRecord ) <= traceSize;)
+	{
+		const TraceRecord* record = (TraceRecord*)((uchar*)trace.data() + pos);
+		if (record->opcode == TRACE_RENDER) frameCount++;
+		pos += sizeof( TraceRecord ) + record->size;
+	}
+	return true;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreTracePlayer::Replay                                                    |
+//  |  Feed the loaded trace to a core.                                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CoreTracePlayer::Replay( CoreAPI_Base* core )
+{
+	for (int i = 0; i < TRACE_OPCODE_COUNT; i++) stats[i] = OpcodeStats();
+	vector<int> meshIds;				// full instance arrays, updated by TRACE_SET_INSTANCES
+	vector<mat4> transforms;
+	struct MeshState { const float4* vertices; const CoreTri* triangles; const uint* alphaFlags; vector<float4> v; vector<CoreTri> t; };
+	vector<MeshState> meshes;			// per mesh: most recent SetGeometry data, and a copy for TRACE_UPDATE_GEOMETRY
+	vector<CoreTexDesc> textures;		// most recent texture set, patched by TRACE_SET_TEXTURE; texels point into the trace
+	uchar* data = (uchar*)trace.data();
+	for (size_t pos = 16; pos + sizeof( TraceRecord ) <= traceSize;)
+	{
+		const TraceRecord* record = (TraceRecord*)(data + pos);
+		uchar* args = data + pos + sizeof( TraceRecord );
+		pos += sizeof( TraceRecord ) + record->size;
+		FATALERROR_IF( pos > traceSize || record->opcode >= TRACE_OPCODE_COUNT, "Corrupt trace" );
+		if (record->opcode == TRACE_SHUTDOWN) break;
+		// Get: obtain the next argument chunk of the record
+		auto Get = [&args]( const size_t size ) { uchar* chunk = args; args += Padded( size ); return chunk; };
+		Timer timer;
+		switch (record->opcode)
+		{
+		case TRACE_SET_PROBE_POS:
+			core->SetProbePos( *(int2*)Get( sizeof( int2 ) ) );
+			break;
+		case TRACE_SET_TARGET:
+		case TRACE_SET_HOST_TARGET:
+		{
+			const uint4 a = *(uint4*)Get( sizeof( uint4 ) );
+			FATALERROR_IF( !setTarget, "CoreTracePlayer::setTarget not set" );
+			setTarget( core, a.x, a.y, a.z );
+			break;
+		}
+		case TRACE_SETTING:
+		{
+			const SettingArgs a = *(SettingArgs*)Get( sizeof( SettingArgs ) );
+			core->Setting( (char*)Get( a.nameLength + 1 ), a.value );
+			break;
+		}
+		case TRACE_RENDER:
+		{
+			const ViewPyramid& view = *(ViewPyramid*)Get( sizeof( ViewPyramid ) );
+			const RenderArgs a = *(RenderArgs*)Get( sizeof( RenderArgs ) );
+			core->Render( view, (Convergence)a.converge, a.brightness, a.contrast );
+			break;
+		}
+		case TRACE_SET_TEXTURES:
+		{
+			const int count = *(int*)Get( sizeof( int ) );
+			CoreTexDesc* tex = (CoreTexDesc*)Get( count * sizeof( CoreTexDesc ) );
+			for (int i = 0; i < count; i++) tex[i].idata = (uchar4*)Get( TexelBytes( tex[i] ) );
+			core->SetTextures( tex, count );
+			textures.assign( tex, tex + count );
+			break;
+		}
+		case TRACE_SET_TEXTURE:
+		{
+			// the recording core accepted this update; the replay core may not, in which case the full set is sent
+			const int idx = *(int*)Get( sizeof( int ) );
+			CoreTexDesc& tex = *(CoreTexDesc*)Get( sizeof( CoreTexDesc ) );
+			tex.idata = (uchar4*)Get( TexelBytes( tex ) );
+			FATALERROR_IF( idx < 0 || idx >= (int)textures.size(), "Corrupt trace" );
+			textures[idx] = tex;
+			if (!core->SetTexture( idx, tex )) core->SetTextures( textures.data(), (int)textures.size() );
+			break;
+		}
+		case TRACE_SET_MATERIALS:
+		{
+			const int count = *(int*)Get( sizeof( int ) );
+			CoreMaterial* mat = (CoreMaterial*)Get( count * sizeof( CoreMaterial ) );
+			const CoreMaterialEx* matEx = (CoreMaterialEx*)Get( count * sizeof( CoreMaterialEx ) );
+			core->SetMaterials( mat, matEx, count );
+			break;
+		}
+		case TRACE_SET_LIGHTS:
+		{
+			const LightArgs a = *(LightArgs*)Get( sizeof( LightArgs ) );
+			const CoreLightTri* areaLights = (CoreLightTri*)Get( a.areaLightCount * sizeof( CoreLightTri ) );
+			const CorePointLight* pointLights = (CorePointLight*)Get( a.pointLightCount * sizeof( CorePointLight ) );
+			const CoreSpotLight* spotLights = (CoreSpotLight*)Get( a.spotLightCount * sizeof( CoreSpotLight ) );
+			const CoreDirectionalLight* directionalLights = (CoreDirectionalLight*)Get( a.directionalLightCount * sizeof( CoreDirectionalLight ) );
+			core->SetLights( areaLights, a.areaLightCount, pointLights, a.pointLightCount, spotLights, a.spotLightCount, directionalLights, a.directionalLightCount );
+			break;
+		}
+		case TRACE_SET_SKY_DATA:
+		{
+			const uint4 a = *(uint4*)Get( sizeof( uint4 ) );
+			core->SetSkyData( (float3*)Get( a.x * a.y * sizeof( float3 ) ), a.x, a.y );
+			break;
+		}
+		case TRACE_SET_GEOMETRY:
+		{
+			const int4 a = *(int4*)Get( sizeof( int4 ) );
+			const float4* vertices = (float4*)Get( a.y * sizeof( float4 ) );
+			const CoreTri* triangles = (CoreTri*)Get( a.z * sizeof( CoreTri ) );
+			const uint* alphaFlags = a.w ? (uint*)Get( a.z * sizeof( uint ) ) : 0;
+			core->SetGeometry( a.x, vertices, a.y, a.z, triangles, alphaFlags );
+			if (a.x >= (int)meshes.size()) meshes.resize( a.x + 1 );
+			meshes[a.x].vertices = vertices, meshes[a.x].triangles = triangles, meshes[a.x].alphaFlags = alphaFlags;
+			meshes[a.x].v.clear(), meshes[a.x].t.clear();
+			break;
+		}
+		case TRACE_UPDATE_GEOMETRY:
+		{
+			// the trace contains only the modified ranges; apply these to a copy of the mesh
+			const int4 a = *(int4*)Get( sizeof( int4 ) );
+			const int2* ranges = (int2*)Get( a.w * sizeof( int2 ) );
+			MeshState& mesh = meshes[a.x];
+			if (mesh.v.size() == 0) mesh.v.assign( mesh.vertices, mesh.vertices + a.y ), mesh.t.assign( mesh.triangles, mesh.triangles + a.z );
+			for (int i = 0; i < a.w; i++)
+			{
+				memcpy( mesh.v.data() + ranges[i].x * 3, Get( ranges[i].y * 3 * sizeof( float4 ) ), ranges[i].y * 3 * sizeof( float4 ) );
+				memcpy( mesh.t.data() + ranges[i].x, Get( ranges[i].y * sizeof( CoreTri ) ), ranges[i].y * sizeof( CoreTri ) );
+			}
+			if (!core->UpdateGeometry( a.x, mesh.v.data(), a.y, a.z, mesh.t.data(), ranges, a.w ))
+				core->SetGeometry( a.x, mesh.v.data(), a.y, a.z, mesh.t.data(), mesh.alphaFlags );
+			break;
+		}
+		case TRACE_SET_INSTANCE:
+		{
+			const int2 a = *(int2*)Get( sizeof( int2 ) );
+			core->SetInstance( a.x, a.y, *(mat4*)Get( sizeof( mat4 ) ) );
+			break;
+		}
+		case TRACE_SET_INSTANCES:
+		{
+			const int2 a = *(int2*)Get( sizeof( int2 ) );
+			const int2* ranges = (int2*)Get( a.y * sizeof( int2 ) );
+			meshIds.resize( a.x ), transforms.resize( a.x );
+			for (int i = 0; i < a.y; i++)
+			{
+				memcpy( meshIds.data() + ranges[i].x, Get( ranges[i].y * sizeof( int ) ), ranges[i].y * sizeof( int ) );
+				memcpy( transforms.data() + ranges[i].x, Get( ranges[i].y * sizeof( mat4 ) ), ranges[i].y * sizeof( mat4 ) );
+			}
+			core->SetInstances( meshIds.data(), transforms.data(), a.x, ranges, a.y );
+			break;
+		}
+		case TRACE_UPDATE_TOPLEVEL:
+			core->UpdateToplevel();
+			break;
+		}
+		OpcodeStats& s = stats[record->opcode];
+		s.calls++;
+		s.bytes += record->size;
+		s.time += timer.elapsed();
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreTracePlayer::PrintStats                                                |
+//  |  Report the per opcode statistics of the last replay.                 LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CoreTracePlayer::PrintStats()
+{
+	double total = 0;
+	printf( "opcode              calls          MB        ms\n" );
+	for (int i = 0; i < TRACE_OPCODE_COUNT; i++) if (stats[i].calls > 0)
+	{
+		const OpcodeStats& s = stats[i];
+		printf( "%-16s %8i %11.3f %9.3f\n", OpcodeName( i ), s.calls, (double)s.bytes / (1024 * 1024), s.time * 1000 );
+		total += s.time;
+	}
+	printf( "total: %.3fms, %i frames, %.3fms/frame\n", total * 1000, frameCount, total * 1000 / max( 1u, frameCount ) );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreTracePlayer::OpcodeName                                                |
+//  |  Name of the CoreAPI entry point for an opcode.                       LH2'19|
+//  +-----------------------------------------------------------------------------+
+const char* CoreTracePlayer::OpcodeName( const uint opcode )
+{
+	static const char* name[TRACE_OPCODE_COUNT] = {
+		"SetProbePos", "SetTarget", "SetHostTarget", "Setting", "Render",
+		"SetTextures", "SetTexture", "SetMaterials", "SetLights", "SetSkyData",
+		"SetGeometry", "SetInstance", "SetInstances", "UpdateToplevel", "Shutdown", "UpdateGeometry"
+	};
+	return opcode < TRACE_OPCODE_COUNT ? name[opcode] : "unknown";
+}
+
+// EOF
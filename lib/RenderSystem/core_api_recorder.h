@@ -0,0 +1,128 @@
+/* core_api_recorder.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file contains the declaration of the core API recorder, which
+   writes all calls to a core to a binary trace, and the trace player,
+   which feeds a trace into any core.
+
+   Trace layout: a 16-byte header ("LH2TRACE", version, 0), followed by
+   records. Each record starts with a 16-byte TraceRecord, followed by
+   the arguments of the call. Arrays in a record are padded to 16 bytes,
+   so the player can pass pointers into the loaded trace to the core.
+*/
+
+#pragma once
+
+#include <functional>
+
+namespace lighthouse2
+{
+
+#define TRACE_VERSION	1
+
+enum TraceOpcode
+{
+	TRACE_SET_PROBE_POS = 0,
+	TRACE_SET_TARGET,
+	TRACE_SET_HOST_TARGET,
+	TRACE_SETTING,
+	TRACE_RENDER,
+	TRACE_SET_TEXTURES,
+	TRACE_SET_TEXTURE,
+	TRACE_SET_MATERIALS,
+	TRACE_SET_LIGHTS,
+	TRACE_SET_SKY_DATA,
+	TRACE_SET_GEOMETRY,
+	TRACE_SET_INSTANCE,
+	TRACE_SET_INSTANCES,
+	TRACE_UPDATE_TOPLEVEL,
+	TRACE_SHUTDOWN,
+	TRACE_UPDATE_GEOMETRY,
+	TRACE_OPCODE_COUNT
+};
+
+struct TraceRecord
+{
+	uint opcode;						// TraceOpcode
+	uint dummy;							// padding
+	uint64_t size;						// size of the arguments following this record, in bytes
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreAPI_Recorder                                                           |
+//  |  Forwards all calls to a core, and writes them to a trace file.       LH2'19|
+//  +-----------------------------------------------------------------------------+
+class CoreAPI_Recorder : public CoreAPI_Base
+{
+public:
+	CoreAPI_Recorder( CoreAPI_Base* recordedCore, const char* fileName );
+	~CoreAPI_Recorder();
+	// CoreAPI_Base interface
+	CoreStats GetCoreStats() { return core->GetCoreStats(); }
+	void Init() { /* the recorded core is initialized by CreateCoreAPI */ }
+	void SetProbePos( const int2 pos );
+	void SetTarget( GLTexture* target, const uint spp );
+	void SetHostTarget( Bitmap* target, const uint spp );
+	void Setting( const char* name, float value );
+	void Render( const ViewPyramid& view, const Convergence converge, const float brightness, const float contrast );
+	void Shutdown();
+	void SetTextures( const CoreTexDesc* tex, const int textureCount );
+	bool SetTexture( const int textureIdx, const CoreTexDesc& tex );
+	void SetMaterials( CoreMaterial* mat, const CoreMaterialEx* matEx, const int materialCount );
+	void SetLights( const CoreLightTri* areaLights, const int areaLightCount,
+		const CorePointLight* pointLights, const int pointLightCount,
+		const CoreSpotLight* spotLights, const int spotLightCount,
+		const CoreDirectionalLight* directionalLights, const int directionalLightCount );
+	void SetSkyData( const float3* pixels, const uint width, const uint height );
+	void SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags = 0 );
+	bool UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount );
+	void SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform = mat4::Identity() );
+	void SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount );
+	void UpdateToplevel();
+private:
+	struct Chunk { const void* data; size_t size; };
+	void Write( const TraceOpcode opcode, const vector<Chunk>& chunks );
+	CoreAPI_Base* core = nullptr;		// the core that receives the calls
+	FILE* file = nullptr;				// trace file
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  CoreTracePlayer                                                            |
+//  |  Loads a trace and replays it on a core. The core receives pointers into    |
+//  |  the loaded trace, so no data is copied during playback.              LH2'19|
+//  +-----------------------------------------------------------------------------+
+class CoreTracePlayer
+{
+public:
+	struct OpcodeStats { uint calls = 0; uint64_t bytes = 0; double time = 0; };
+	// Load: read a trace file into memory; returns false if the file is not a valid trace.
+	bool Load( const char* fileName );
+	// Replay: feed the trace to the core, up to the recorded Shutdown, which is left to the application.
+	// Render targets are created by the application, via setTarget.
+	void Replay( CoreAPI_Base* core );
+	// PrintStats: report calls, data size and time per opcode for the last replay.
+	void PrintStats();
+	static const char* OpcodeName( const uint opcode );
+	// callback for TRACE_SET_TARGET and TRACE_SET_HOST_TARGET: set a render target of the recorded size on the core
+	std::function<void( CoreAPI_Base* core, const int width, const int height, const uint spp )> setTarget;
+	OpcodeStats stats[TRACE_OPCODE_COUNT];
+	uint frameCount = 0;				// number of TRACE_RENDER records in the trace
+private:
+	vector<uint4> trace;				// trace contents, 16-byte aligned
+	size_t traceSize = 0;				// trace size in bytes
+};
+
+} // namespace lighthouse2
+
+// EOF
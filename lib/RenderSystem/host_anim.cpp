@@ -248,6 +248,7 @@ void HostAnimation::Channel::Update( const float dt, const Sampler* sampler )
 		}
 		HostScene::nodePool[nodeIdx]->morphed = true;
 	}
+	HostScene::nodePool[nodeIdx]->MarkAsDirty();
 }
 
 //  +-----------------------------------------------------------------------------+
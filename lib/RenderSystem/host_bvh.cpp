@@ -0,0 +1,532 @@
+/* host_bvh.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+*/
+
+#include "rendersystem.h"
+
+#define BVH_BINS			16		// split candidates per axis: BVH_BINS - 1
+#define BVH_MAXLEAF			8		// larger leaves are split, even if the SAH disagrees
+#define BVH_PARALLEL_SPLIT	4096	// subtrees of nodes with children of at least this size are built concurrently
+#define BVH_PARALLEL_BINS	65536	// nodes of at least this size bin their triangles in parallel
+
+// build state, shared by the jobs of a single build
+struct HostBVH::BuildState
+{
+	std::atomic<uint> nodesUsed;		// node allocation
+};
+
+// centroid bins of a node, along the three axes
+struct BVHBins
+{
+	aabb bounds[3][BVH_BINS];
+	uint count[3][BVH_BINS];
+	void Reset() { for (int a = 0; a < 3; a++) for (int i = 0; i < BVH_BINS; i++) bounds[a][i].Reset(), count[a][i] = 0; }
+};
+
+// bin of a centroid along an axis; the partition uses the same expression as the binning
+static inline int BinIndex( const float c, const float cmin, const float scale )
+{
+	return min( BVH_BINS - 1, (int)((c - cmin) * scale) );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::Build                                                             |
+//  |  Build the BVH for the vertices of a mesh, or for a set of bounding boxes   |
+//  |  (e.g. the instances of a scene).                                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::Build( const HostMesh* mesh )
+{
+	Build( mesh->vertices.data(), (int)mesh->triangles.size() );
+}
+void HostBVH::Build( const float4* vertexData, const int triangleCount )
+{
+	PROFILE_ZONE( "HostBVH::Build" );
+	Timer timer;
+	vertices.assign( vertexData, vertexData + triangleCount * 3 );
+	primBounds.resize( triangleCount );
+	UpdateTriangleBounds( 0, triangleCount );
+	BuildTree();
+	buildTime = timer.elapsed();
+}
+void HostBVH::Build( const aabb* bounds, const int count )
+{
+	Timer timer;
+	vertices.clear();
+	primBounds.assign( bounds, bounds + count );
+	BuildTree();
+	buildTime = timer.elapsed();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::Refit                                                             |
+//  |  Adapt the node bounds to moved primitives. The topology of the tree does   |
+//  |  not change, so its quality degrades if primitives move a lot; compare      |
+//  |  SAHCost against builtCost to decide when to rebuild.                 LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::Refit( const float4* vertexData, const int2* ranges, const int rangeCount )
+{
+	PROFILE_ZONE( "HostBVH::Refit" );
+	// ranges are (first, count) pairs of modified triangles
+	for (int i = 0; i < rangeCount; i++)
+	{
+		const int first = ranges[i].x, count = ranges[i].y;
+		memcpy( &vertices[first * 3], vertexData + first * 3, count * 3 * sizeof( float4 ) );
+		UpdateTriangleBounds( first, first + count );
+	}
+	RefitTree();
+}
+void HostBVH::Refit( const aabb* bounds )
+{
+	memcpy( primBounds.data(), bounds, primCount * sizeof( aabb ) );
+	RefitTree();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::UpdateTriangleBounds                                              |
+//  |  Calculate the bounds of a range of triangles.                        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::UpdateTriangleBounds( const int first, const int last )
+{
+	parallel_for( first, last, 4096, [&]( const int i ) {
+		const __m128 v0 = _mm_load_ps( &vertices[i * 3 + 0].x );
+		const __m128 v1 = _mm_load_ps( &vertices[i * 3 + 1].x );
+		const __m128 v2 = _mm_load_ps( &vertices[i * 3 + 2].x );
+		primBounds[i].bmin4 = _mm_min_ps( _mm_min_ps( v0, v1 ), v2 );
+		primBounds[i].bmax4 = _mm_max_ps( _mm_max_ps( v0, v1 ), v2 );
+	} );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::BuildTree                                                         |
+//  |  Build the tree over primBounds.                                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::BuildTree()
+{
+	primCount = (uint)primBounds.size();
+	primIdx.resize( primCount );
+	FREE64( nodes );
+	nodes = (BVHNode*)MALLOC64( max( 1u, primCount ) * 2 * sizeof( BVHNode ) );
+	nodesUsed = 0, builtCost = 0;
+	if (primCount == 0) return;
+	// bounds of the root, reduced per chunk
+	const int chunkSize = 16384, chunkCount = (primCount + chunkSize - 1) / chunkSize;
+	vector<aabb> chunkBounds( chunkCount );
+	parallel_for( 0, chunkCount, 1, [&]( const int chunk ) {
+		aabb& cb = chunkBounds[chunk];
+		cb.Reset();
+		for (uint i = chunk * chunkSize, e = min( primCount, i + chunkSize ); i < e; i++) cb.Grow( primBounds[i] ), primIdx[i] = i;
+	} );
+	aabb rootBounds;
+	rootBounds.Reset();
+	for (const aabb& b : chunkBounds) rootBounds.Grow( b );
+	BVHNode& root = nodes[0];
+	root.aabbMin = rootBounds.bmin3, root.aabbMax = rootBounds.bmax3;
+	root.leftFirst = 0, root.primCount = primCount;
+	BuildState state;
+	state.nodesUsed = 2; // node 1 stays unused; siblings start at even indices
+	Subdivide( 0, 0, state );
+	nodesUsed = state.nodesUsed;
+	builtCost = SAHCost();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::RefitTree                                                         |
+//  |  Recalculate the node bounds from primBounds. Children are always created   |
+//  |  after their parent, so a reverse sweep visits them first.            LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::RefitTree()
+{
+	for (int i = (int)nodesUsed - 1; i >= 0; i--) if (i != 1)
+	{
+		BVHNode& node = nodes[i];
+		aabb b;
+		if (node.IsLeaf())
+		{
+			b.Reset();
+			for (uint j = 0; j < node.primCount; j++) b.Grow( primBounds[primIdx[node.leftFirst + j]] );
+		}
+		else
+		{
+			const BVHNode& left = nodes[node.leftFirst], &right = nodes[node.leftFirst + 1];
+			b = aabb( fminf( left.aabbMin, right.aabbMin ), fmaxf( left.aabbMax, right.aabbMax ) );
+		}
+		node.aabbMin = b.bmin3, node.aabbMax = b.bmax3;
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::Subdivide                                                         |
+//  |  Split a node using binned SAH, and recurse into the children.        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::Subdivide( const uint nodeIdx, const int depth, BuildState& state )
+{
+	BVHNode& node = nodes[nodeIdx];
+	const uint first = node.leftFirst, count = node.primCount;
+	if (count == 1 || depth >= BVH_MAXDEPTH) return;
+	const aabb* bounds = primBounds.data();
+	// centroid bounds determine the bin boundaries
+	aabb cb;
+	cb.Reset();
+	for (uint i = first; i < first + count; i++) cb.Grow( bounds[primIdx[i]].Center() );
+	float scale[3];
+	for (int a = 0; a < 3; a++) scale[a] = cb.Extend( a ) > 0 ? BVH_BINS / cb.Extend( a ) : 0;
+	if (scale[0] == 0 && scale[1] == 0 && scale[2] == 0) return; // coinciding centroids; no split separates them
+	// populate the bins; large nodes use several jobs, each with its own set of bins
+	auto binRange = [&]( BVHBins& bins, const uint start, const uint end ) {
+		bins.Reset();
+		for (uint i = start; i < end; i++)
+		{
+			const aabb& b = bounds[primIdx[i]];
+			for (int a = 0; a < 3; a++) if (scale[a] > 0)
+			{
+				const int bin = BinIndex( b.Center( a ), cb.bmin[a], scale[a] );
+				bins.bounds[a][bin].Grow( b ), bins.count[a][bin]++;
+			}
+		}
+	};
+	BVHBins bins;
+	if (count < BVH_PARALLEL_BINS) binRange( bins, first, first + count ); else
+	{
+		const int jobs = (count + BVH_PARALLEL_BINS / 2 - 1) / (BVH_PARALLEL_BINS / 2);
+		vector<BVHBins> partial( jobs );
+		parallel_for( 0, jobs, 1, [&]( const int j ) {
+			binRange( partial[j], first + (uint)((uint64_t)count * j / jobs), first + (uint)((uint64_t)count * (j + 1) / jobs) );
+		} );
+		bins = partial[0];
+		for (int j = 1; j < jobs; j++) for (int a = 0; a < 3; a++) for (int i = 0; i < BVH_BINS; i++)
+			bins.bounds[a][i].Grow( partial[j].bounds[a][i] ), bins.count[a][i] += partial[j].count[a][i];
+	}
+	// sweep the bins from both sides; the split after bin i puts bins 0..i on the left
+	float bestCost = 1e34f;
+	int bestAxis = -1, bestSplit = 0;
+	uint bestLeftCount = 0;
+	aabb bestLeft, bestRight;
+	for (int a = 0; a < 3; a++) if (scale[a] > 0)
+	{
+		float leftArea[BVH_BINS - 1];
+		uint leftCount[BVH_BINS - 1];
+		aabb leftBox[BVH_BINS - 1], box;
+		box.Reset();
+		for (int i = 0, sum = 0; i < BVH_BINS - 1; i++)
+		{
+			sum += bins.count[a][i], box.Grow( bins.bounds[a][i] );
+			leftCount[i] = sum, leftArea[i] = box.Area(), leftBox[i] = box;
+		}
+		box.Reset();
+		for (int i = BVH_BINS - 1, sum = 0; i > 0; i--)
+		{
+			sum += bins.count[a][i], box.Grow( bins.bounds[a][i] );
+			if (leftCount[i - 1] == 0 || sum == 0) continue;
+			const float cost = leftCount[i - 1] * leftArea[i - 1] + sum * box.Area();
+			if (cost < bestCost) bestCost = cost, bestAxis = a, bestSplit = i - 1, bestLeftCount = leftCount[i - 1], bestLeft = leftBox[i - 1], bestRight = box;
+		}
+	}
+	// compare against the cost of a leaf: traversal and intersection cost are taken to be equal,
+	// so a split also pays for traversing the node itself
+	const float nodeArea = aabb( node.aabbMin, node.aabbMax ).Area();
+	const float splitCost = nodeArea + bestCost, leafCost = count * nodeArea;
+	if (bestAxis == -1 || (splitCost >= leafCost && count <= BVH_MAXLEAF)) return;
+	// partition the triangle indices in place
+	const float cmin = cb.bmin[bestAxis], s = scale[bestAxis];
+	uint i = first, j = first + count;
+	while (i < j)
+	{
+		if (BinIndex( bounds[primIdx[i]].Center( bestAxis ), cmin, s ) <= bestSplit) i++;
+		else Swap( primIdx[i], primIdx[--j] );
+	}
+	assert( i - first == bestLeftCount );
+	// create the children
+	const uint leftIdx = state.nodesUsed.fetch_add( 2 );
+	BVHNode& left = nodes[leftIdx], &right = nodes[leftIdx + 1];
+	left.aabbMin = bestLeft.bmin3, left.aabbMax = bestLeft.bmax3, left.leftFirst = first, left.primCount = bestLeftCount;
+	right.aabbMin = bestRight.bmin3, right.aabbMax = bestRight.bmax3, right.leftFirst = first + bestLeftCount, right.primCount = count - bestLeftCount;
+	node.leftFirst = leftIdx, node.primCount = 0;
+	// recurse; large subtrees are built concurrently
+	if (left.primCount >= BVH_PARALLEL_SPLIT && right.primCount >= BVH_PARALLEL_SPLIT)
+	{
+		JobCounter counter;
+		JobSystem::Run( [this, leftIdx, depth, &state]() { Subdivide( leftIdx, depth + 1, state ); }, &counter );
+		Subdivide( leftIdx + 1, depth + 1, state );
+		JobSystem::Wait( counter );
+	}
+	else
+	{
+		Subdivide( leftIdx, depth + 1, state );
+		Subdivide( leftIdx + 1, depth + 1, state );
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::SAHCost                                                           |
+//  |  Expected cost of a random ray that hits the root, with equal traversal     |
+//  |  and intersection costs. Lower is better.                             LH2'19|
+//  +-----------------------------------------------------------------------------+
+float HostBVH::SAHCost() const
+{
+	if (primCount == 0) return 0;
+	float cost = 0;
+	for (uint i = 0; i < nodesUsed; i++) if (i != 1)
+	{
+		const BVHNode& n = nodes[i];
+		cost += aabb( n.aabbMin, n.aabbMax ).Area() * (n.IsLeaf() ? n.primCount : 1);
+	}
+	return cost / aabb( nodes[0].aabbMin, nodes[0].aabbMax ).Area();
+}
+
+// slab test; returns the distance to the box, or 1e34f if the ray misses it or hits it beyond ray.t
+static inline float IntersectAABB( const HostRay& ray, const float3& rD, const BVHNode& node )
+{
+	const float tx1 = (node.aabbMin.x - ray.O.x) * rD.x, tx2 = (node.aabbMax.x - ray.O.x) * rD.x;
+	const float ty1 = (node.aabbMin.y - ray.O.y) * rD.y, ty2 = (node.aabbMax.y - ray.O.y) * rD.y;
+	const float tz1 = (node.aabbMin.z - ray.O.z) * rD.z, tz2 = (node.aabbMax.z - ray.O.z) * rD.z;
+	const float tmin = max( max( min( tx1, tx2 ), min( ty1, ty2 ) ), min( tz1, tz2 ) );
+	const float tmax = min( min( max( tx1, tx2 ), max( ty1, ty2 ) ), max( tz1, tz2 ) );
+	return (tmax >= tmin && tmin < ray.t && tmax > 0) ? tmin : 1e34f;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::IntersectTri                                                      |
+//  |  Moller-Trumbore ray/triangle intersection.                           LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::IntersectTri( HostRay& ray, const uint idx ) const
+{
+	const float3 v0 = make_float3( vertices[idx * 3 + 0] );
+	const float3 e1 = make_float3( vertices[idx * 3 + 1] ) - v0, e2 = make_float3( vertices[idx * 3 + 2] ) - v0;
+	const float3 h = cross( ray.D, e2 );
+	const float a = dot( e1, h );
+	if (fabs( a ) < 1e-12f) return; // ray parallel to triangle
+	const float f = 1 / a;
+	const float3 s = ray.O - v0;
+	const float u = f * dot( s, h );
+	if (u < 0 || u > 1) return;
+	const float3 q = cross( s, e1 );
+	const float v = f * dot( ray.D, q );
+	if (v < 0 || u + v > 1) return;
+	const float t = f * dot( e2, q );
+	if (t > 0 && t < ray.t) ray.t = t, ray.u = u, ray.v = v, ray.tri = idx;
+}
+
+// traversal helpers, shared by the bottom and top level: leaf( primIdx ) intersects a primitive and
+// updates the ray. Closest: children are visited front to back. Any: stops when leaf returns true.
+template <class F> static void TraverseClosest( const HostBVH& bvh, HostRay& ray, const F& leaf )
+{
+	if (bvh.primCount == 0) return;
+	const float3 rD = make_float3( 1 / ray.D.x, 1 / ray.D.y, 1 / ray.D.z );
+	if (IntersectAABB( ray, rD, bvh.nodes[0] ) == 1e34f) return;
+	const BVHNode* node = bvh.nodes, *stack[BVH_MAXDEPTH + 4];
+	uint stackPtr = 0;
+	while (1)
+	{
+		if (node->IsLeaf())
+		{
+			for (uint i = 0; i < node->primCount; i++) leaf( bvh.primIdx[node->leftFirst + i] );
+			if (stackPtr == 0) break;
+			node = stack[--stackPtr];
+			continue;
+		}
+		const BVHNode* child1 = &bvh.nodes[node->leftFirst], *child2 = child1 + 1;
+		float dist1 = IntersectAABB( ray, rD, *child1 ), dist2 = IntersectAABB( ray, rD, *child2 );
+		if (dist1 > dist2) Swap( dist1, dist2 ), Swap( child1, child2 );
+		if (dist1 == 1e34f)
+		{
+			if (stackPtr == 0) break;
+			node = stack[--stackPtr];
+		}
+		else
+		{
+			node = child1;
+			if (dist2 != 1e34f) stack[stackPtr++] = child2;
+		}
+	}
+}
+template <class F> static bool TraverseAny( const HostBVH& bvh, const HostRay& ray, const F& leaf )
+{
+	if (bvh.primCount == 0) return false;
+	const float3 rD = make_float3( 1 / ray.D.x, 1 / ray.D.y, 1 / ray.D.z );
+	const BVHNode* stack[BVH_MAXDEPTH + 4];
+	uint stackPtr = 0;
+	stack[stackPtr++] = bvh.nodes;
+	while (stackPtr > 0)
+	{
+		const BVHNode* node = stack[--stackPtr];
+		if (IntersectAABB( ray, rD, *node ) == 1e34f) continue;
+		if (!node->IsLeaf()) stack[stackPtr++] = &bvh.nodes[node->leftFirst], stack[stackPtr++] = &bvh.nodes[node->leftFirst + 1];
+		else for (uint i = 0; i < node->primCount; i++) if (leaf( bvh.primIdx[node->leftFirst + i] )) return true;
+	}
+	return false;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::Intersect                                                         |
+//  |  Find the nearest intersection closer than ray.t.                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::Intersect( HostRay& ray ) const
+{
+	TraverseClosest( *this, ray, [&]( const uint idx ) { IntersectTri( ray, idx ); } );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::IsOccluded                                                        |
+//  |  Check for any intersection closer than ray.t.                        LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool HostBVH::IsOccluded( const HostRay& ray ) const
+{
+	HostRay probe = ray;
+	probe.tri = -1; // the ray may carry the result of an earlier query
+	return TraverseAny( *this, ray, [&]( const uint idx ) { IntersectTri( probe, idx ); return probe.tri != -1; } );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::SetMesh                                                      |
+//  |  Build the BVH of a new or modified mesh.                             LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostSceneBVH::SetMesh( const int meshIdx, const HostMesh* mesh )
+{
+	SetMesh( meshIdx, mesh->vertices.data(), (int)mesh->triangles.size() );
+}
+void HostSceneBVH::SetMesh( const int meshIdx, const float4* vertexData, const int triangleCount )
+{
+	if (meshIdx >= meshes.size()) meshes.resize( meshIdx + 1, 0 );
+	if (!meshes[meshIdx]) meshes[meshIdx] = new HostBVH();
+	meshes[meshIdx]->Build( vertexData, triangleCount );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::RefitMesh                                                    |
+//  |  Update the BVH of a mesh of which only vertices changed, e.g. by           |
+//  |  HostMesh::SetPose. Rebuilds if refitting degraded the BVH too much.  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostSceneBVH::RefitMesh( const int meshIdx, const HostMesh* mesh, const int2* ranges, const int rangeCount )
+{
+	RefitMesh( meshIdx, mesh->vertices.data(), (int)mesh->triangles.size(), ranges, rangeCount );
+}
+void HostSceneBVH::RefitMesh( const int meshIdx, const float4* vertexData, const int triangleCount, const int2* ranges, const int rangeCount )
+{
+	HostBVH* bvh = meshIdx < meshes.size() ? meshes[meshIdx] : 0;
+	if (!bvh || bvh->primCount != triangleCount) { SetMesh( meshIdx, vertexData, triangleCount ); return; }
+	bvh->Refit( vertexData, ranges, rangeCount );
+	if (bvh->SAHCost() > bvh->builtCost * rebuildThreshold) bvh->Build( vertexData, triangleCount );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::SetInstances                                                 |
+//  |  Update the instance array; same arguments as CoreAPI_Base::SetInstances.   |
+//  |  Takes effect in the next UpdateToplevel call.                        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostSceneBVH::SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount )
+{
+	if (instances.size() != instanceCount) instances.resize( instanceCount ), rebuildToplevel = true;
+	for (int i = 0; i < rangeCount; i++) for (int j = dirtyRanges[i].x; j < dirtyRanges[i].x + dirtyRanges[i].y; j++)
+		SetInstance( j, meshIds[j], transforms[j] );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::SetInstance                                                  |
+//  |  Update a single instance; grows the instance array if needed. Takes        |
+//  |  effect in the next UpdateToplevel call.                              LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostSceneBVH::SetInstance( const int instanceIdx, const int meshIdx, const mat4& transform )
+{
+	if (instanceIdx >= instances.size()) instances.resize( instanceIdx + 1 ), rebuildToplevel = true;
+	Instance& instance = instances[instanceIdx];
+	if (instance.mesh != meshIdx) rebuildToplevel = true; // a different mesh may be anywhere
+	instance.mesh = meshIdx;
+	instance.transform = transform;
+	instance.inverse = transform.Inverted();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::UpdateToplevel                                               |
+//  |  Recalculate the world-space bounds of the instances, and rebuild or refit  |
+//  |  the top-level BVH. Refitting is used when instances and meshes only        |
+//  |  moved, as long as the SAH cost stays below rebuildThreshold times the cost |
+//  |  after the last rebuild.                                              LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostSceneBVH::UpdateToplevel()
+{
+	PROFILE_ZONE( "HostSceneBVH::UpdateToplevel" );
+	const int instanceCount = (int)instances.size();
+	instanceBounds.resize( instanceCount );
+	parallel_for( 0, instanceCount, 256, [&]( const int i ) {
+		const Instance& instance = instances[i];
+		const HostBVH* bvh = instance.mesh < meshes.size() ? meshes[instance.mesh] : 0;
+		const mat4& T = instance.transform;
+		aabb& b = instanceBounds[i];
+		if (!bvh || bvh->primCount == 0)
+		{
+			// empty mesh: a point, so the builder sees valid bounds
+			b = aabb( make_float3( T.cell[3], T.cell[7], T.cell[11] ), make_float3( T.cell[3], T.cell[7], T.cell[11] ) );
+			return;
+		}
+		// transformed corners of the mesh bounds
+		const aabb mb = bvh->Bounds();
+		b.Reset();
+		for (int c = 0; c < 8; c++) b.Grow( T * make_float3( mb.bmin[0] + (c & 1) * mb.Extend( 0 ), mb.bmin[1] + ((c >> 1) & 1) * mb.Extend( 1 ), mb.bmin[2] + (c >> 2) * mb.Extend( 2 ) ) );
+	} );
+	if (!rebuildToplevel)
+	{
+		toplevel.Refit( instanceBounds.data() );
+		refits++;
+		if (toplevel.SAHCost() <= toplevel.builtCost * rebuildThreshold) return;
+	}
+	toplevel.Build( instanceBounds.data(), instanceCount );
+	rebuildToplevel = false;
+	rebuilds++;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::Instance::ObjectSpaceRay                                     |
+//  |  Transform a world-space ray to the object space of the instance. The       |
+//  |  direction is not normalized: distances along the ray are unchanged.  LH2'19|
+//  +-----------------------------------------------------------------------------+
+HostRay HostSceneBVH::Instance::ObjectSpaceRay( const HostRay& ray ) const
+{
+	const float* m = inverse.cell;
+	const float3 O = make_float3( m[0] * ray.O.x + m[1] * ray.O.y + m[2] * ray.O.z + m[3],
+		m[4] * ray.O.x + m[5] * ray.O.y + m[6] * ray.O.z + m[7], m[8] * ray.O.x + m[9] * ray.O.y + m[10] * ray.O.z + m[11] );
+	const float3 D = make_float3( m[0] * ray.D.x + m[1] * ray.D.y + m[2] * ray.D.z,
+		m[4] * ray.D.x + m[5] * ray.D.y + m[6] * ray.D.z, m[8] * ray.D.x + m[9] * ray.D.y + m[10] * ray.D.z );
+	return HostRay( O, D, ray.t );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::Intersect                                                    |
+//  |  Find the nearest intersection closer than ray.t; reports the triangle and  |
+//  |  the instance.                                                        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostSceneBVH::Intersect( HostRay& ray ) const
+{
+	TraverseClosest( toplevel, ray, [&]( const uint idx ) {
+		const Instance& instance = instances[idx];
+		if (instance.mesh >= meshes.size() || !meshes[instance.mesh]) return; // mesh was never set
+		HostRay r = instance.ObjectSpaceRay( ray );
+		meshes[instance.mesh]->Intersect( r );
+		if (r.tri != -1) ray.t = r.t, ray.u = r.u, ray.v = r.v, ray.tri = r.tri, ray.inst = idx;
+	} );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::IsOccluded                                                   |
+//  |  Check for any intersection closer than ray.t.                        LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool HostSceneBVH::IsOccluded( const HostRay& ray ) const
+{
+	return TraverseAny( toplevel, ray, [&]( const uint idx ) {
+		const Instance& instance = instances[idx];
+		if (instance.mesh >= meshes.size() || !meshes[instance.mesh]) return false;
+		return meshes[instance.mesh]->IsOccluded( instance.ObjectSpaceRay( ray ) );
+	} );
+}
+
+// EOF
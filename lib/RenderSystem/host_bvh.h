@@ -0,0 +1,179 @@
+/* host_bvh.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   Host-side bounding volume hierarchies, for ray queries without a GPU
+   core: HostBVH over the triangles of a mesh, and HostSceneBVH, which
+   combines these with a top-level BVH over the instances of the scene.
+   The builder bins primitive centroids along all three axes and picks
+   the split with the lowest surface area heuristic cost; subtrees and
+   the binning of large nodes run on the job system.
+   Rays are traced one at a time, in packets of eight coherent rays, or
+   as streams of incoherent rays; the latter two use AVX2 when available
+   and are implemented in host_bvh_simd.cpp.
+*/
+
+#pragma once
+
+#define BVH_MAXDEPTH		60		// deeper nodes become leaves; keeps the traversal stacks small
+
+namespace lighthouse2
+{
+
+class HostMesh;
+
+//  +-----------------------------------------------------------------------------+
+//  |  BVHNode                                                                    |
+//  |  32 bytes; siblings are stored in pairs, so that the two children of a      |
+//  |  node share a single cache line.                                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct BVHNode
+{
+	float3 aabbMin; uint leftFirst;				// interior node: index of the left child, the right child follows it;
+	float3 aabbMax; uint primCount;				// leaf: first entry in HostBVH::primIdx and primitive count (0 for interior nodes)
+	bool IsLeaf() const { return primCount > 0; }
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostRay                                                                    |
+//  |  Ray and nearest intersection for the host-side BVHs.                 LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct HostRay
+{
+	HostRay() = default;
+	HostRay( const float3& origin, const float3& direction, const float tmax = 1e34f ) : O( origin ), t( tmax ), D( direction ) {}
+	float3 O; float t = 1e34f;					// origin; distance to the nearest intersection found so far
+	float3 D; int tri = -1;						// direction; triangle of the nearest intersection, or -1
+	float u = 0, v = 0;							// barycentrics of the nearest intersection
+	int inst = -1;								// instance of the nearest intersection (HostSceneBVH only)
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostRayPacket                                                              |
+//  |  Eight rays in SoA layout, traced together with AVX2. Suited for coherent   |
+//  |  rays, e.g. the primary rays of a small block of pixels, or shadow rays     |
+//  |  towards a single light. Lanes with t = 0 are inactive.               LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct HostRayPacket
+{
+	enum { SIZE = 8 };
+	void Set( const int lane, const HostRay& ray );
+	HostRay Get( const int lane ) const;
+	ALIGN( 32 ) float Ox[SIZE];
+	ALIGN( 32 ) float Oy[SIZE];
+	ALIGN( 32 ) float Oz[SIZE];
+	ALIGN( 32 ) float Dx[SIZE];
+	ALIGN( 32 ) float Dy[SIZE];
+	ALIGN( 32 ) float Dz[SIZE];
+	ALIGN( 32 ) float t[SIZE];
+	ALIGN( 32 ) float u[SIZE];
+	ALIGN( 32 ) float v[SIZE];
+	ALIGN( 32 ) int tri[SIZE];
+	ALIGN( 32 ) int inst[SIZE];
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH                                                                    |
+//  |  BVH over the triangles of a single mesh, or over a set of bounding boxes;  |
+//  |  the latter serves as the top level of a HostSceneBVH.                LH2'19|
+//  +-----------------------------------------------------------------------------+
+class HostBVH
+{
+public:
+	// constructor / destructor
+	HostBVH() = default;
+	HostBVH( const HostBVH& ) = delete;
+	~HostBVH() { FREE64( nodes ); }
+	// methods
+	void Build( const HostMesh* mesh );
+	void Build( const float4* vertexData, const int triangleCount );
+	void Build( const aabb* bounds, const int count );
+	void Refit( const float4* vertexData, const int2* ranges, const int rangeCount );
+	void Refit( const aabb* bounds );
+	void Intersect( HostRay& ray ) const;
+	bool IsOccluded( const HostRay& ray ) const;
+	void Intersect( HostRayPacket& packet ) const;
+	uint IsOccluded( const HostRayPacket& packet ) const;
+	void Intersect( HostRay* rays, const int count ) const;
+	void IsOccluded( const HostRay* rays, const int count, bool* occluded ) const;
+	float SAHCost() const;
+	aabb Bounds() const { return primCount ? aabb( nodes[0].aabbMin, nodes[0].aabbMax ) : aabb( make_float3( 1e34f ), make_float3( -1e34f ) ); }
+	static bool AVX2Supported();
+	// data members
+	vector<float4> vertices;					// copy of the vertex data, three per triangle; empty for a top-level BVH
+	vector<aabb> primBounds;					// bounds per primitive
+	vector<uint> primIdx;						// primitive indices, ordered by leaf
+	BVHNode* nodes = 0;							// node 0 is the root; node 1 is unused, to align the sibling pairs
+	uint nodesUsed = 0;							// including the unused node
+	uint primCount = 0;
+	float buildTime = 0;						// duration of the last build, in seconds
+	float builtCost = 0;						// SAHCost right after the last build
+private:
+	struct BuildState;
+	void UpdateTriangleBounds( const int first, const int last );
+	void BuildTree();
+	void RefitTree();
+	void Subdivide( const uint nodeIdx, const int depth, BuildState& state );
+	void IntersectTri( HostRay& ray, const uint idx ) const;
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH                                                               |
+//  |  Two-level acceleration structure: a HostBVH per mesh, and a top-level BVH  |
+//  |  over the instances. Fed with the same data as the cores: meshes via        |
+//  |  SetMesh / RefitMesh, the instance array via SetInstances, followed by      |
+//  |  UpdateToplevel.                                                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+class HostSceneBVH
+{
+public:
+	struct Instance
+	{
+		int mesh = -1;							// index in HostSceneBVH::meshes
+		mat4 transform;							// object to world
+		mat4 inverse;							// world to object
+		HostRay ObjectSpaceRay( const HostRay& ray ) const;
+	};
+	// constructor / destructor
+	HostSceneBVH() = default;
+	HostSceneBVH( const HostSceneBVH& ) = delete;
+	~HostSceneBVH() { for (HostBVH* bvh : meshes) delete bvh; }
+	// methods
+	void SetMesh( const int meshIdx, const HostMesh* mesh );
+	void SetMesh( const int meshIdx, const float4* vertexData, const int triangleCount );
+	void RefitMesh( const int meshIdx, const HostMesh* mesh, const int2* ranges, const int rangeCount );
+	void RefitMesh( const int meshIdx, const float4* vertexData, const int triangleCount, const int2* ranges, const int rangeCount );
+	void SetInstances( const int* meshIds, const mat4* transforms, const int instanceCount, const int2* dirtyRanges, const int rangeCount );
+	void SetInstance( const int instanceIdx, const int meshIdx, const mat4& transform );
+	void UpdateToplevel();
+	void Intersect( HostRay& ray ) const;
+	bool IsOccluded( const HostRay& ray ) const;
+	void Intersect( HostRayPacket& packet ) const;
+	uint IsOccluded( const HostRayPacket& packet ) const;
+	void Intersect( HostRay* rays, const int count ) const;
+	void IsOccluded( const HostRay* rays, const int count, bool* occluded ) const;
+	// data members
+	vector<HostBVH*> meshes;					// bottom level: one BVH per mesh
+	vector<Instance> instances;					// flattened instance array, as sent to the core
+	vector<aabb> instanceBounds;				// world-space bounds per instance
+	HostBVH toplevel;							// top level: BVH over instanceBounds
+	bool rebuildToplevel = true;				// the instance array changed size or content; refitting won't do
+	float rebuildThreshold = 1.5f;				// rebuild when refitting increased the SAH cost by this factor
+	uint rebuilds = 0, refits = 0;				// statistics: number of toplevel updates of either kind
+};
+
+} // namespace lighthouse2
+
+// EOF
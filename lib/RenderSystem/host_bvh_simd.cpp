@@ -0,0 +1,561 @@
+/* host_bvh_simd.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   Packet and stream traversal for the host-side BVHs, using AVX2.
+   A packet of eight rays shares a single traversal stack, and visits a
+   node if any of its rays hits it; this works well for coherent rays.
+   Stream traversal visits each node with the list of rays that hit it,
+   filtering the list eight rays at a time. This keeps the SIMD lanes
+   busy for incoherent rays, as long as the stream is large enough:
+   a few thousand rays per call is a good size.
+*/
+
+#include "rendersystem.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#define AVX2_FUNCTION
+#else
+#define __popcnt __builtin_popcount
+#define AVX2_FUNCTION __attribute__(( target( "avx2" ) ))
+#endif
+
+#define STREAM_CHUNK	256		// rays per batch, when a stream is passed on to the meshes of the instances
+#define STREAM_MIN		32		// smaller streams are traced one ray at a time
+
+static const bool avx2 = HostBVH::AVX2Supported();
+
+// eight rays in registers; rD is the reciprocal direction
+struct Packet8
+{
+	__m256 Ox, Oy, Oz, Dx, Dy, Dz, rDx, rDy, rDz, t, u, v;
+	__m256i tri, inst;
+};
+
+// SoA copy of a stream of rays; t is kept up to date during traversal, ids holds the ray lists of the nodes
+struct RayStream
+{
+	void Set( const HostRay* rays, const int count );
+	vector<float> O[3], D[3], rD[3], t;
+	vector<uint> ids;
+};
+
+void RayStream::Set( const HostRay* rays, const int count )
+{
+	for (int a = 0; a < 3; a++) O[a].resize( count ), D[a].resize( count ), rD[a].resize( count );
+	t.resize( count );
+	for (int i = 0; i < count; i++)
+	{
+		const HostRay& ray = rays[i];
+		O[0][i] = ray.O.x, O[1][i] = ray.O.y, O[2][i] = ray.O.z;
+		D[0][i] = ray.D.x, D[1][i] = ray.D.y, D[2][i] = ray.D.z;
+		rD[0][i] = 1 / ray.D.x, rD[1][i] = 1 / ray.D.y, rD[2][i] = 1 / ray.D.z;
+		t[i] = ray.t;
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::AVX2Supported                                                     |
+//  |  Check if the CPU and the OS support AVX2. Without it, packets and streams  |
+//  |  are traced one ray at a time.                                        LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool HostBVH::AVX2Supported()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid( info, 0 );
+	if (info[0] < 7) return false;
+	__cpuid( info, 1 );
+	if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false; // OSXSAVE, AVX
+	if ((_xgetbv( 0 ) & 6) != 6) return false; // OS saves the YMM registers
+	__cpuidex( info, 7, 0 );
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports( "avx2" );
+#endif
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostRayPacket::Set / Get                                                   |
+//  |  Conversion between a lane of the packet and a single ray.            LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostRayPacket::Set( const int lane, const HostRay& ray )
+{
+	Ox[lane] = ray.O.x, Oy[lane] = ray.O.y, Oz[lane] = ray.O.z;
+	Dx[lane] = ray.D.x, Dy[lane] = ray.D.y, Dz[lane] = ray.D.z;
+	t[lane] = ray.t, u[lane] = ray.u, v[lane] = ray.v, tri[lane] = ray.tri, inst[lane] = ray.inst;
+}
+HostRay HostRayPacket::Get( const int lane ) const
+{
+	HostRay ray( make_float3( Ox[lane], Oy[lane], Oz[lane] ), make_float3( Dx[lane], Dy[lane], Dz[lane] ), t[lane] );
+	ray.u = u[lane], ray.v = v[lane], ray.tri = tri[lane], ray.inst = inst[lane];
+	return ray;
+}
+
+// helpers for eight lanes
+AVX2_FUNCTION static inline __m256 Dot8( const __m256 ax, const __m256 ay, const __m256 az, const __m256 bx, const __m256 by, const __m256 bz )
+{
+	return _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ax, bx ), _mm256_mul_ps( ay, by ) ), _mm256_mul_ps( az, bz ) );
+}
+AVX2_FUNCTION static inline __m256i BlendInt8( const __m256i a, const __m256i b, const __m256 mask )
+{
+	return _mm256_castps_si256( _mm256_blendv_ps( _mm256_castsi256_ps( a ), _mm256_castsi256_ps( b ), mask ) );
+}
+AVX2_FUNCTION static inline void SetReciprocal( Packet8& p )
+{
+	const __m256 one = _mm256_set1_ps( 1 );
+	p.rDx = _mm256_div_ps( one, p.Dx ), p.rDy = _mm256_div_ps( one, p.Dy ), p.rDz = _mm256_div_ps( one, p.Dz );
+}
+
+// slab test for eight rays; returns the lanes that hit the node closer than their t, and the entry distances
+AVX2_FUNCTION static inline __m256 IntersectAABB8( const Packet8& p, const BVHNode& node, __m256& tnear )
+{
+	const __m256 tx1 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( node.aabbMin.x ), p.Ox ), p.rDx );
+	const __m256 tx2 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( node.aabbMax.x ), p.Ox ), p.rDx );
+	const __m256 ty1 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( node.aabbMin.y ), p.Oy ), p.rDy );
+	const __m256 ty2 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( node.aabbMax.y ), p.Oy ), p.rDy );
+	const __m256 tz1 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( node.aabbMin.z ), p.Oz ), p.rDz );
+	const __m256 tz2 = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( node.aabbMax.z ), p.Oz ), p.rDz );
+	const __m256 tmin = _mm256_max_ps( _mm256_max_ps( _mm256_min_ps( tx1, tx2 ), _mm256_min_ps( ty1, ty2 ) ), _mm256_min_ps( tz1, tz2 ) );
+	const __m256 tmax = _mm256_min_ps( _mm256_min_ps( _mm256_max_ps( tx1, tx2 ), _mm256_max_ps( ty1, ty2 ) ), _mm256_max_ps( tz1, tz2 ) );
+	tnear = _mm256_max_ps( tmin, _mm256_setzero_ps() );
+	return _mm256_and_ps( _mm256_cmp_ps( tnear, tmax, _CMP_LE_OQ ), _mm256_cmp_ps( tnear, p.t, _CMP_LT_OQ ) );
+}
+
+// Moller-Trumbore for eight rays and one triangle; returns the lanes with a hit closer than their t
+AVX2_FUNCTION static inline __m256 IntersectTri8( const Packet8& p, const float4* vert, __m256& t, __m256& u, __m256& v )
+{
+	const float3 v0 = make_float3( vert[0] ), e1 = make_float3( vert[1] ) - v0, e2 = make_float3( vert[2] ) - v0;
+	const __m256 e1x = _mm256_set1_ps( e1.x ), e1y = _mm256_set1_ps( e1.y ), e1z = _mm256_set1_ps( e1.z );
+	const __m256 e2x = _mm256_set1_ps( e2.x ), e2y = _mm256_set1_ps( e2.y ), e2z = _mm256_set1_ps( e2.z );
+	const __m256 hx = _mm256_sub_ps( _mm256_mul_ps( p.Dy, e2z ), _mm256_mul_ps( p.Dz, e2y ) );
+	const __m256 hy = _mm256_sub_ps( _mm256_mul_ps( p.Dz, e2x ), _mm256_mul_ps( p.Dx, e2z ) );
+	const __m256 hz = _mm256_sub_ps( _mm256_mul_ps( p.Dx, e2y ), _mm256_mul_ps( p.Dy, e2x ) );
+	const __m256 a = Dot8( e1x, e1y, e1z, hx, hy, hz );
+	const __m256 f = _mm256_div_ps( _mm256_set1_ps( 1 ), a );
+	const __m256 sx = _mm256_sub_ps( p.Ox, _mm256_set1_ps( v0.x ) );
+	const __m256 sy = _mm256_sub_ps( p.Oy, _mm256_set1_ps( v0.y ) );
+	const __m256 sz = _mm256_sub_ps( p.Oz, _mm256_set1_ps( v0.z ) );
+	u = _mm256_mul_ps( f, Dot8( sx, sy, sz, hx, hy, hz ) );
+	const __m256 qx = _mm256_sub_ps( _mm256_mul_ps( sy, e1z ), _mm256_mul_ps( sz, e1y ) );
+	const __m256 qy = _mm256_sub_ps( _mm256_mul_ps( sz, e1x ), _mm256_mul_ps( sx, e1z ) );
+	const __m256 qz = _mm256_sub_ps( _mm256_mul_ps( sx, e1y ), _mm256_mul_ps( sy, e1x ) );
+	v = _mm256_mul_ps( f, Dot8( p.Dx, p.Dy, p.Dz, qx, qy, qz ) );
+	t = _mm256_mul_ps( f, Dot8( e2x, e2y, e2z, qx, qy, qz ) );
+	const __m256 zero = _mm256_setzero_ps();
+	__m256 hit = _mm256_cmp_ps( _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), a ), _mm256_set1_ps( 1e-12f ), _CMP_GE_OQ ); // not parallel
+	hit = _mm256_and_ps( hit, _mm256_and_ps( _mm256_cmp_ps( u, zero, _CMP_GE_OQ ), _mm256_cmp_ps( v, zero, _CMP_GE_OQ ) ) );
+	hit = _mm256_and_ps( hit, _mm256_cmp_ps( _mm256_add_ps( u, v ), _mm256_set1_ps( 1 ), _CMP_LE_OQ ) );
+	return _mm256_and_ps( hit, _mm256_and_ps( _mm256_cmp_ps( t, zero, _CMP_GT_OQ ), _mm256_cmp_ps( t, p.t, _CMP_LT_OQ ) ) );
+}
+
+// nearest entry distance over the lanes in mask; used to order the children of a node
+AVX2_FUNCTION static inline float NearestLane( const __m256 tnear, const __m256 mask )
+{
+	const __m256 d = _mm256_blendv_ps( _mm256_set1_ps( 1e34f ), tnear, mask );
+	__m128 m = _mm_min_ps( _mm256_castps256_ps128( d ), _mm256_extractf128_ps( d, 1 ) );
+	m = _mm_min_ps( m, _mm_movehl_ps( m, m ) );
+	return _mm_cvtss_f32( _mm_min_ss( m, _mm_shuffle_ps( m, m, 1 ) ) );
+}
+
+// the rays of a packet in the object space of an instance; distances along the rays are unchanged
+AVX2_FUNCTION static inline __m256 TransformRow8( const float* m, const __m256 x, const __m256 y, const __m256 z, const float w )
+{
+	return _mm256_add_ps( Dot8( _mm256_set1_ps( m[0] ), _mm256_set1_ps( m[1] ), _mm256_set1_ps( m[2] ), x, y, z ), _mm256_set1_ps( m[3] * w ) );
+}
+AVX2_FUNCTION static void ObjectSpacePacket( const Packet8& p, const mat4& M, Packet8& q )
+{
+	const float* m = M.cell;
+	q.Ox = TransformRow8( m, p.Ox, p.Oy, p.Oz, 1 ), q.Oy = TransformRow8( m + 4, p.Ox, p.Oy, p.Oz, 1 ), q.Oz = TransformRow8( m + 8, p.Ox, p.Oy, p.Oz, 1 );
+	q.Dx = TransformRow8( m, p.Dx, p.Dy, p.Dz, 0 ), q.Dy = TransformRow8( m + 4, p.Dx, p.Dy, p.Dz, 0 ), q.Dz = TransformRow8( m + 8, p.Dx, p.Dy, p.Dz, 0 );
+	SetReciprocal( q );
+	q.t = p.t, q.u = q.v = _mm256_setzero_ps(), q.tri = _mm256_set1_epi32( -1 ), q.inst = p.inst;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  IntersectPacket / OccludedPacket                                           |
+//  |  Packet traversal. The leaves of a mesh BVH hold triangles; those of the    |
+//  |  top-level BVH of scene hold instances, which continue the traversal in     |
+//  |  the BVH of their mesh. Children are visited in the order in which the      |
+//  |  nearest ray of the packet enters them.                               LH2'19|
+//  +-----------------------------------------------------------------------------+
+AVX2_FUNCTION static void IntersectInstance8( const HostSceneBVH& scene, const uint idx, Packet8& p );
+AVX2_FUNCTION static __m256 OccludedInstance8( const HostSceneBVH& scene, const uint idx, const Packet8& p );
+AVX2_FUNCTION static void IntersectPacket( const HostBVH& bvh, const HostSceneBVH* scene, Packet8& p )
+{
+	if (bvh.primCount == 0) return;
+	__m256 near1, near2;
+	if (!_mm256_movemask_ps( IntersectAABB8( p, bvh.nodes[0], near1 ) )) return;
+	const BVHNode* node = bvh.nodes, *stack[BVH_MAXDEPTH + 4];
+	uint stackPtr = 0;
+	while (1)
+	{
+		if (node->IsLeaf())
+		{
+			for (uint i = 0; i < node->primCount; i++)
+			{
+				const uint idx = bvh.primIdx[node->leftFirst + i];
+				if (scene) { IntersectInstance8( *scene, idx, p ); continue; }
+				__m256 t, u, v;
+				const __m256 hit = IntersectTri8( p, &bvh.vertices[idx * 3], t, u, v );
+				p.t = _mm256_blendv_ps( p.t, t, hit ), p.u = _mm256_blendv_ps( p.u, u, hit ), p.v = _mm256_blendv_ps( p.v, v, hit );
+				p.tri = BlendInt8( p.tri, _mm256_set1_epi32( idx ), hit );
+			}
+			if (stackPtr == 0) break;
+			node = stack[--stackPtr];
+			continue;
+		}
+		const BVHNode* child1 = &bvh.nodes[node->leftFirst], *child2 = child1 + 1;
+		const __m256 hit1 = IntersectAABB8( p, *child1, near1 ), hit2 = IntersectAABB8( p, *child2, near2 );
+		const int mask1 = _mm256_movemask_ps( hit1 ), mask2 = _mm256_movemask_ps( hit2 );
+		if (mask1 && mask2)
+		{
+			if (NearestLane( near2, hit2 ) < NearestLane( near1, hit1 )) Swap( child1, child2 );
+			node = child1, stack[stackPtr++] = child2;
+		}
+		else if (mask1) node = child1;
+		else if (mask2) node = child2;
+		else if (stackPtr == 0) break;
+		else node = stack[--stackPtr];
+	}
+}
+AVX2_FUNCTION static __m256 OccludedPacket( const HostBVH& bvh, const HostSceneBVH* scene, Packet8 p )
+{
+	__m256 occluded = _mm256_setzero_ps();
+	if (bvh.primCount == 0) return occluded;
+	const BVHNode* stack[BVH_MAXDEPTH + 4];
+	uint stackPtr = 0;
+	stack[stackPtr++] = bvh.nodes;
+	while (stackPtr > 0)
+	{
+		const BVHNode* node = stack[--stackPtr];
+		__m256 tnear;
+		if (!_mm256_movemask_ps( IntersectAABB8( p, *node, tnear ) )) continue;
+		if (!node->IsLeaf())
+		{
+			stack[stackPtr++] = &bvh.nodes[node->leftFirst + 1];
+			stack[stackPtr++] = &bvh.nodes[node->leftFirst];
+			continue;
+		}
+		for (uint i = 0; i < node->primCount; i++)
+		{
+			const uint idx = bvh.primIdx[node->leftFirst + i];
+			__m256 t, u, v;
+			occluded = _mm256_or_ps( occluded, scene ? OccludedInstance8( *scene, idx, p ) : IntersectTri8( p, &bvh.vertices[idx * 3], t, u, v ) );
+			p.t = _mm256_andnot_ps( occluded, p.t ); // occluded lanes become inactive
+		}
+		if (!_mm256_movemask_ps( _mm256_cmp_ps( p.t, _mm256_setzero_ps(), _CMP_GT_OQ ) )) break; // all lanes done
+	}
+	return occluded;
+}
+AVX2_FUNCTION static void IntersectInstance8( const HostSceneBVH& scene, const uint idx, Packet8& p )
+{
+	const HostSceneBVH::Instance& instance = scene.instances[idx];
+	if (instance.mesh >= scene.meshes.size() || !scene.meshes[instance.mesh]) return; // mesh was never set
+	Packet8 q;
+	ObjectSpacePacket( p, instance.inverse, q );
+	IntersectPacket( *scene.meshes[instance.mesh], 0, q );
+	const __m256 hit = _mm256_cmp_ps( q.t, p.t, _CMP_LT_OQ );
+	p.t = _mm256_blendv_ps( p.t, q.t, hit ), p.u = _mm256_blendv_ps( p.u, q.u, hit ), p.v = _mm256_blendv_ps( p.v, q.v, hit );
+	p.tri = BlendInt8( p.tri, q.tri, hit ), p.inst = BlendInt8( p.inst, _mm256_set1_epi32( idx ), hit );
+}
+AVX2_FUNCTION static __m256 OccludedInstance8( const HostSceneBVH& scene, const uint idx, const Packet8& p )
+{
+	const HostSceneBVH::Instance& instance = scene.instances[idx];
+	if (instance.mesh >= scene.meshes.size() || !scene.meshes[instance.mesh]) return _mm256_setzero_ps();
+	Packet8 q;
+	ObjectSpacePacket( p, instance.inverse, q );
+	return OccludedPacket( *scene.meshes[instance.mesh], 0, q );
+}
+// unaligned loads and stores: a vector<HostRayPacket> is not guaranteed to be 32-byte aligned
+AVX2_FUNCTION static void IntersectPacket( const HostBVH& bvh, const HostSceneBVH* scene, HostRayPacket& packet )
+{
+	Packet8 p;
+	p.Ox = _mm256_loadu_ps( packet.Ox ), p.Oy = _mm256_loadu_ps( packet.Oy ), p.Oz = _mm256_loadu_ps( packet.Oz );
+	p.Dx = _mm256_loadu_ps( packet.Dx ), p.Dy = _mm256_loadu_ps( packet.Dy ), p.Dz = _mm256_loadu_ps( packet.Dz );
+	p.t = _mm256_loadu_ps( packet.t ), p.u = _mm256_loadu_ps( packet.u ), p.v = _mm256_loadu_ps( packet.v );
+	p.tri = _mm256_loadu_si256( (const __m256i*)packet.tri ), p.inst = _mm256_loadu_si256( (const __m256i*)packet.inst );
+	SetReciprocal( p );
+	IntersectPacket( bvh, scene, p );
+	_mm256_storeu_ps( packet.t, p.t ), _mm256_storeu_ps( packet.u, p.u ), _mm256_storeu_ps( packet.v, p.v );
+	_mm256_storeu_si256( (__m256i*)packet.tri, p.tri ), _mm256_storeu_si256( (__m256i*)packet.inst, p.inst );
+}
+AVX2_FUNCTION static uint OccludedPacket( const HostBVH& bvh, const HostSceneBVH* scene, const HostRayPacket& packet )
+{
+	Packet8 p;
+	p.Ox = _mm256_loadu_ps( packet.Ox ), p.Oy = _mm256_loadu_ps( packet.Oy ), p.Oz = _mm256_loadu_ps( packet.Oz );
+	p.Dx = _mm256_loadu_ps( packet.Dx ), p.Dy = _mm256_loadu_ps( packet.Dy ), p.Dz = _mm256_loadu_ps( packet.Dz );
+	p.t = _mm256_max_ps( _mm256_loadu_ps( packet.t ), _mm256_setzero_ps() );
+	SetReciprocal( p );
+	return (uint)_mm256_movemask_ps( OccludedPacket( bvh, scene, p ) );
+}
+
+// load eight rays of a stream (n <= 8); returns the mask of valid lanes
+AVX2_FUNCTION static inline int GatherRays( const RayStream& s, const uint* ids, const int n, const bool directions, Packet8& p )
+{
+	const __m256i lanes = _mm256_cmpgt_epi32( _mm256_set1_epi32( n ), _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ) );
+	const __m256i idx = _mm256_maskload_epi32( (const int*)ids, lanes ); // invalid lanes load ray 0
+	p.Ox = _mm256_i32gather_ps( s.O[0].data(), idx, 4 ), p.Oy = _mm256_i32gather_ps( s.O[1].data(), idx, 4 ), p.Oz = _mm256_i32gather_ps( s.O[2].data(), idx, 4 );
+	p.rDx = _mm256_i32gather_ps( s.rD[0].data(), idx, 4 ), p.rDy = _mm256_i32gather_ps( s.rD[1].data(), idx, 4 ), p.rDz = _mm256_i32gather_ps( s.rD[2].data(), idx, 4 );
+	p.t = _mm256_i32gather_ps( s.t.data(), idx, 4 );
+	if (directions) p.Dx = _mm256_i32gather_ps( s.D[0].data(), idx, 4 ), p.Dy = _mm256_i32gather_ps( s.D[1].data(), idx, 4 ), p.Dz = _mm256_i32gather_ps( s.D[2].data(), idx, 4 );
+	return (1 << n) - 1;
+}
+
+// distribute a list of rays over the children of a node; returns the number of rays that hit both children
+// and enter child1 first, minus the number that enter child2 first
+AVX2_FUNCTION static int SplitStream( const RayStream& s, const uint* ids, const int count, const BVHNode& child1, const BVHNode& child2, uint* list1, int& count1, uint* list2, int& count2 )
+{
+	int votes = 0;
+	count1 = count2 = 0;
+	for (int i = 0; i < count; i += 8)
+	{
+		const int n = min( 8, count - i );
+		Packet8 p;
+		const int valid = GatherRays( s, ids + i, n, false, p );
+		__m256 near1, near2;
+		const int mask1 = _mm256_movemask_ps( IntersectAABB8( p, child1, near1 ) ) & valid;
+		const int mask2 = _mm256_movemask_ps( IntersectAABB8( p, child2, near2 ) ) & valid;
+		const int first = _mm256_movemask_ps( _mm256_cmp_ps( near1, near2, _CMP_LE_OQ ) ) & mask1 & mask2;
+		votes += 2 * (int)__popcnt( first ) - (int)__popcnt( mask1 & mask2 );
+		for (int lane = 0; lane < n; lane++)
+		{
+			if (mask1 & (1 << lane)) list1[count1++] = ids[i + lane];
+			if (mask2 & (1 << lane)) list2[count2++] = ids[i + lane];
+		}
+	}
+	return votes;
+}
+
+// intersect a list of rays with the triangles of a leaf, eight rays at a time
+AVX2_FUNCTION static void IntersectLeaf( const HostBVH& bvh, const BVHNode& leaf, RayStream& s, const uint* ids, const int count, HostRay* rays )
+{
+	for (int i = 0; i < count; i += 8)
+	{
+		const int n = min( 8, count - i );
+		Packet8 p;
+		const int valid = GatherRays( s, ids + i, n, true, p );
+		const __m256 t0 = p.t;
+		p.u = p.v = _mm256_setzero_ps(), p.tri = _mm256_set1_epi32( -1 );
+		for (uint j = 0; j < leaf.primCount; j++)
+		{
+			const uint idx = bvh.primIdx[leaf.leftFirst + j];
+			__m256 t, u, v;
+			const __m256 hit = IntersectTri8( p, &bvh.vertices[idx * 3], t, u, v );
+			p.t = _mm256_blendv_ps( p.t, t, hit ), p.u = _mm256_blendv_ps( p.u, u, hit ), p.v = _mm256_blendv_ps( p.v, v, hit );
+			p.tri = BlendInt8( p.tri, _mm256_set1_epi32( idx ), hit );
+		}
+		const int hit = _mm256_movemask_ps( _mm256_cmp_ps( p.t, t0, _CMP_LT_OQ ) ) & valid;
+		if (!hit) continue;
+		ALIGN( 32 ) float t[8];
+		ALIGN( 32 ) float u[8];
+		ALIGN( 32 ) float v[8];
+		ALIGN( 32 ) int tri[8];
+		_mm256_store_ps( t, p.t ), _mm256_store_ps( u, p.u ), _mm256_store_ps( v, p.v ), _mm256_store_si256( (__m256i*)tri, p.tri );
+		for (int lane = 0; lane < n; lane++) if (hit & (1 << lane))
+		{
+			HostRay& ray = rays[ids[i + lane]];
+			s.t[ids[i + lane]] = ray.t = t[lane], ray.u = u[lane], ray.v = v[lane], ray.tri = tri[lane];
+		}
+	}
+}
+
+// check a list of rays for occlusion by the triangles of a leaf; occluded rays leave the stream
+AVX2_FUNCTION static void OccludedLeaf( const HostBVH& bvh, const BVHNode& leaf, RayStream& s, const uint* ids, const int count, bool* occluded )
+{
+	for (int i = 0; i < count; i += 8)
+	{
+		const int n = min( 8, count - i );
+		Packet8 p;
+		const int valid = GatherRays( s, ids + i, n, true, p );
+		__m256 hits = _mm256_setzero_ps();
+		for (uint j = 0; j < leaf.primCount; j++)
+		{
+			__m256 t, u, v;
+			hits = _mm256_or_ps( hits, IntersectTri8( p, &bvh.vertices[bvh.primIdx[leaf.leftFirst + j] * 3], t, u, v ) );
+			p.t = _mm256_andnot_ps( hits, p.t );
+		}
+		const int hit = _mm256_movemask_ps( hits ) & valid;
+		for (int lane = 0; lane < n; lane++) if (hit & (1 << lane)) occluded[ids[i + lane]] = true, s.t[ids[i + lane]] = 0;
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  TraverseStream                                                             |
+//  |  Stream traversal: each node is visited with the list of rays that hit it.  |
+//  |  The list of an interior node is split over its children; the child that    |
+//  |  most rays enter first is visited first. leaf( node, ids, count ) handles   |
+//  |  the rays that reach a leaf. The lists are stored in s.ids.           LH2'19|
+//  +-----------------------------------------------------------------------------+
+template <class F> static void TraverseStream( const HostBVH& bvh, RayStream& s, const int count, const F& leaf )
+{
+	if (bvh.primCount == 0 || count == 0) return;
+	struct Entry { const BVHNode* node; uint first, count; };
+	Entry stack[BVH_MAXDEPTH + 4];
+	vector<uint>& ids = s.ids;
+	ids.resize( count );
+	for (int i = 0; i < count; i++) ids[i] = i;
+	uint stackPtr = 0;
+	stack[stackPtr++] = { bvh.nodes, 0, (uint)count };
+	while (stackPtr > 0)
+	{
+		const Entry e = stack[--stackPtr];
+		if (e.node->IsLeaf()) { leaf( *e.node, &ids[e.first], (int)e.count ); continue; }
+		// the lists of the children go after those of the entries that are still on the stack
+		uint base = e.first + e.count;
+		if (stackPtr > 0) base = max( base, stack[stackPtr - 1].first + stack[stackPtr - 1].count );
+		ids.resize( base + 2 * e.count );
+		const BVHNode* child = &bvh.nodes[e.node->leftFirst];
+		int count1, count2;
+		const int votes = SplitStream( s, &ids[e.first], (int)e.count, child[0], child[1], &ids[base], count1, &ids[base + e.count], count2 );
+		Entry nearChild = { child, base, (uint)count1 }, farChild = { child + 1, base + e.count, (uint)count2 };
+		if (votes < 0) Swap( nearChild, farChild );
+		if (farChild.count > 0) stack[stackPtr++] = farChild;
+		if (nearChild.count > 0) stack[stackPtr++] = nearChild;
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostBVH::Intersect / IsOccluded                                            |
+//  |  Packet and stream versions. IsOccluded for a packet returns a bitmask of   |
+//  |  the occluded lanes; for a stream, it fills one bool per ray.         LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostBVH::Intersect( HostRayPacket& packet ) const
+{
+	if (avx2) { IntersectPacket( *this, 0, packet ); return; }
+	for (int i = 0; i < HostRayPacket::SIZE; i++) if (packet.t[i] > 0)
+	{
+		HostRay ray = packet.Get( i );
+		Intersect( ray );
+		packet.Set( i, ray );
+	}
+}
+uint HostBVH::IsOccluded( const HostRayPacket& packet ) const
+{
+	if (avx2) return OccludedPacket( *this, 0, packet );
+	uint mask = 0;
+	for (int i = 0; i < HostRayPacket::SIZE; i++) if (packet.t[i] > 0 && IsOccluded( packet.Get( i ) )) mask |= 1 << i;
+	return mask;
+}
+void HostBVH::Intersect( HostRay* rays, const int count ) const
+{
+	if (!avx2 || count < STREAM_MIN) { for (int i = 0; i < count; i++) Intersect( rays[i] ); return; }
+	static thread_local RayStream s;
+	s.Set( rays, count );
+	TraverseStream( *this, s, count, [&]( const BVHNode& leaf, const uint* ids, const int n ) { IntersectLeaf( *this, leaf, s, ids, n, rays ); } );
+}
+void HostBVH::IsOccluded( const HostRay* rays, const int count, bool* occluded ) const
+{
+	if (!avx2 || count < STREAM_MIN) { for (int i = 0; i < count; i++) occluded[i] = IsOccluded( rays[i] ); return; }
+	memset( occluded, 0, count * sizeof( bool ) );
+	static thread_local RayStream s;
+	s.Set( rays, count );
+	for (int i = 0; i < count; i++) s.t[i] = max( s.t[i], 0.0f );
+	TraverseStream( *this, s, count, [&]( const BVHNode& leaf, const uint* ids, const int n ) { OccludedLeaf( *this, leaf, s, ids, n, occluded ); } );
+}
+
+// slab test for a ray of a stream and the world-space bounds of an instance
+static inline bool HitsBounds( const RayStream& s, const uint id, const aabb& bounds )
+{
+	float tmin = 0, tmax = s.t[id];
+	for (int a = 0; a < 3; a++)
+	{
+		const float t1 = (bounds.bmin[a] - s.O[a][id]) * s.rD[a][id], t2 = (bounds.bmax[a] - s.O[a][id]) * s.rD[a][id];
+		tmin = max( tmin, min( t1, t2 ) ), tmax = min( tmax, max( t1, t2 ) );
+	}
+	return tmin <= tmax && tmin < s.t[id];
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostSceneBVH::Intersect / IsOccluded                                       |
+//  |  Packet and stream versions. The rays of a stream that hit an instance      |
+//  |  continue in the BVH of its mesh, in chunks of STREAM_CHUNK rays.     LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostSceneBVH::Intersect( HostRayPacket& packet ) const
+{
+	if (avx2) { IntersectPacket( toplevel, this, packet ); return; }
+	for (int i = 0; i < HostRayPacket::SIZE; i++) if (packet.t[i] > 0)
+	{
+		HostRay ray = packet.Get( i );
+		Intersect( ray );
+		packet.Set( i, ray );
+	}
+}
+uint HostSceneBVH::IsOccluded( const HostRayPacket& packet ) const
+{
+	if (avx2) return OccludedPacket( toplevel, this, packet );
+	uint mask = 0;
+	for (int i = 0; i < HostRayPacket::SIZE; i++) if (packet.t[i] > 0 && IsOccluded( packet.Get( i ) )) mask |= 1 << i;
+	return mask;
+}
+void HostSceneBVH::Intersect( HostRay* rays, const int count ) const
+{
+	if (!avx2 || count < STREAM_MIN) { for (int i = 0; i < count; i++) Intersect( rays[i] ); return; }
+	static thread_local RayStream s;
+	s.Set( rays, count );
+	TraverseStream( toplevel, s, count, [&]( const BVHNode& leaf, const uint* ids, const int n ) {
+		for (uint j = 0; j < leaf.primCount; j++)
+		{
+			const uint idx = toplevel.primIdx[leaf.leftFirst + j];
+			const Instance& instance = instances[idx];
+			if (instance.mesh >= meshes.size() || !meshes[instance.mesh]) continue; // mesh was never set
+			// rays that hit the bounds of the instance continue in object space, in chunks
+			HostRay local[STREAM_CHUNK];
+			int chunk = 0, localIds[STREAM_CHUNK];
+			for (int k = 0; k <= n; k++)
+			{
+				if (k < n && HitsBounds( s, ids[k], instanceBounds[idx] )) localIds[chunk] = ids[k], local[chunk++] = instance.ObjectSpaceRay( rays[ids[k]] );
+				if (k < n && chunk < STREAM_CHUNK) continue;
+				meshes[instance.mesh]->Intersect( local, chunk );
+				for (int i = 0; i < chunk; i++) if (local[i].tri != -1)
+				{
+					HostRay& ray = rays[localIds[i]];
+					s.t[localIds[i]] = ray.t = local[i].t, ray.u = local[i].u, ray.v = local[i].v, ray.tri = local[i].tri, ray.inst = idx;
+				}
+				chunk = 0;
+			}
+		}
+	} );
+}
+void HostSceneBVH::IsOccluded( const HostRay* rays, const int count, bool* occluded ) const
+{
+	if (!avx2 || count < STREAM_MIN) { for (int i = 0; i < count; i++) occluded[i] = IsOccluded( rays[i] ); return; }
+	memset( occluded, 0, count * sizeof( bool ) );
+	static thread_local RayStream s;
+	s.Set( rays, count );
+	for (int i = 0; i < count; i++) s.t[i] = max( s.t[i], 0.0f );
+	TraverseStream( toplevel, s, count, [&]( const BVHNode& leaf, const uint* ids, const int n ) {
+		for (uint j = 0; j < leaf.primCount; j++)
+		{
+			const uint idx = toplevel.primIdx[leaf.leftFirst + j];
+			const Instance& instance = instances[idx];
+			if (instance.mesh >= meshes.size() || !meshes[instance.mesh]) continue;
+			HostRay local[STREAM_CHUNK];
+			bool localOccluded[STREAM_CHUNK];
+			int chunk = 0, localIds[STREAM_CHUNK];
+			for (int k = 0; k <= n; k++)
+			{
+				if (k < n && HitsBounds( s, ids[k], instanceBounds[idx] )) localIds[chunk] = ids[k], local[chunk++] = instance.ObjectSpaceRay( rays[ids[k]] );
+				if (k < n && chunk < STREAM_CHUNK) continue;
+				meshes[instance.mesh]->IsOccluded( local, chunk, localOccluded );
+				for (int i = 0; i < chunk; i++) if (localOccluded[i]) occluded[localIds[i]] = true, s.t[localIds[i]] = 0;
+				chunk = 0;
+			}
+		}
+	} );
+}
+
+// EOF
@@ -50,6 +50,7 @@ void HostMaterial::ConvertFrom( const tinyobjMaterial& original )
 	{
 		map[NORMALMAP0].textureID = HostScene::FindOrCreateTexture( original.normal_texname, HostTexture::FLIPPED );
 		HostScene::textures[map[NORMALMAP0].textureID]->flags |= HostTexture::NORMALMAP; // TODO: what if it's also used as regular texture?
+		HostScene::textures[map[NORMALMAP0].textureID]->MarkAsDirty(); // texture may have been synchronized already
 	}
 	else if (original.bump_texname != "")
 	{
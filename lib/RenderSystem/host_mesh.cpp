@@ -134,7 +134,7 @@ void HostMesh::LoadGeometryFromOBJ( const string& fileName, const char* director
 	tinyobj::attrib_t attrib;
 	vector<tinyobj::shape_t> shapes;
 	vector<tinyobj::material_t> materials;
-	map<string, GLuint> textures;
+	map<string, uint> textures;
 	string err;
 	Timer timer;
 	timer.reset();
@@ -635,17 +635,35 @@ void HostMesh::UpdateAlphaFlags()
 //  +-----------------------------------------------------------------------------+
 void HostMesh::SetPose( const vector<float>& weights )
 {
+	PROFILE_ZONE( "HostMesh::SetPose (morph)" );
 	assert( weights.size() == poses.size() - 1 /* first pose is base pose */ );
 	const int weightCount = (int)weights.size();
-	// adjust intersection geometry data
-	for (int s = (int)vertices.size(), i = 0; i < s; i++)
+	// the first call poses all triangles; after that, only triangles affected by the morph targets change
+	vector<int2> allTriangles;
+	const vector<int2>& ranges = morphTriangles.size() > 0 ? morphTriangles : allTriangles;
+	if (morphTriangles.size() == 0)
 	{
-		vertices[i] = make_float4( poses[0].positions[i], 1 );
-		for (int j = 1; j <= weightCount; j++) vertices[i] += weights[j - 1] * make_float4( poses[j].positions[i], 0 );
+		for (int s = (int)triangles.size(), i = 0; i < s; i++)
+		{
+			bool affected = false;
+			for (int j = 1; j <= weightCount; j++) for (int v = i * 3; v < i * 3 + 3; v++)
+				if (dot( poses[j].positions[v], poses[j].positions[v] ) > 0 || dot( poses[j].normals[v], poses[j].normals[v] ) > 0) affected = true;
+			if (!affected) continue;
+			if (morphTriangles.size() > 0 && morphTriangles.back().x + morphTriangles.back().y == i) morphTriangles.back().y++;
+			else morphTriangles.push_back( make_int2( i, 1 ) );
+		}
+		if (morphTriangles.size() == 0) morphTriangles.push_back( make_int2( 0, 0 ) ); // no triangles affected
+		allTriangles.push_back( make_int2( 0, (int)triangles.size() ) );
 	}
-	// adjust full triangles
-	for (int s = (int)triangles.size(), i = 0; i < s; i++)
+	for (const int2& range : ranges) for (int i = range.x; i < range.x + range.y; i++)
 	{
+		// adjust intersection geometry data
+		for (int v = i * 3; v < i * 3 + 3; v++)
+		{
+			vertices[v] = make_float4( poses[0].positions[v], 1 );
+			for (int j = 1; j <= weightCount; j++) vertices[v] += weights[j - 1] * make_float4( poses[j].positions[v], 0 );
+		}
+		// adjust full triangles
 		triangles[i].vertex0 = make_float3( vertices[i * 3 + 0] );
 		triangles[i].vertex1 = make_float3( vertices[i * 3 + 1] );
 		triangles[i].vertex2 = make_float3( vertices[i * 3 + 2] );
@@ -660,8 +678,8 @@ void HostMesh::SetPose( const vector<float>& weights )
 		triangles[i].vN1 = normalize( triangles[i].vN1 );
 		triangles[i].vN2 = normalize( triangles[i].vN2 );
 	}
-	// mark as dirty; changing vector contents doesn't trigger this
-	MarkAsDirty();
+	// mark as dirty; changing vector contents doesn't trigger this. The topology did not change.
+	for (const int2& range : ranges) if (range.y > 0) MarkAsDirty( range.x, range.y );
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -671,6 +689,7 @@ void HostMesh::SetPose( const vector<float>& weights )
 //  +-----------------------------------------------------------------------------+
 void HostMesh::SetPose( const HostSkin* skin )
 {
+	PROFILE_ZONE( "HostMesh::SetPose (skin)" );
 	// ensure that we have a backup of the original vertex positions
 	if (original.size() == 0)
 	{
@@ -688,7 +707,7 @@ void HostMesh::SetPose( const HostSkin* skin )
 #define USE_PARALLEL_SETPOSE 1
 	// adjust full triangles
 #if USE_PARALLEL_SETPOSE == 1
-	concurrency::parallel_for<int>( 0, (int)triangles.size(), [&]( int t ) {
+	parallel_for( 0, (int)triangles.size(), 256, [&]( int t ) {
 	#else
 	for (int s = (int)triangles.size(), t = 0; t < s; t++)
 	{
@@ -820,8 +839,46 @@ void HostMesh::SetPose( const HostSkin* skin )
 		triangles[i].Nz = N.z;
 	}
 #endif
-	// mark as dirty; changing vector contents doesn't trigger this
+	// mark as dirty; changing vector contents doesn't trigger this. The topology did not change.
+	MarkAsDirty( 0, (int)triangles.size() );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostMesh::MarkAsDirty                                                      |
+//  |  Register a modification of the vertices of a range of triangles, without   |
+//  |  changes to the topology. If all modifications since the last sync are      |
+//  |  registered this way, the RenderSystem sends only the modified ranges and   |
+//  |  the core may refit the mesh BVH instead of rebuilding it.            LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostMesh::MarkAsDirty( const int firstTri, const int triCount )
+{
+	// a partial update is only possible if the mesh was unchanged, or only partially changed
+	const bool partial = generation == syncedGeneration || generation == partialGeneration;
+	if (generation == syncedGeneration) dirtyRanges.clear();
 	MarkAsDirty();
+	if (!partial) return;
+	// merge with the last range if they overlap or touch; otherwise add a range
+	if (dirtyRanges.size() > 0 && firstTri >= dirtyRanges.back().x && firstTri <= dirtyRanges.back().x + dirtyRanges.back().y)
+		dirtyRanges.back().y = max( dirtyRanges.back().y, firstTri + triCount - dirtyRanges.back().x );
+	else dirtyRanges.push_back( make_int2( firstTri, triCount ) );
+	partialGeneration = generation;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostMesh::TakeDirtyRanges                                                  |
+//  |  To be called after Changed() returned true. If only vertex data changed    |
+//  |  since the previous sync, the modified triangle ranges are moved to         |
+//  |  'ranges' and true is returned. Otherwise, the full mesh must be sent.      |
+//  |  Resets the partial update state.                                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool HostMesh::TakeDirtyRanges( vector<int2>& ranges )
+{
+	const bool partial = generation == partialGeneration;
+	ranges.clear();
+	if (partial) ranges.swap( dirtyRanges );
+	dirtyRanges.clear();
+	partialGeneration = 0;
+	return partial;
 }
 
 // EOF
\ No newline at end of file
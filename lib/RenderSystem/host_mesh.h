@@ -64,6 +64,8 @@ public:
 	void UpdateAlphaFlags();
 	void SetPose( const vector<float>& weights );
 	void SetPose( const HostSkin* skin );
+	void MarkAsDirty( const int firstTri, const int triCount );
+	bool TakeDirtyRanges( vector<int2>& ranges );
 	// data members
 	string name = "unnamed";					// name for the mesh						
 	int ID = -1;								// unique ID for the mesh: position in mesh array
@@ -79,7 +81,10 @@ public:
 	vector<Pose> poses;							// morph target data
 	bool isAnimated;							// true when this mesh has animation data
 	bool excludeFromNavmesh = false;			// prevents mesh from influencing navmesh generation (e.g. curtains)
+	vector<int2> morphTriangles;				// morph targets: (first, count) ranges of triangles affected by the poses
 	TRACKCHANGES;								// add Changed(), MarkAsDirty() methods, see system.h
+	vector<int2> dirtyRanges;					// (first, count) ranges of triangles modified since the last sync
+	uint partialGeneration = 0;					// generation after the last MarkAsDirty( first, count ) call
 	// Note: design decision:
 	// Vertices and indices can be deduced from the list of HostTris, obviously. However, efficient intersection
 	// (e.g. in OptiX) requires only vertices and connectivity data. Shading on the other hand requires the full
@@ -138,62 +138,70 @@ void HostNode::UpdateTransformFromTRS()
 //  +-----------------------------------------------------------------------------+
 //  |  HostNode::Update                                                           |
 //  |  Calculates the combined transform for this node and recurses into the      |
-//  |  child nodes. If a change is detected, the light triangles are updated      |
-//  |  as well.                                                             LH2'19|
+//  |  child nodes. Mesh nodes are appended to the instance list. Morphing,       |
+//  |  skinning and light triangle updates depend on other nodes (e.g. skin       |
+//  |  joints), so these are deferred: nodes that need them are added to          |
+//  |  posedNodes. Only this subtree is touched, so subtrees can be updated in    |
+//  |  parallel, see RenderSystem::UpdateSceneGraph.                        LH2'19|
 //  +-----------------------------------------------------------------------------+
-bool HostNode::Update( mat4& T, vector<int>& instances, int& posInInstanceArray )
+bool HostNode::Update( const mat4& T, vector<int>& instances, vector<int>& posedNodes )
 {
+	PROFILE_ZONE( "HostNode::Update" );
 	// update the combined transform for this node
 	bool thisWasModified = Changed();
-	bool instancesChanged = thisWasModified;
-	treeChanged = thisWasModified;
 	if (transformed)
 	{
 		UpdateTransformFromTRS();
 		transformed = false;
 	}
-	combinedTransform = T * localTransform;
+	const mat4 newTransform = T * localTransform;
+	if (newTransform != combinedTransform) combinedTransform = newTransform, thisWasModified = true; // e.g. a parent moved
+	bool instancesChanged = thisWasModified;
+	treeChanged = thisWasModified;
 	// update the combined transforms of the children
 	for (int s = (int)childIdx.size(), i = 0; i < s; i++)
 	{
 		HostNode* child = HostScene::nodePool[childIdx[i]];
-		bool childChanged = child->Update( combinedTransform, instances, posInInstanceArray );
+		bool childChanged = child->Update( combinedTransform, instances, posedNodes );
 		instancesChanged |= childChanged;
 		treeChanged |= childChanged;
 	}
-	// update animations
+	// register instance; defer animations
 	if (meshID > -1)
 	{
-		if (morphed)
-		{
-			HostScene::meshPool[meshID]->SetPose( weights );
-			morphed = false;
-		}
-		if (thisWasModified && hasLTris) UpdateLights();
-		if (instanceID != posInInstanceArray)
-		{
-			instancesChanged = true;
-			if (posInInstanceArray < instances.size())
-				instances[posInInstanceArray] = ID;
-			else
-				instances.push_back( ID );
-		}
-		if (skinID > -1)
+		if (thisWasModified && hasLTris) lightsChanged = true;
+		if (morphed || skinID > -1 || lightsChanged) posedNodes.push_back( ID );
+		instances.push_back( ID );
+	}
+	// all done; derived data was updated, which should not be reported as a change.
+	Changed();
+	return instancesChanged;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  HostNode::UpdatePose                                                       |
+//  |  Applies morph target weights and / or skinning to the mesh of this node.   |
+//  |  Requires up-to-date combined transforms for all skin joints.         LH2'19|
+//  +-----------------------------------------------------------------------------+
+void HostNode::UpdatePose()
+{
+	if (morphed)
+	{
+		HostScene::meshPool[meshID]->SetPose( weights );
+		morphed = false;
+	}
+	if (skinID > -1)
+	{
+		HostSkin* skin = HostScene::skins[skinID];
+		mat4 meshTransform = combinedTransform;
+		mat4 meshTransformInverted = meshTransform.Inverted();
+		for (int s = (int)skin->joints.size(), j = 0; j < s; j++)
 		{
-			HostSkin* skin = HostScene::skins[skinID];
-			mat4 meshTransform = combinedTransform;
-			mat4 meshTransformInverted = meshTransform.Inverted();
-			for (int s = (int)skin->joints.size(), j = 0; j < s; j++)
-			{
-				HostNode* jointNode = HostScene::nodePool[skin->joints[j]];
-				skin->jointMat[j] = meshTransformInverted * jointNode->combinedTransform * skin->inverseBindMatrices[j];
-			}
-			HostScene::meshPool[meshID]->SetPose( skin );
+			HostNode* jointNode = HostScene::nodePool[skin->joints[j]];
+			skin->jointMat[j] = meshTransformInverted * jointNode->combinedTransform * skin->inverseBindMatrices[j];
 		}
-		posInInstanceArray++;
+		HostScene::meshPool[meshID]->SetPose( skin );
 	}
-	// all done.
-	return instancesChanged;
 }
 
 //  +-----------------------------------------------------------------------------+
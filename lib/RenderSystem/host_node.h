@@ -35,7 +35,8 @@ public:
 	~HostNode();
 	// methods
 	void ConvertFromGLTFNode( const tinygltfNode& gltfNode, const int nodeBase, const int meshBase, const int skinBase );
-	bool Update( mat4& T, vector<int>& instances, int& instanceIdx );	// recursively update the transform of this node and its children
+	bool Update( const mat4& T, vector<int>& instances, vector<int>& posedNodes ); // recursively update the transform of this node and its children
+	void UpdatePose();					// apply morph target weights and / or skinning to the mesh of this node
 	void UpdateTransformFromTRS();		// process T, R, S data to localTransform
 	void PrepareLights();				// detects emissive triangles and creates light triangles for them
 	void UpdateLights();				// when the transform changes, this fixes the light triangles
@@ -60,6 +61,7 @@ public:
 protected:
 	friend class RenderSystem;
 	int instanceID = -1;				// for mesh nodes: location in the instance array. For internal use only.
+	bool lightsChanged = false;			// light triangles need to be updated after posing. For internal use only.
 };
 
 } // namespace lighthouse2
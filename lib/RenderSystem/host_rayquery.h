@@ -0,0 +1,82 @@
+/* host_rayquery.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   Batched ray queries for application code (line of sight, ground
+   snapping, picking), traced on the host against the HostSceneBVH by the
+   job system. See RenderAPI::QueryRays.
+*/
+
+#pragma once
+
+namespace lighthouse2
+{
+
+enum RayQueryType
+{
+	RAYQUERY_CLOSEST = 0,					// nearest intersection, with the node, mesh and material that were hit
+	RAYQUERY_OCCLUSION						// any intersection within [0, tmax); cheaper
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  RayQueryHit                                                                |
+//  |  Result of a closest-hit query. The ids match those returned by             |
+//  |  RenderAPI::GetTriangleNode, GetTriangleMesh and GetTriangleMaterialID.     |
+//  |  All ids are -1 if the ray did not hit anything.                      LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct RayQueryHit
+{
+	float t = 1e34f;						// distance along the ray
+	int nodeId = -1;						// scene node of the instance that was hit
+	int meshId = -1;						// mesh of that node
+	int materialId = -1;					// material of the triangle
+	int instId = -1, triId = -1;			// core instance and triangle index
+	float u = 0, v = 0;						// barycentrics of the intersection
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  RayQueryBatch                                                              |
+//  |  A batch of rays and its results. Created by RenderAPI::QueryRays, which    |
+//  |  returns as soon as the work is handed to the job system. Poll Done(), or   |
+//  |  Wait() (which helps with the work), before reading results; delete the     |
+//  |  batch when it is no longer needed. If the job system has no workers (e.g.  |
+//  |  on a machine with two hardware threads), QueryRays traces the batch        |
+//  |  before it returns, so Done() is true right away.                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+class RayQueryBatch
+{
+public:
+	// constructor / destructor
+	RayQueryBatch( const HostRay* queries, const int count, const RayQueryType queryType ) : type( queryType ), rays( queries, queries + count )
+	{
+		if (type == RAYQUERY_CLOSEST) hits.resize( count ); else occluded = new bool[count];
+	}
+	RayQueryBatch( const RayQueryBatch& ) = delete;
+	~RayQueryBatch() { Wait(); delete[] occluded; }
+	// methods
+	bool Done() const { return pending.Done(); }
+	void Wait() const { JobSystem::Wait( pending ); }
+	int Count() const { return (int)rays.size(); }
+	const RayQueryHit& Hit( const int idx ) const { return hits[idx]; }		// RAYQUERY_CLOSEST only
+	bool Occluded( const int idx ) const { return occluded[idx]; }			// RAYQUERY_OCCLUSION only
+	// data members
+	const RayQueryType type;
+	vector<HostRay> rays;					// copy of the queries; after a closest-hit query, t, tri, u, v and inst are set
+	vector<RayQueryHit> hits;				// closest-hit results
+	bool* occluded = nullptr;				// occlusion results
+	JobCounter pending;						// unfinished chunks of the batch
+};
+
+} // namespace lighthouse2
+
+// EOF
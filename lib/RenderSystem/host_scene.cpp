@@ -166,6 +166,7 @@ void HostScene::DeserializeMaterials( const char* xmlFile )
 		if (entry->FirstChildElement( "custom1" )) entry->FirstChildElement( "custom1" )->QueryFloatText( &m->custom1 );
 		if (entry->FirstChildElement( "custom2" )) entry->FirstChildElement( "custom2" )->QueryFloatText( &m->custom2 );
 		if (entry->FirstChildElement( "custom3" )) entry->FirstChildElement( "custom3" )->QueryFloatText( &m->custom3 );
+		m->MarkAsDirty();
 	}
 }
 
@@ -228,6 +229,7 @@ void HostScene::AddTriToMesh( const int meshId, const float3& v0, const float3&
 	tri.vertex1 = v1;
 	tri.vertex2 = v2;
 	m->triangles.push_back( tri );
+	m->MarkAsDirty();
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -264,9 +266,11 @@ int HostScene::AddScene( const char* sceneFile, const char* dir, const mat4& tra
 	if (!warn.empty()) printf( "Warn: %s\n", warn.c_str() );
 	if (!err.empty()) printf( "Err: %s\n", err.c_str() );
 	FATALERROR_IF( !ret, "could not load glTF file:\n%s", cleanFileName.c_str() );
-	// convert textures
-	for (size_t s = gltfModel.textures.size(), i = 0; i < s; i++)
-	{
+	// convert textures; texel data and MIP levels are produced in parallel
+	const int gltfTextureCount = (int)gltfModel.textures.size();
+	vector<HostTexture*> converted( gltfTextureCount );
+	parallel_for( 0, gltfTextureCount, 1, [&]( int i ) {
+		PROFILE_ZONE( "glTF texture" );
 		tinygltf::Texture& gltfTexture = gltfModel.textures[i];
 		HostTexture* texture = new HostTexture();
 		const tinygltf::Image& image = gltfModel.images[gltfTexture.source];
@@ -274,12 +278,13 @@ int HostScene::AddScene( const char* sceneFile, const char* dir, const mat4& tra
 		texture->width = image.width;
 		texture->height = image.height;
 		texture->idata = (uchar4*)MALLOC64( texture->PixelsNeeded( image.width, image.height, MIPLEVELCOUNT ) * sizeof( uint ) );
-		texture->ID = (int)i + textureBase;
+		texture->ID = i + textureBase;
 		texture->flags |= HostTexture::LDR;
 		memcpy( texture->idata, image.image.data(), size );
 		texture->ConstructMIPmaps();
-		textures.push_back( texture );
-	}
+		converted[i] = texture;
+	} );
+	textures.insert( textures.end(), converted.begin(), converted.end() );
 	// convert materials
 	for (size_t s = gltfModel.materials.size(), i = 0; i < s; i++)
 	{
@@ -397,6 +402,7 @@ int HostScene::AddQuad( float3 N, const float3 pos, const float width, const flo
 		newMesh->materialList.push_back( matId );
 		meshPool.push_back( newMesh );
 	}
+	else newMesh->MarkAsDirty();
 	return newMesh->ID;
 }
 
@@ -453,6 +459,7 @@ void HostScene::RemoveNode( const int nodeId )
 	nodePool[nodeId] = 0; // safe; we only access the nodes vector indirectly.
 	delete node;
 	nodeListHoles++; // HostScene::AddInstance will fill up holes first.
+	ChangeCounter<HostNode>::value++; // make sure the RenderSystem notices the removal
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -521,6 +528,7 @@ void HostScene::SetNodeTransform( const int nodeId, const mat4& transform )
 {
 	if (nodeId < 0 || nodeId >= nodePool.size()) return;
 	nodePool[nodeId]->localTransform = transform;
+	nodePool[nodeId]->MarkAsDirty();
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -156,7 +156,7 @@ void HostSkyDome::Load()
 	}
 #endif
 	// done
-	dirty = true;
+	MarkAsDirty();
 	printf( "sky ready in %5.3fs.\n", timer.elapsed() );
 }
 
@@ -135,6 +135,7 @@ void HostTexture::ConstructMIPmaps()
 //  +-----------------------------------------------------------------------------+
 void HostTexture::Load( const char* fileName, const uint modFlags, bool normalMap )
 {
+	PROFILE_ZONE( "HostTexture::Load" );
 	// check if texture exists
 	FATALERROR_IF( !FileExists( fileName ), "File %s not found", fileName );
 
@@ -21,23 +21,25 @@
 static RenderSystem* renderer = nullptr;
 static RenderAPI api;
 
-RenderAPI* RenderAPI::CreateRenderAPI( const char* dllName )
+RenderAPI* RenderAPI::CreateRenderAPI( const char* dllName, const char* traceFile )
 {
 	if (!renderer)
 	{
 		renderer = new RenderSystem();
-		renderer->Init( dllName );
+		renderer->Init( dllName, traceFile );
 	}
 	return &api;
 }
 
 void RenderAPI::SerializeMaterials( const char* xmlFile )
 {
+	renderer->WaitForSceneSync();
 	renderer->scene->SerializeMaterials( xmlFile );
 }
 
 void RenderAPI::DeserializeMaterials( const char* xmlFile )
 {
+	renderer->WaitForSceneSync();
 	renderer->scene->DeserializeMaterials( xmlFile );
 }
 
@@ -58,51 +60,66 @@ void RenderAPI::SerializeCamera( const char* xmlFile )
 
 int RenderAPI::AddMesh( const char* file, const char* dir, const float scale )
 {
+	renderer->WaitForSceneSync();
+	renderer->WaitForRayQueries();
 	return renderer->scene->AddMesh( file, dir, scale );
 }
 
 int RenderAPI::AddMesh( const int triCount )
 {
+	renderer->WaitForSceneSync();
+	renderer->WaitForRayQueries();
 	return renderer->scene->AddMesh( triCount );
 }
 
 void RenderAPI::AddTriToMesh( const int meshId, const float3& v0, const float3& v1, const float3& v2, const int matId )
 {
+	renderer->WaitForSceneSync();
+	renderer->WaitForRayQueries();
 	return renderer->scene->AddTriToMesh( meshId, v0, v1, v2, matId );
 }
 
 int RenderAPI::AddScene( const char* file, const char* dir, const mat4& transform )
 {
+	renderer->WaitForSceneSync();
+	renderer->WaitForRayQueries();
 	return renderer->scene->AddScene( file, dir, transform );
 }
 
 int RenderAPI::AddQuad( const float3 N, const float3 pos, const float width, const float height, const int material, const int meshID )
 {
+	renderer->WaitForSceneSync();
+	renderer->WaitForRayQueries();
 	return renderer->scene->AddQuad( N, pos, width, height, material, meshID );
 }
 
 int RenderAPI::AddInstance( const int meshId, const mat4& transform )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->AddInstance( meshId, transform );
 }
 
 void RenderAPI::RemoveNode( const int nodeId )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->RemoveNode( nodeId );
 }
 
 void RenderAPI::SetNodeTransform( const int nodeId, const mat4& transform )
 {
+	renderer->WaitForSceneSync();
 	renderer->scene->SetNodeTransform( nodeId, transform );
 }
 
 void RenderAPI::ResetAnimation( const int animId )
 {
+	renderer->WaitForSceneSync();
 	renderer->scene->ResetAnimation( animId );
 }
 
 void RenderAPI::UpdateAnimation( const int animId, const float dt )
 {
+	renderer->WaitForSceneSync();
 	renderer->scene->UpdateAnimation( animId, dt );
 }
 
@@ -116,6 +133,16 @@ void RenderAPI::SynchronizeSceneData()
 	renderer->SynchronizeSceneData();
 }
 
+void RenderAPI::SetPipelinedSync( const bool enabled )
+{
+	renderer->SetPipelinedSync( enabled );
+}
+
+void RenderAPI::WaitForSceneSync()
+{
+	renderer->WaitForSceneSync();
+}
+
 void RenderAPI::Render( Convergence converge )
 {
 	renderer->Render( renderer->scene->camera->GetView(), converge );
@@ -133,67 +160,96 @@ RenderSettings* RenderAPI::GetSettings()
 
 int RenderAPI::GetTriangleNode(const int coreInstId, const int coreTriId)
 {
+	renderer->WaitForSceneSync();
 	return renderer->GetTriangleNode(coreInstId, coreTriId);
 }
 
 int RenderAPI::GetTriangleMesh(const int coreInstId, const int coreTriId)
 {
+	renderer->WaitForSceneSync();
 	return renderer->GetTriangleMesh(coreInstId, coreTriId);
 }
 
 int RenderAPI::GetTriangleMaterialID( const int coreInstId, const int coreTriId )
 {
+	renderer->WaitForSceneSync();
 	return renderer->GetTriangleMaterial( coreInstId, coreTriId );
 }
 
 HostMaterial* RenderAPI::GetTriangleMaterial( const int coreInstId, const int coreTriId )
 {
+	renderer->WaitForSceneSync();
 	int matId = renderer->GetTriangleMaterial( coreInstId, coreTriId );
 	return GetMaterial( matId );
 }
 
 HostMaterial* RenderAPI::GetMaterial( const int matId )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->materials[matId];
 }
 
 HostScene* RenderAPI::GetScene()
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene;
 }
 
+void RenderAPI::EnableHostBVH( const bool enabled )
+{
+	renderer->EnableHostBVH( enabled );
+}
+
+const HostSceneBVH* RenderAPI::GetHostBVH()
+{
+	renderer->WaitForSceneSync();
+	return renderer->GetHostBVH();
+}
+
+RayQueryBatch* RenderAPI::QueryRays( const HostRay* rays, const int rayCount, const RayQueryType type )
+{
+	return renderer->QueryRays( rays, rayCount, type );
+}
+
 HostMesh* RenderAPI::GetMesh(int meshID)
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->meshPool[meshID];
 }
 
 int RenderAPI::FindMaterialID( const char* name )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->FindMaterialID( name );
 }
 
 int RenderAPI::FindNode( const char* name )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->FindNode( name );
 }
 
 int RenderAPI::AddMaterial( const float3 color )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->AddMaterial( color );
 }
 
 int RenderAPI::AddPointLight( const float3 pos, const float3 radiance, bool enabled )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->AddPointLight( pos, radiance, enabled );
 }
 
 int RenderAPI::AddSpotLight( const float3 pos, const float3 direction, const float inner, const float outer, const float3 radiance, bool enabled )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->AddSpotLight( pos, direction, inner, outer, radiance, enabled );
 }
 
 int RenderAPI::AddDirectionalLight( const float3 direction, const float3 radiance, bool enabled )
 {
+	renderer->WaitForSceneSync();
 	return renderer->scene->AddDirectionalLight( direction, radiance, enabled );
 }
 
@@ -202,6 +258,11 @@ void RenderAPI::SetTarget( GLTexture* tex, const uint spp )
 	renderer->SetTarget( tex, spp );
 }
 
+void RenderAPI::SetTarget( Bitmap* target, const uint spp )
+{
+	renderer->SetTarget( target, spp );
+}
+
 void RenderAPI::SetProbePos( const int2 pos )
 {
 	renderer->SetProbePos( pos );
@@ -29,7 +29,8 @@ class RenderAPI
 {
 public:
 	// CreateRenderAPI: instantiate and initialize a RenderSystem object and obtain an interface to it.
-	static RenderAPI* CreateRenderAPI( const char* dllName );
+	// If traceFile is specified, all calls to the core are recorded to this file, for replay with replayapp.
+	static RenderAPI* CreateRenderAPI( const char* dllName, const char* traceFile = 0 );
 	// Methods
 	void SerializeMaterials( const char* xmlFile );
 	void DeserializeMaterials( const char* xmlFile );
@@ -48,6 +49,12 @@ public:
 	void UpdateAnimation( int animId, const float dt );
 	int AnimationCount();
 	void SynchronizeSceneData();
+	// Pipelined scene synchronization: SynchronizeSceneData sends the update prepared during the previous frame
+	// and prepares the next one on a worker thread, overlapping with Render. Methods of this class that access the
+	// scene wait for the worker thread themselves; objects obtained from it (e.g. via GetScene, GetMaterial) must not
+	// be modified until WaitForSceneSync returns.
+	void SetPipelinedSync( const bool enabled );
+	void WaitForSceneSync();
 	void Render( Convergence converge );
 	Camera* GetCamera();
 	RenderSettings* GetSettings();
@@ -57,6 +64,15 @@ public:
 	HostMaterial* GetTriangleMaterial( const int coreInstId, const int coreTriId );
 	HostMaterial* GetMaterial( const int matId );
 	HostScene* GetScene();
+	// Host-side scene BVH: a CPU copy of the acceleration structure, for ray queries on the host. Once enabled, it is
+	// updated (refitted where possible) by SynchronizeSceneData. Instance indices in HostRay match core instance ids.
+	void EnableHostBVH( const bool enabled );
+	const HostSceneBVH* GetHostBVH();
+	// Batched ray queries on the host, e.g. for line of sight tests by game code: the rays are traced against the host-side
+	// scene BVH (enabled on first use) by the job system, and the call returns immediately. Poll or wait for the batch
+	// before reading its results, and delete it afterwards. Closest-hit results report node, mesh and material ids, as
+	// GetTriangleNode etc. do. Adding meshes or triangles waits until all batches are done.
+	RayQueryBatch* QueryRays( const HostRay* rays, const int rayCount, const RayQueryType type = RAYQUERY_CLOSEST );
 	HostMesh* GetMesh(int meshID);
 	int FindNode( const char* name );
 	int FindMaterialID( const char* name );
@@ -65,6 +81,7 @@ public:
 	int AddSpotLight( const float3 pos, const float3 direction, const float inner, const float outer, const float3 radiance, bool enabled = true );
 	int AddDirectionalLight( const float3 direction, const float3 radiance, bool enabled = true );
 	void SetTarget( GLTexture* tex, const uint spp );
+	void SetTarget( Bitmap* target, const uint spp ); // headless mode: render to a host buffer
 	void SetProbePos( const int2 pos );
 	CoreStats GetCoreStats();
 	SystemStats GetSystemStats();
@@ -15,14 +15,24 @@
 
 #include "rendersystem.h"
 
+// helper: check if any object of type T was created or modified since the previous call, see system.h
+template <class T> static bool PoolChanged( uint& syncedChanges )
+{
+	if (ChangeCounter<T>::value == syncedChanges) return false;
+	syncedChanges = ChangeCounter<T>::value;
+	return true;
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem::Init                                                         |
 //  |  Initialize the rendering system.                                     LH2'19|
 //  +-----------------------------------------------------------------------------+
-void RenderSystem::Init( const char* dllName )
+void RenderSystem::Init( const char* dllName, const char* traceFile )
 {
 	// create core
 	core = CoreAPI_Base::CreateCoreAPI( dllName );
+	// record all calls to the core, if requested
+	if (traceFile) core = new CoreAPI_Recorder( core, traceFile );
 	// create scene - load a scene using tinyobjloader
 	scene = new HostScene();
 	scene->Init();
@@ -41,6 +51,19 @@ void RenderSystem::SetTarget( GLTexture* target, const uint spp )
 	scene->camera->pixelCount = make_int2( target->width, target->height );
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::SetTarget                                                    |
+//  |  Use the specified host buffer as the render target (headless mode).  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::SetTarget( Bitmap* target, const uint spp )
+{
+	// forward to core
+	core->SetHostTarget( target, spp );
+	// update camera aspect ratio
+	scene->camera->aspectRatio = (float)target->width / (float)target->height;
+	scene->camera->pixelCount = make_int2( target->width, target->height );
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem::SynchronizeSky                                               |
 //  |  Detect changes to the skydome. If a change is found, send the new data to  |
@@ -49,30 +72,31 @@ void RenderSystem::SetTarget( GLTexture* target, const uint spp )
 //  +-----------------------------------------------------------------------------+
 void RenderSystem::SynchronizeSky()
 {
-	if (scene->sky->Changed())
-	{
-		// send sky data to core
-		HostSkyDome* sky = scene->sky;
-		core->SetSkyData( sky->pixels, sky->width, sky->height );
-	}
+	PROFILE_ZONE( "SynchronizeSky" );
+	if (scene->sky->Changed()) pending.skyChanged = true;
 }
 
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem::SynchronizeTextures                                          |
-//  |  Detect changes to the textures. TODO: currently, the system always sends   |
-//  |  all textures to the core whenever any of them changes.               LH2'19|
+//  |  Detect changes to the textures. The modified textures are sent to the      |
+//  |  core in CommitSceneData. Materials store the dimensions of their           |
+//  |  textures, so these are sent again when a texture is resized.         LH2'19|
 //  +-----------------------------------------------------------------------------+
 void RenderSystem::SynchronizeTextures()
 {
-	bool texturesDirty = false;
-	for (auto texture : scene->textures) if (texture->Changed()) texturesDirty = true;
-	if (texturesDirty)
+	PROFILE_ZONE( "SynchronizeTextures" );
+	if (!PoolChanged<HostTexture>( textureChanges )) return;
+	bool resized = false;
+	textureSizes.resize( scene->textures.size(), make_uint2( 0 ) );
+	for (int s = (int)scene->textures.size(), i = 0; i < s; i++) if (scene->textures[i]->Changed())
 	{
-		// send texture data to core
-		vector<CoreTexDesc> gpuTex;
-		for (auto texture : scene->textures) gpuTex.push_back( texture->ConvertToCoreTexDesc() );
-		core->SetTextures( gpuTex.data(), (int)gpuTex.size() );
+		const HostTexture* texture = scene->textures[i];
+		pending.dirtyTextures.push_back( i );
+		if (textureSizes[i].x == texture->width && textureSizes[i].y == texture->height) continue;
+		textureSizes[i] = make_uint2( texture->width, texture->height );
+		resized = true;
 	}
+	if (resized) for (auto material : scene->materials) material->MarkAsDirty();
 }
 
 //  +-----------------------------------------------------------------------------+
@@ -82,6 +106,8 @@ void RenderSystem::SynchronizeTextures()
 //  +-----------------------------------------------------------------------------+
 void RenderSystem::SynchronizeMaterials()
 {
+	PROFILE_ZONE( "SynchronizeMaterials" );
+	if (!PoolChanged<HostMaterial>( materialChanges )) return;
 	bool materialsDirty = false;
 	for (auto material : scene->materials) if (material->Changed())
 	{
@@ -93,85 +119,276 @@ void RenderSystem::SynchronizeMaterials()
 			mesh->MarkAsDirty();
 			break;
 		}
+		material->Changed(); // AlphaChanged updated the material; this is not a change
 	}
 	if (materialsDirty)
 	{
-		// send material data to core
-		vector<CoreMaterial> gpuMaterial;
-		vector<CoreMaterialEx> gpuMaterialEx;
+		// convert material data for the core
+		pending.materialsChanged = true;
+		pending.materials.clear();
+		pending.materialsEx.clear();
 		for (auto material : scene->materials)
 		{
 			CoreMaterial m;
 			CoreMaterialEx e;
 			material->ConvertTo( m, e );
-			gpuMaterial.push_back( m );
-			gpuMaterialEx.push_back( e );
+			pending.materials.push_back( m );
+			pending.materialsEx.push_back( e );
 		}
-		core->SetMaterials( gpuMaterial.data(), gpuMaterialEx.data(), (int)gpuMaterial.size() );
 	}
 }
 
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem::SynchronizeMeshes                                            |
-//  |  Detect changes to scene models. Note: right now, if a single model was     |
-//  |  modified, all geometry is sent to the core. This works fine when all       |
-//  |  geometry is initialized at once, but for more dynamic scenes we will need  |
-//  |  a better system.                                                     LH2'19|
+//  |  Detect changes to scene models. Meshes of which only vertices changed      |
+//  |  (e.g. by skinning or morphing) are updated in place, using the dirty       |
+//  |  triangle ranges recorded by the mesh; other modified meshes are sent in    |
+//  |  full.                                                                LH2'19|
 //  +-----------------------------------------------------------------------------+
 void RenderSystem::SynchronizeMeshes()
 {
+	PROFILE_ZONE( "SynchronizeMeshes" );
+	if (!PoolChanged<HostMesh>( meshChanges )) return;
 	for (int s = (int)scene->meshPool.size(), modelIdx = 0; modelIdx < s; modelIdx++)
 	{
 		HostMesh* mesh = scene->meshPool[modelIdx];
 		if (mesh->Changed())
 		{
-			mesh->UpdateAlphaFlags();
-			core->SetGeometry( modelIdx, mesh->vertices.data(), (int)mesh->vertices.size(), (int)mesh->triangles.size(), (CoreTri*)mesh->triangles.data(), mesh->alphaFlags.data() );
-			meshesChanged = true; // trigger scene graph update
+			vector<int2> ranges;
+			if (mesh->TakeDirtyRanges( ranges )) pending.toplevelChanged = true; else
+			{
+				mesh->UpdateAlphaFlags();
+				mesh->Changed(); // alpha flags are derived data
+				meshesChanged = true; // trigger scene graph update
+			}
+			pending.dirtyMeshes.push_back( modelIdx );
+			pending.dirtyMeshRanges.push_back( ranges );
 		}
 	}
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  GroupPosedNodes                                                            |
+//  |  Helper for UpdateSceneGraph: splits the list of nodes that need posing     |
+//  |  into tasks that can safely run in parallel. Nodes that share a mesh or a   |
+//  |  skin are placed in the same task, in their original order.           LH2'19|
+//  +-----------------------------------------------------------------------------+
+static int FindGroup( vector<int>& group, int i ) { while (group[i] != i) i = group[i] = group[group[i]]; return i; }
+static void GroupPosedNodes( const vector<int>& posedNodes, vector<vector<int>>& tasks )
+{
+	// union-find over the list of posed nodes
+	const int count = (int)posedNodes.size();
+	vector<int> group( count );
+	map<int, int> lastMeshUser, lastSkinUser;
+	for (int i = 0; i < count; i++)
+	{
+		group[i] = i;
+		const HostNode* node = HostScene::nodePool[posedNodes[i]];
+		if (lastMeshUser.count( node->meshID )) group[FindGroup( group, lastMeshUser[node->meshID] )] = FindGroup( group, i );
+		lastMeshUser[node->meshID] = i;
+		if (node->skinID == -1) continue;
+		if (lastSkinUser.count( node->skinID )) group[FindGroup( group, lastSkinUser[node->skinID] )] = FindGroup( group, i );
+		lastSkinUser[node->skinID] = i;
+	}
+	// emit one task per group; task order follows the first node of each group
+	vector<int> taskIdx( count, -1 );
+	for (int i = 0; i < count; i++)
+	{
+		int& t = taskIdx[FindGroup( group, i )];
+		if (t == -1) t = (int)tasks.size(), tasks.push_back( vector<int>() );
+		tasks[t].push_back( posedNodes[i] );
+	}
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem::UpdateSceneGraph                                             |
 //  |  Walk the scene graph:                                                      |
 //  |  - update all node matrices                                                 |
 //  |  - update the instance array (where an 'instance' is a node with            |
-//  |    a mesh)                                                            LH2'19|
+//  |    a mesh)                                                                  |
+//  |  - update morphed and skinned meshes, and the light triangles of moved      |
+//  |    instances.                                                               |
+//  |  Root subtrees are processed in parallel; results are concatenated in root  |
+//  |  order, so the instance array does not depend on thread scheduling.   LH2'19|
 //  +-----------------------------------------------------------------------------+
 void RenderSystem::UpdateSceneGraph()
 {
+	PROFILE_ZONE( "UpdateSceneGraph" );
+	// nothing to do if no node was added, removed or modified
+	if (!PoolChanged<HostNode>( nodeChanges ) && !meshesChanged)
+	{
+		stats.sceneUpdateTime = stats.transformTime = stats.poseTime = stats.lightUpdateTime = 0;
+		return;
+	}
 	// walk the scene graph to update matrices
 	Timer timer;
+	const int rootCount = (int)HostScene::rootNodes.size();
+	vector<vector<int>> rootInstances( rootCount ), rootPosedNodes( rootCount );
+	vector<char> rootChanged( rootCount );
+	parallel_for( 0, rootCount, 1, [&]( int r ) {
+		HostNode* node = HostScene::nodePool[HostScene::rootNodes[r]];
+		mat4 T; // start with an identity matrix
+		rootChanged[r] = node->Update( T, rootInstances[r], rootPosedNodes[r] );
+	} );
 	int instanceCount = 0;
 	bool instancesChanged = false;
-	for (int nodeIdx : HostScene::rootNodes)
+	vector<int> posedNodes;
+	for (int r = 0; r < rootCount; r++)
+	{
+		instancesChanged |= rootChanged[r] != 0;
+		for (int nodeIdx : rootInstances[r])
+		{
+			if (HostScene::nodePool[nodeIdx]->instanceID != instanceCount) instancesChanged = true;
+			if (instanceCount < instances.size()) instances[instanceCount] = nodeIdx; else instances.push_back( nodeIdx );
+			instanceCount++;
+		}
+		posedNodes.insert( posedNodes.end(), rootPosedNodes[r].begin(), rootPosedNodes[r].end() );
+	}
+	stats.transformTime = timer.elapsed();
+	// update morphed and skinned meshes; nodes that share a mesh or a skin end up in the same task
+	timer.reset();
+	vector<vector<int>> poseTasks;
+	GroupPosedNodes( posedNodes, poseTasks );
+	parallel_for( 0, (int)poseTasks.size(), 1, [&]( int t ) {
+		for (int nodeIdx : poseTasks[t]) HostScene::nodePool[nodeIdx]->UpdatePose();
+	} );
+	stats.poseTime = timer.elapsed();
+	// update light triangles; serial, since instances of a mesh share light triangles (see PrepareLights)
+	timer.reset();
+	for (int nodeIdx : posedNodes)
 	{
 		HostNode* node = HostScene::nodePool[nodeIdx];
-		mat4 T;
-		instancesChanged |= node->Update( T /* start with an identity matrix */, instances, instanceCount );
+		if (!node->lightsChanged) continue;
+		node->UpdateLights();
+		node->lightsChanged = false;
 	}
-	stats.sceneUpdateTime = timer.elapsed();
+	stats.lightUpdateTime = timer.elapsed();
+	stats.sceneUpdateTime = stats.transformTime + stats.poseTime + stats.lightUpdateTime;
 	// synchronize instances to device if anything changed
 	if (instancesChanged || meshesChanged || instances.size() != instanceCount)
 	{
-		// resize vector (this is free if the size didn't change)
+		// resize vectors (this is free if the size didn't change)
+		const int sentCount = (int)instanceMeshIDs.size();
 		instances.resize( instanceCount );
-		// send instances to core
+		instanceMeshIDs.resize( instanceCount );
+		instanceTransforms.resize( instanceCount );
+		// gather instance data; collect ranges of instances that differ from what the core has
+		vector<int2> dirtyRanges;
 		for (int instanceIdx = 0; instanceIdx < instanceCount; instanceIdx++)
 		{
 			HostNode* node = HostScene::nodePool[instances[instanceIdx]];
 			node->instanceID = instanceIdx;
 			int dummy = node->Changed(); // prevent superfluous update in the next frame
-			core->SetInstance( instanceIdx, node->meshID, node->combinedTransform );
+			if (instanceIdx < sentCount && instanceMeshIDs[instanceIdx] == node->meshID && instanceTransforms[instanceIdx] == node->combinedTransform) continue;
+			instanceMeshIDs[instanceIdx] = node->meshID;
+			instanceTransforms[instanceIdx] = node->combinedTransform;
+			if (dirtyRanges.size() > 0 && dirtyRanges.back().x + dirtyRanges.back().y == instanceIdx) dirtyRanges.back().y++;
+			else dirtyRanges.push_back( make_int2( instanceIdx, 1 ) );
 		}
-		core->SetInstance( instanceCount, -1 );
-		// finalize
-		core->UpdateToplevel();
+		// a mesh may have been rebuilt, in which case the core needs to see all instances again
+		if (meshesChanged) dirtyRanges.clear(), dirtyRanges.push_back( make_int2( 0, instanceCount ) );
+		// instances are sent to the core in CommitSceneData
+		pending.instancesChanged = true;
+		pending.dirtyInstances = dirtyRanges;
 		meshesChanged = false;
 	}
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::UpdateHostBVH                                                |
+//  |  Apply the pending mesh and instance changes to the host-side scene BVH,    |
+//  |  if enabled. Like the cores, meshes of which only vertices changed are      |
+//  |  refitted, and the top level is refitted when instances only moved.   LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::UpdateHostBVH()
+{
+	stats.hostBVHTime = 0;
+	if (!hostBVH) return;
+	PROFILE_ZONE( "UpdateHostBVH" );
+	Timer timer;
+	for (size_t i = 0; i < pending.dirtyMeshes.size(); i++)
+	{
+		const int meshIdx = pending.dirtyMeshes[i];
+		const vector<int2>& ranges = pending.dirtyMeshRanges[i];
+		if (ranges.size() > 0) hostBVH->RefitMesh( meshIdx, scene->meshPool[meshIdx], ranges.data(), (int)ranges.size() );
+		else hostBVH->SetMesh( meshIdx, scene->meshPool[meshIdx] );
+	}
+	if (pending.instancesChanged) hostBVH->SetInstances( instanceMeshIDs.data(), instanceTransforms.data(), (int)instanceMeshIDs.size(),
+		pending.dirtyInstances.data(), (int)pending.dirtyInstances.size() );
+	if (pending.instancesChanged || pending.dirtyMeshes.size() > 0) hostBVH->UpdateToplevel();
+	stats.hostBVHTime = timer.elapsed();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::EnableHostBVH                                                |
+//  |  Create or delete the host-side scene BVH. Once enabled, it is kept up to   |
+//  |  date by SynchronizeSceneData, and reflects the most recently prepared      |
+//  |  scene update; in pipelined mode, call WaitForSceneSync before using it.    |
+//  |  Instance indices match the core instance indices.                    LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::EnableHostBVH( const bool enabled )
+{
+	WaitForSceneSync();
+	WaitForRayQueries();
+	if (!enabled) { delete hostBVH; hostBVH = nullptr; return; }
+	if (hostBVH) return;
+	hostBVH = new HostSceneBVH();
+	for (int s = (int)scene->meshPool.size(), meshIdx = 0; meshIdx < s; meshIdx++) hostBVH->SetMesh( meshIdx, scene->meshPool[meshIdx] );
+	const int2 all = make_int2( 0, (int)instanceMeshIDs.size() );
+	hostBVH->SetInstances( instanceMeshIDs.data(), instanceTransforms.data(), all.y, &all, 1 );
+	hostBVH->UpdateToplevel();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::QueryRays                                                    |
+//  |  Trace a batch of rays against the host BVH, on the job system. Returns     |
+//  |  immediately, unless the job system has no workers: the batch is then       |
+//  |  traced on the calling thread. See RayQueryBatch for retrieving the         |
+//  |  results. The queries see the scene as it was at the last                   |
+//  |  SynchronizeSceneData.                                                LH2'19|
+//  +-----------------------------------------------------------------------------+
+RayQueryBatch* RenderSystem::QueryRays( const HostRay* rays, const int rayCount, const RayQueryType type )
+{
+	WaitForSceneSync();
+	if (!hostBVH) EnableHostBVH( true );
+	RayQueryBatch* batch = new RayQueryBatch( rays, rayCount, type );
+	// chunks are large enough for the stream traversal to find coherent packets
+	const int chunkSize = 256, chunkCount = (rayCount + chunkSize - 1) / chunkSize;
+	batch->pending.value += chunkCount;
+	for (int c = 0; c < chunkCount; c++) JobSystem::Run( [this, batch, c, chunkSize, rayCount]() {
+		const int first = c * chunkSize, count = min( chunkSize, rayCount - first );
+		HostRay* chunk = batch->rays.data() + first;
+		if (batch->type == RAYQUERY_OCCLUSION) hostBVH->IsOccluded( chunk, count, batch->occluded + first ); else
+		{
+			hostBVH->Intersect( chunk, count );
+			for (int i = 0; i < count; i++) if (chunk[i].tri != -1)
+			{
+				// same mapping as GetTriangleNode, GetTriangleMesh and GetTriangleMaterial
+				RayQueryHit& hit = batch->hits[first + i];
+				hit.t = chunk[i].t, hit.u = chunk[i].u, hit.v = chunk[i].v;
+				hit.instId = chunk[i].inst, hit.triId = chunk[i].tri;
+				hit.nodeId = instances[hit.instId];
+				hit.meshId = hostBVH->instances[hit.instId].mesh;
+				hit.materialId = scene->meshPool[hit.meshId]->triangles[hit.triId].material;
+			}
+		}
+		batch->pending.value.fetch_sub( 1, std::memory_order_release );
+	}, &rayQueryJobs );
+	// without workers, nothing would run the chunks until Wait is called; polling Done would never return true
+	if (JobSystem::WorkerCount() == 0) batch->Wait();
+	return batch;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::WaitForRayQueries                                            |
+//  |  Finish all ray query batches. Called before anything that the queries      |
+//  |  read is modified: the host BVH, the instance list or the mesh pool.  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::WaitForRayQueries()
+{
+	JobSystem::Wait( rayQueryJobs );
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem::SynchronizeLights                                            |
 //  |  Detect changes to the lights. Note: light data is small, so we can safely  |
@@ -179,6 +396,12 @@ void RenderSystem::UpdateSceneGraph()
 //  +-----------------------------------------------------------------------------+
 void RenderSystem::SynchronizeLights()
 {
+	PROFILE_ZONE( "SynchronizeLights" );
+	bool poolsChanged = PoolChanged<HostAreaLight>( areaLightChanges );
+	poolsChanged |= PoolChanged<HostPointLight>( pointLightChanges );
+	poolsChanged |= PoolChanged<HostSpotLight>( spotLightChanges );
+	poolsChanged |= PoolChanged<HostDirectionalLight>( directionalLightChanges );
+	if (!poolsChanged) return;
 	bool lightsDirty = false;
 	for (auto light : scene->areaLights) if (light->Changed()) lightsDirty = true;
 	for (auto light : scene->pointLights) if (light->Changed()) lightsDirty = true;
@@ -186,40 +409,170 @@ void RenderSystem::SynchronizeLights()
 	for (auto light : scene->directionalLights) if (light->Changed()) lightsDirty = true;
 	if (lightsDirty)
 	{
-		// send delta lights to core
-		vector<CoreLightTri> gpuAreaLights;
-		vector<CorePointLight> gpuPointLights;
-		vector<CoreSpotLight> gpuSpotLights;
-		vector<CoreDirectionalLight> gpuDirectionalLights;
-		for (auto light : scene->areaLights) if (light->enabled) gpuAreaLights.push_back( light->ConvertToCoreLightTri() );
-		for (auto light : scene->pointLights) if (light->enabled) gpuPointLights.push_back( light->ConvertToCorePointLight() );
-		for (auto light : scene->spotLights) if (light->enabled) gpuSpotLights.push_back( light->ConvertToCoreSpotLight() );
-		for (auto light : scene->directionalLights) if (light->enabled) gpuDirectionalLights.push_back( light->ConvertToCoreDirectionalLight() );
-		core->SetLights( gpuAreaLights.data(), (int)gpuAreaLights.size(),
-			gpuPointLights.data(), (int)gpuPointLights.size(),
-			gpuSpotLights.data(), (int)gpuSpotLights.size(),
-			gpuDirectionalLights.data(), (int)gpuDirectionalLights.size() );
+		// convert light data for the core
+		pending.lightsChanged = true;
+		pending.areaLights.clear();
+		pending.pointLights.clear();
+		pending.spotLights.clear();
+		pending.directionalLights.clear();
+		for (auto light : scene->areaLights) if (light->enabled) pending.areaLights.push_back( light->ConvertToCoreLightTri() );
+		for (auto light : scene->pointLights) if (light->enabled) pending.pointLights.push_back( light->ConvertToCorePointLight() );
+		for (auto light : scene->spotLights) if (light->enabled) pending.spotLights.push_back( light->ConvertToCoreSpotLight() );
+		for (auto light : scene->directionalLights) if (light->enabled) pending.directionalLights.push_back( light->ConvertToCoreDirectionalLight() );
 	}
 }
 
 //  +-----------------------------------------------------------------------------+
-//  |  RenderSystem::Synchronize                                                  |
-//  |  Send modified data to the RenderCore layer.                                |
+//  |  RenderSystem::PrepareSceneData                                             |
+//  |  Detect modified data and collect it in the 'pending' scene update.         |
 //  |  Modifications are detected using the Changed() method implemented for most |
-//  |  scene-related objects. These rely on a crc64 checksum; theoretically it is |
-//  |  possible that a change goes undetected. Ideally, the system should at      |
-//  |  least not crash when this happens.                                   LH2'19|
+//  |  scene-related objects. These rely on generation counters, which must be    |
+//  |  bumped using MarkAsDirty whenever an object is modified. Object pools in   |
+//  |  which nothing changed are skipped entirely. Define VERIFYCHANGES to find   |
+//  |  modifications that were not flagged.                                       |
+//  |  Does not call the core, so this may run on a worker thread.          LH2'19|
 //  +-----------------------------------------------------------------------------+
-void RenderSystem::SynchronizeSceneData()
+void RenderSystem::PrepareSceneData()
 {
+	PROFILE_ZONE( "PrepareSceneData" );
+	WaitForRayQueries(); // queries read the host BVH and the instance list
 	SynchronizeSky();
 	SynchronizeTextures();
 	SynchronizeMaterials();
 	SynchronizeMeshes();
 	UpdateSceneGraph();
+	UpdateHostBVH();
 	SynchronizeLights();
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::CommitSceneData                                              |
+//  |  Send the pending scene update to the RenderCore layer. Must be called on   |
+//  |  the thread that owns the core.                                       LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::CommitSceneData()
+{
+	PROFILE_ZONE( "CommitSceneData" );
+	if (pending.skyChanged)
+	{
+		// send sky data to core
+		HostSkyDome* sky = scene->sky;
+		core->SetSkyData( sky->pixels, sky->width, sky->height );
+	}
+	if (pending.dirtyTextures.size() > 0)
+	{
+		// if the set of textures did not change, only the modified textures are sent to
+		// the core. If the core does not support this, or when textures were added, all
+		// textures are sent.
+		bool sendAll = scene->textures.size() != coreTextureCount;
+		if (!sendAll) for (int textureIdx : pending.dirtyTextures)
+		{
+			if (core->SetTexture( textureIdx, scene->textures[textureIdx]->ConvertToCoreTexDesc() )) continue;
+			sendAll = true; // core declined; fall back to the full set
+			break;
+		}
+		if (sendAll)
+		{
+			vector<CoreTexDesc> gpuTex;
+			for (auto texture : scene->textures) gpuTex.push_back( texture->ConvertToCoreTexDesc() );
+			core->SetTextures( gpuTex.data(), (int)gpuTex.size() );
+			coreTextureCount = (int)gpuTex.size();
+		}
+	}
+	if (pending.materialsChanged) core->SetMaterials( pending.materials.data(), pending.materialsEx.data(), (int)pending.materials.size() );
+	bool meshRebuilt = false;
+	for (size_t i = 0; i < pending.dirtyMeshes.size(); i++)
+	{
+		// meshes of which only vertices changed are updated in place, if the core supports this
+		const int meshIdx = pending.dirtyMeshes[i];
+		const vector<int2>& ranges = pending.dirtyMeshRanges[i];
+		HostMesh* mesh = scene->meshPool[meshIdx];
+		if (ranges.size() > 0 && core->UpdateGeometry( meshIdx, mesh->vertices.data(), (int)mesh->vertices.size(), (int)mesh->triangles.size(),
+			(CoreTri*)mesh->triangles.data(), ranges.data(), (int)ranges.size() )) continue;
+		core->SetGeometry( meshIdx, mesh->vertices.data(), (int)mesh->vertices.size(), (int)mesh->triangles.size(), (CoreTri*)mesh->triangles.data(), mesh->alphaFlags.data() );
+		if (ranges.size() > 0) meshRebuilt = true;
+	}
+	if (pending.instancesChanged || meshRebuilt)
+	{
+		// a mesh that the core could not update in place was rebuilt, in which case the core needs to see all instances again
+		if (meshRebuilt) pending.dirtyInstances.assign( 1, make_int2( 0, (int)instanceMeshIDs.size() ) );
+		core->SetInstances( instanceMeshIDs.data(), instanceTransforms.data(), (int)instanceMeshIDs.size(), pending.dirtyInstances.data(), (int)pending.dirtyInstances.size() );
+	}
+	if (pending.instancesChanged || pending.toplevelChanged) core->UpdateToplevel();
+	if (pending.lightsChanged) core->SetLights( pending.areaLights.data(), (int)pending.areaLights.size(),
+		pending.pointLights.data(), (int)pending.pointLights.size(),
+		pending.spotLights.data(), (int)pending.spotLights.size(),
+		pending.directionalLights.data(), (int)pending.directionalLights.size() );
+	committedStats = stats;
+	pending.Clear();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::SynchronizeSceneData                                         |
+//  |  Send modified data to the RenderCore layer. In pipelined mode, this sends  |
+//  |  the update that was prepared during the previous call, and starts          |
+//  |  preparing the next one on a worker thread, so that it overlaps with        |
+//  |  rendering. The scene may then not be modified until WaitForSceneSync       |
+//  |  returns; the result is one frame of latency for scene changes.       LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::SynchronizeSceneData()
+{
+	if (!pipelined)
+	{
+		PrepareSceneData();
+		CommitSceneData();
+		return;
+	}
+	WaitForSceneSync();
+	CommitSceneData();
+	syncThread.renderSystem = this;
+	syncThread.start();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::SetPipelinedSync                                             |
+//  |  Enable or disable pipelined scene synchronization.                   LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::SetPipelinedSync( const bool enabled )
+{
+	if (enabled == pipelined) return;
+	WaitForSceneSync();
+	if (!enabled) CommitSceneData(); // don't lose the update that was prepared last
+	pipelined = enabled;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  RenderSystem::WaitForSceneSync                                             |
+//  |  Fence: returns when the worker thread finished preparing the scene update, |
+//  |  after which the scene may be safely modified again.                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void RenderSystem::WaitForSceneSync()
+{
+	if (syncThread.thread.joinable()) syncThread.thread.join();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  SceneSyncThread::run                                                       |
+//  |  Prepare a scene update on the worker thread.                         LH2'19|
+//  +-----------------------------------------------------------------------------+
+void SceneSyncThread::run()
+{
+	renderSystem->PrepareSceneData();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  SceneUpdate::Clear                                                         |
+//  |  Reset after the update has been sent to the core.                    LH2'19|
+//  +-----------------------------------------------------------------------------+
+void SceneUpdate::Clear()
+{
+	skyChanged = materialsChanged = instancesChanged = toplevelChanged = lightsChanged = false;
+	dirtyTextures.clear();
+	dirtyMeshes.clear();
+	dirtyMeshRanges.clear();
+	dirtyInstances.clear();
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem::Render                                                       |
 //  |  Produce one image.                                                   LH2'19|
@@ -293,10 +646,16 @@ int RenderSystem::GetTriangleNode(const int coreInstId, const int coreTriId)
 //  +-----------------------------------------------------------------------------+
 void RenderSystem::Shutdown()
 {
+	// wait for the worker thread
+	WaitForSceneSync();
+	WaitForRayQueries();
 	// delete scene
+	delete hostBVH;
 	delete scene;
 	// shutdown core
 	core->Shutdown();
+	// stop the worker threads; each core DLL stops its own
+	JobSystem::Shutdown();
 }
 
 // EOF
\ No newline at end of file
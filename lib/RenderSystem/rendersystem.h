@@ -17,6 +17,7 @@
 
 #include "system.h"
 #include "core_api_base.h"
+#include "core_api_recorder.h"
 #ifdef RENDERSYSTEMBUILD
 // we will not expose these to the host application
 #define TINYGLTF_NO_STB_IMAGE_WRITE
@@ -47,6 +48,8 @@ typedef int tinyobjMaterial;
 #include "host_texture.h"
 #include "host_material.h"
 #include "host_mesh.h"
+#include "host_bvh.h"
+#include "host_rayquery.h"
 #include "host_light.h"
 #include "host_skydome.h"
 #include "camera.h"
@@ -71,6 +74,44 @@ struct RenderSettings
 	uint TAAEnabled = 1;
 };
 
+//  +-----------------------------------------------------------------------------+
+//  |  SceneUpdate                                                                |
+//  |  Staging area for scene changes: filled by RenderSystem::PrepareSceneData,  |
+//  |  consumed by RenderSystem::CommitSceneData. Mesh, texture and sky data are  |
+//  |  not copied; the committing thread reads these from the scene.        LH2'19|
+//  +-----------------------------------------------------------------------------+
+struct SceneUpdate
+{
+	void Clear();
+	bool skyChanged = false;				// sky dome needs to be sent
+	vector<int> dirtyTextures;				// textures that need to be sent
+	bool materialsChanged = false;			// materials need to be sent
+	vector<CoreMaterial> materials;			// converted material data
+	vector<CoreMaterialEx> materialsEx;
+	vector<int> dirtyMeshes;				// meshes that need to be sent
+	vector<vector<int2>> dirtyMeshRanges;	// per dirty mesh: modified triangle ranges, or empty if the full mesh needs to be sent
+	bool toplevelChanged = false;			// meshes were updated in place; top-level BVH needs an update
+	bool instancesChanged = false;			// instances need to be sent; top-level BVH needs an update
+	vector<int2> dirtyInstances;			// (first, count) ranges of modified instances
+	bool lightsChanged = false;				// lights need to be sent
+	vector<CoreLightTri> areaLights;		// converted light data
+	vector<CorePointLight> pointLights;
+	vector<CoreSpotLight> spotLights;
+	vector<CoreDirectionalLight> directionalLights;
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  SceneSyncThread                                                            |
+//  |  Worker thread for pipelined scene synchronization.                   LH2'19|
+//  +-----------------------------------------------------------------------------+
+class RenderSystem;
+class SceneSyncThread : public Thread
+{
+public:
+	void run();
+	RenderSystem* renderSystem = nullptr;
+};
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderSystem                                                               |
 //  |  High-level API.                                                      LH2'19|
@@ -79,17 +120,25 @@ class RenderSystem
 {
 public:
 	// methods
-	void Init( const char* dllName );
+	void Init( const char* dllName, const char* traceFile = 0 );
 	void SynchronizeSceneData();
+	void SetPipelinedSync( const bool enabled );
+	void WaitForSceneSync();
+	void PrepareSceneData();
 	void Render( const ViewPyramid& view, Convergence converge );
 	void SetTarget( GLTexture* target, const uint spp );
+	void SetTarget( Bitmap* target, const uint spp );
 	void SetProbePos( int2 pos ) { if (core) core->SetProbePos( pos ); }
 	int GetTriangleMaterial( const int coreInstId, const int coreTriId );
 	int GetTriangleMesh( const int coreInstId, const int coreTriId );
 	int GetTriangleNode(const int coreInstId, const int coreTriId);
+	void EnableHostBVH( const bool enabled );
+	const HostSceneBVH* GetHostBVH() const { return hostBVH; }
+	RayQueryBatch* QueryRays( const HostRay* rays, const int rayCount, const RayQueryType type );
+	void WaitForRayQueries();
 	void Shutdown();
 	CoreStats GetCoreStats() { return core ? core->GetCoreStats() : CoreStats(); }
-	SystemStats GetSystemStats() { return stats; }
+	SystemStats GetSystemStats() { return committedStats; }
 private:
 	// private methods
 	void SynchronizeSky();
@@ -98,13 +147,27 @@ private:
 	void SynchronizeMeshes();
 	void SynchronizeLights();
 	void UpdateSceneGraph();
+	void UpdateHostBVH();
+	void CommitSceneData();
 private:
 	// private data members
 	CoreAPI_Base* core = nullptr;			// low-level rendering functionality
 	GLTexture* renderTarget = nullptr;		// CUDA will render to this OpenGL texture
 	bool meshesChanged = false;				// rebuild scene graph if a mesh was rebuilt / refit
-	SystemStats stats;						// performance counters
+	int coreTextureCount = -1;				// number of textures the core received in the last SetTextures call
+	vector<uint2> textureSizes;				// texture dimensions at the last sync; a resize invalidates the materials
+	uint textureChanges = 0, materialChanges = 0, meshChanges = 0, nodeChanges = 0; // ChangeCounter values at last sync
+	uint areaLightChanges = 0, pointLightChanges = 0, spotLightChanges = 0, directionalLightChanges = 0;
+	SystemStats stats;						// performance counters, updated by PrepareSceneData
+	SystemStats committedStats;				// performance counters for the most recently committed update
+	SceneUpdate pending;					// changes that have been prepared but not yet sent to the core
+	bool pipelined = false;					// prepare scene updates on a worker thread, see SynchronizeSceneData
+	SceneSyncThread syncThread;				// worker thread for pipelined scene synchronization
 	vector<int> instances;					// node indices that have been sent to the core as instances
+	vector<int> instanceMeshIDs;			// mesh ids of the instances, as sent to the core
+	vector<mat4> instanceTransforms;		// transforms of the instances, as sent to the core
+	HostSceneBVH* hostBVH = nullptr;		// host-side copy of the acceleration structure; null unless enabled
+	JobCounter rayQueryJobs;				// unfinished ray query chunks, of all batches
 public:
 	// public data members
 	HostScene* scene = nullptr;				// scene I/O and management module
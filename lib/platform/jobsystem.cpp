@@ -0,0 +1,218 @@
+/* jobsystem.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   Implementation of the job system.
+*/
+
+#include "platform.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+namespace {
+
+// a deque of jobs; the owning worker uses the back, other threads steal from the front
+struct WorkQueue
+{
+	std::mutex lock;
+	std::deque<Job*> jobs;
+};
+
+class JobWorker : public Thread
+{
+public:
+	void run();
+	int idx = 0;
+};
+
+struct JobSystemState
+{
+	vector<WorkQueue*> queues;			// one per worker, plus a shared queue for other threads (last)
+	vector<JobWorker*> workers;
+	std::atomic<int> queued = { 0 };	// number of jobs in the queues
+	std::mutex sleepLock;				// idle workers wait on wakeUp
+	std::condition_variable wakeUp;
+	bool quit = false;					// protected by sleepLock
+};
+
+std::mutex initLock;
+std::atomic<JobSystemState*> state = { nullptr };
+thread_local int workerIdx = -1;		// index of the calling worker, -1 for other threads
+
+JobSystemState& State()
+{
+	JobSystemState* s = state.load( std::memory_order_acquire );
+	if (!s) JobSystem::Init(), s = state.load( std::memory_order_acquire );
+	return *s;
+}
+
+// take a job: own queue first (newest job), then the shared queue, then steal (oldest job) from the other workers
+Job* TakeJob( JobSystemState& s )
+{
+	if (s.queued.load( std::memory_order_relaxed ) <= 0) return nullptr;
+	const int queueCount = (int)s.queues.size(), own = workerIdx >= 0 ? workerIdx : queueCount - 1;
+	for (int i = 0; i < queueCount; i++)
+	{
+		const int q = (own + i) % queueCount;
+		WorkQueue& queue = *s.queues[q];
+		std::lock_guard<std::mutex> lock( queue.lock );
+		if (queue.jobs.empty()) continue;
+		Job* job;
+		if (q == workerIdx) job = queue.jobs.back(), queue.jobs.pop_back();
+		else job = queue.jobs.front(), queue.jobs.pop_front();
+		s.queued--;
+		return job;
+	}
+	return nullptr;
+}
+
+void Enqueue( JobSystemState& s, Job* job )
+{
+	WorkQueue& queue = *s.queues[workerIdx >= 0 ? workerIdx : s.queues.size() - 1];
+	{
+		std::lock_guard<std::mutex> lock( queue.lock );
+		queue.jobs.push_back( job );
+	}
+	s.queued++;
+	// take the lock, so a worker that just found the queues empty is waiting by now
+	{ std::lock_guard<std::mutex> lock( s.sleepLock ); }
+	s.wakeUp.notify_one();
+}
+
+void RunJob( JobSystemState& s, Job* job )
+{
+	job->task();
+	for (Job* dependent : job->dependents) if (--dependent->unmet == 0) Enqueue( s, dependent );
+	if (job->counter) job->counter->value.fetch_sub( 1, std::memory_order_release );
+	delete job;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  JobWorker::run                                                             |
+//  |  Execute jobs until the job system shuts down.                        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void JobWorker::run()
+{
+	workerIdx = idx;
+	JobSystemState& s = *state.load();
+	while (1)
+	{
+		Job* job = TakeJob( s );
+		if (job) { RunJob( s, job ); continue; }
+		std::unique_lock<std::mutex> lock( s.sleepLock );
+		s.wakeUp.wait( lock, [&s]() { return s.queued > 0 || s.quit; } );
+		if (s.quit && s.queued <= 0) break;
+	}
+}
+
+} // namespace
+
+//  +-----------------------------------------------------------------------------+
+//  |  JobSystem::Init                                                            |
+//  |  Start the worker threads.                                            LH2'19|
+//  +-----------------------------------------------------------------------------+
+void JobSystem::Init( const int workerCount, const bool pinWorkers )
+{
+	std::lock_guard<std::mutex> lock( initLock );
+	if (state.load()) return;
+	JobSystemState* s = new JobSystemState();
+	const int hardwareThreads = (int)std::thread::hardware_concurrency();
+	const int count = workerCount > 0 ? workerCount : max( 0, hardwareThreads / 2 - 1 );
+	for (int i = 0; i <= count; i++) s->queues.push_back( new WorkQueue() );
+	state.store( s, std::memory_order_release );
+	for (int i = 0; i < count; i++)
+	{
+		JobWorker* worker = new JobWorker();
+		worker->idx = i;
+		s->workers.push_back( worker );
+		worker->start( pinWorkers && hardwareThreads > 1 ? (i + 1) % hardwareThreads : -1 );
+	}
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  JobSystem::Shutdown                                                        |
+//  |  Finish the queued jobs and stop the worker threads.                  LH2'19|
+//  +-----------------------------------------------------------------------------+
+void JobSystem::Shutdown()
+{
+	std::lock_guard<std::mutex> lock( initLock );
+	JobSystemState* s = state.load();
+	if (!s) return;
+	{
+		std::lock_guard<std::mutex> sleepLock( s->sleepLock );
+		s->quit = true;
+	}
+	s->wakeUp.notify_all();
+	for (JobWorker* worker : s->workers) worker->thread.join(), delete worker;
+	// jobs submitted by other threads are executed here if there are no workers
+	while (Job* job = TakeJob( *s )) RunJob( *s, job );
+	for (WorkQueue* queue : s->queues) delete queue;
+	state.store( nullptr );
+	delete s;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  JobSystem::WorkerCount                                                     |
+//  |  Number of worker threads, excluding the calling thread.              LH2'19|
+//  +-----------------------------------------------------------------------------+
+int JobSystem::WorkerCount()
+{
+	return (int)State().workers.size();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  JobSystem::Create / AddDependency / Submit                                 |
+//  |  Build and queue jobs.                                                LH2'19|
+//  +-----------------------------------------------------------------------------+
+Job* JobSystem::Create( const std::function<void()>& task, JobCounter* counter )
+{
+	Job* job = new Job();
+	job->task = task;
+	job->counter = counter;
+	if (counter) counter->value++;
+	return job;
+}
+void JobSystem::AddDependency( Job* job, Job* dependency )
+{
+	job->unmet++;
+	dependency->dependents.push_back( job );
+}
+void JobSystem::Submit( Job* job )
+{
+	// remove the submit reference; the last finished dependency queues the job otherwise
+	if (--job->unmet == 0) Enqueue( State(), job );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  JobSystem::Wait / Execute                                                  |
+//  |  The waiting thread executes jobs until the counter reaches zero: it never  |
+//  |  sleeps on a lock, and a job may wait for the jobs it created.        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void JobSystem::Wait( const JobCounter& counter )
+{
+	while (!counter.Done()) if (!Execute()) std::this_thread::yield();
+}
+bool JobSystem::Execute()
+{
+	JobSystemState& s = State();
+	Job* job = TakeJob( s );
+	if (!job) return false;
+	RunJob( s, job );
+	return true;
+}
+
+// EOF
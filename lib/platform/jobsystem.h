@@ -0,0 +1,112 @@
+/* jobsystem.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   Portable job system. Each worker owns a deque: it pushes and pops jobs
+   at the back, idle workers steal from the front. Threads that are not
+   workers (e.g. the main thread) submit to a shared queue, and execute
+   jobs while they wait for a JobCounter, so a join never blocks on a
+   lock. Jobs can depend on other jobs; a job is queued once all of the
+   jobs it depends on have finished.
+
+   Note: platform is a static library, so each render core DLL has its own
+   pool of workers, next to the one of the RenderSystem and application.
+   With pipelined synchronization both pools are busy at the same time;
+   the default worker count therefore uses half of the hardware threads.
+   Each module stops its own workers with Shutdown.
+*/
+
+#pragma once
+
+#include <functional>
+
+namespace lighthouse2
+{
+
+// counter of unfinished jobs; a thread can wait for it to reach zero
+struct JobCounter
+{
+	JobCounter() = default;
+	JobCounter( const JobCounter& ) = delete;
+	bool Done() const { return value.load( std::memory_order_acquire ) == 0; }
+	std::atomic<int> value = { 0 };
+};
+
+// a unit of work; created by JobSystem::Create, deleted by the job system once it has run
+struct Job
+{
+	std::function<void()> task;
+	JobCounter* counter = nullptr;		// decremented when the job finishes
+	std::atomic<int> unmet = { 1 };		// unfinished dependencies, plus one until the job is submitted
+	std::vector<Job*> dependents;		// jobs that wait for this job
+};
+
+//  +-----------------------------------------------------------------------------+
+//  |  JobSystem                                                                  |
+//  |  Pool of worker threads with work-stealing deques.                    LH2'19|
+//  +-----------------------------------------------------------------------------+
+class JobSystem
+{
+public:
+	// Init: start the workers; workerCount 0 uses half of the hardware threads, including the calling thread.
+	// Optionally pin worker i to core i + 1, leaving core 0 to the main thread. Called implicitly on first use.
+	static void Init( const int workerCount = 0, const bool pinWorkers = false );
+	// Shutdown: finish all queued jobs and stop the workers.
+	static void Shutdown();
+	static int WorkerCount();
+	// Create: allocate a job. If counter is specified, it is incremented now and decremented when the job finishes.
+	static Job* Create( const std::function<void()>& task, JobCounter* counter = nullptr );
+	// AddDependency: job will not start before dependency finished. Call this before submitting either job.
+	static void AddDependency( Job* job, Job* dependency );
+	// Submit: hand a job to the workers; it runs as soon as its dependencies are met.
+	static void Submit( Job* job );
+	// Run: create and submit a job without dependencies.
+	static void Run( const std::function<void()>& task, JobCounter* counter ) { Submit( Create( task, counter ) ); }
+	// Wait: execute jobs on the calling thread until the counter reaches zero.
+	static void Wait( const JobCounter& counter );
+	// Execute: run one queued job on the calling thread; returns false if there was none.
+	static bool Execute();
+};
+
+// parallel_for: call func( i ) for i in [first, last), in parallel, in chunks of (at least) grain
+// iterations. The calling thread takes part in the work and returns when all iterations are done.
+template <class F> void parallel_for( const int first, const int last, const int grain, const F& func )
+{
+	const int count = last - first;
+	if (count <= 0) return;
+	const int chunkSize = max( 1, grain ), chunkCount = (count + chunkSize - 1) / chunkSize;
+	if (chunkCount == 1 || JobSystem::WorkerCount() == 0)
+	{
+		for (int i = first; i < last; i++) func( i );
+		return;
+	}
+	JobCounter counter;
+	for (int c = 1; c < chunkCount; c++) JobSystem::Run( [&func, first, last, chunkSize, c]() {
+		for (int i = first + c * chunkSize, e = min( last, i + chunkSize ); i < e; i++) func( i );
+	}, &counter );
+	// the first chunk runs on the calling thread
+	for (int i = first, e = min( last, first + chunkSize ); i < e; i++) func( i );
+	JobSystem::Wait( counter );
+}
+template <class F> void parallel_for( const int first, const int last, const F& func )
+{
+	// default grain: roughly four chunks per thread
+	const int threads = JobSystem::WorkerCount() + 1;
+	parallel_for( first, last, (last - first + threads * 4 - 1) / (threads * 4), func );
+}
+
+} // namespace lighthouse2
+
+// EOF
@@ -24,6 +24,9 @@
 */
 
 #include "platform.h"
+#ifdef __linux__
+#include <pthread.h>
+#endif
 
 #pragma comment( linker, "/subsystem:windows /ENTRY:mainCRTStartup" )
 
@@ -32,13 +35,20 @@
 //  |  Entry point for threads.                                             LH2'19|
 //  +-----------------------------------------------------------------------------+
 uint sthread_proc( void* param ) { Thread* tp = (Thread*)param; tp->run(); return 0; }
-void Thread::start()
+void Thread::start( const int core )
 {
 	thread = std::thread( sthread_proc, this );
 #ifdef _MSC_VER
 	SetThreadPriority( thread.native_handle(), THREAD_PRIORITY_NORMAL );
-#else
-	// pthread_setschedprio(thread.native_handle(), ...);
+	if (core >= 0) SetThreadAffinityMask( thread.native_handle(), (DWORD_PTR)1 << core );
+#elif defined(__linux__)
+	if (core >= 0)
+	{
+		cpu_set_t cpus;
+		CPU_ZERO( &cpus );
+		CPU_SET( core, &cpus );
+		pthread_setaffinity_np( thread.native_handle(), sizeof( cpu_set_t ), &cpus );
+	}
 #endif
 }
 
@@ -244,6 +254,126 @@ void GLTexture::CopyTo( Bitmap* dst )
 	CheckGL();
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  CPUTarget::SetTarget                                                       |
+//  |  Present frames in an OpenGL texture, via two pixel unpack buffers.   LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CPUTarget::SetTarget( GLTexture* target )
+{
+	hostTarget = 0;
+	if (pbo[0] && target->ID == textureID && target->width == width && target->height == height) return;
+	Release();
+	textureID = target->ID, width = target->width, height = target->height;
+	// specify the texture storage once; frames are uploaded with glTexSubImage2D
+	glBindTexture( GL_TEXTURE_2D, textureID );
+	glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0 );
+	const GLsizeiptr bytes = (GLsizeiptr)width * height * sizeof( uint );
+	persistent = GLAD_GL_VERSION_4_4 != 0;
+	glGenBuffers( 2, pbo );
+	for (int i = 0; i < 2; i++)
+	{
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo[i] );
+		if (persistent)
+		{
+			// coherent: writes through the pointer are visible to the upload without an explicit flush
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage( GL_PIXEL_UNPACK_BUFFER, bytes, 0, flags );
+			mapped[i] = (uint*)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags );
+		}
+		else glBufferData( GL_PIXEL_UNPACK_BUFFER, bytes, 0, GL_STREAM_DRAW );
+	}
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	CheckGL();
+	current = 0;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CPUTarget::SetHostTarget                                                   |
+//  |  Write frames to a caller-provided buffer (offscreen mode).           LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CPUTarget::SetHostTarget( Bitmap* target )
+{
+	Release();
+	hostTarget = target;
+	width = target->width, height = target->height;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CPUTarget::Pixels                                                          |
+//  |  Obtain the buffer for the next frame. Waits if the upload of the frame     |
+//  |  that last used it did not complete yet.                              LH2'19|
+//  +-----------------------------------------------------------------------------+
+uint* CPUTarget::Pixels()
+{
+	if (hostTarget) return hostTarget->pixels;
+	if (!pbo[0]) return 0;
+	if (fence[current])
+	{
+		const GLsync sync = (GLsync)fence[current];
+		while (glClientWaitSync( sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000 ) == GL_TIMEOUT_EXPIRED);
+		glDeleteSync( sync );
+		fence[current] = 0;
+	}
+	if (!mapped[current])
+	{
+		// orphan the storage: the driver hands out fresh memory if the previous upload still uses the old block
+		const GLsizeiptr bytes = (GLsizeiptr)width * height * sizeof( uint );
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo[current] );
+		glBufferData( GL_PIXEL_UNPACK_BUFFER, bytes, 0, GL_STREAM_DRAW );
+		mapped[current] = (uint*)glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT );
+		glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+		CheckGL();
+	}
+	return mapped[current];
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CPUTarget::Present                                                         |
+//  |  Start the upload of the frame in Pixels() to the texture, and switch to    |
+//  |  the other buffer. The upload completes asynchronously.               LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CPUTarget::Present()
+{
+	if (hostTarget || !pbo[0]) return;
+	Pixels(); // make sure the buffer is mapped, in case the caller did not ask for it
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, pbo[current] );
+	if (!persistent) glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER ), mapped[current] = 0;
+	glBindTexture( GL_TEXTURE_2D, textureID );
+	glTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0 /* offset in the bound buffer */ );
+	// unbind, so client-side pointers work again for other glTexImage2D calls
+	glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+	if (persistent) fence[current] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	CheckGL();
+	current ^= 1;
+}
+void CPUTarget::Present( const uint* pixels )
+{
+	// for cores that render into a buffer of their own: a sequential copy, which suits write-combined memory
+	uint* dst = Pixels();
+	if (dst && dst != pixels) memcpy( dst, pixels, (size_t)width * height * sizeof( uint ) );
+	Present();
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  CPUTarget::Release                                                         |
+//  |  Free the OpenGL resources; requires a current OpenGL context.        LH2'19|
+//  +-----------------------------------------------------------------------------+
+void CPUTarget::Release()
+{
+	for (int i = 0; i < 2; i++)
+	{
+		if (fence[i]) glDeleteSync( (GLsync)fence[i] ), fence[i] = 0;
+		mapped[i] = 0; // deleting a buffer unmaps it
+	}
+	if (pbo[0])
+	{
+		glDeleteBuffers( 2, pbo );
+		pbo[0] = pbo[1] = 0;
+		CheckGL();
+	}
+	textureID = 0;
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  Shader class implementation.                                         LH2'19|
 //  +-----------------------------------------------------------------------------+
@@ -78,6 +78,39 @@ private:
 	uint ID = 0;		// shader program identifier
 };
 
+// CPUTarget: presentation of frames rendered on the CPU. Frames go to an OpenGL texture via two pixel unpack
+// buffers, so the texture upload of frame N overlaps the rendering of frame N+1; the buffers are persistently
+// mapped if the driver supports it (GL 4.4), and orphaned and remapped per frame otherwise. Alternatively, frames
+// go straight to a caller-provided host buffer (offscreen mode), without OpenGL.
+// Usage: render into Pixels(), then call Present(); or render into a buffer of your own and pass it to Present.
+// Pixels() may point to write-combined memory: write only, sequentially if possible; never read.
+class CPUTarget
+{
+public:
+	// constructor / destructor
+	CPUTarget() = default;
+	~CPUTarget() { Release(); }
+	// methods
+	void SetTarget( GLTexture* target );
+	void SetHostTarget( Bitmap* target );
+	uint* Pixels();
+	void Present();
+	void Present( const uint* pixels );
+	bool Offscreen() const { return hostTarget != 0; }
+	void Release();
+	// public data members
+	uint width = 0, height = 0;
+private:
+	// data members
+	Bitmap* hostTarget = 0;				// offscreen mode: frames are written here directly
+	uint textureID = 0;					// OpenGL texture that receives the frames
+	uint pbo[2] = { 0, 0 };				// pixel unpack buffers (GLuint)
+	uint* mapped[2] = { 0, 0 };			// CPU pointers to the buffers; persistent, or valid between Pixels and Present
+	void* fence[2] = { 0, 0 };			// per buffer: GLsync of the last upload from it
+	int current = 0;					// buffer that receives the next frame
+	bool persistent = false;			// buffers stay mapped for their entire lifetime
+};
+
 } // namespace lighthouse2
 
 // forward declarations of platform-specific helpers
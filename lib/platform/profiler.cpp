@@ -0,0 +1,125 @@
+/* profiler.cpp - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   Implementation of the CPU profiler.
+*/
+
+#include "platform.h"
+
+#include <mutex>
+
+std::atomic<bool> Profiler::enabled = { false };
+
+namespace {
+
+// zones recorded by a single thread; kept after the thread exits, so they can still be exported
+struct ThreadZones
+{
+	vector<Profiler::Zone> ring;
+	std::atomic<uint64_t> count = { 0 };	// zones recorded since the last Clear
+	uint depth = 0;							// current nesting level
+	uint threadIdx = 0;
+};
+
+std::mutex threadsLock;
+vector<ThreadZones*> threads;
+thread_local ThreadZones* localZones = nullptr;
+const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+ThreadZones* LocalZones()
+{
+	if (localZones) return localZones;
+	ThreadZones* zones = new ThreadZones();
+	zones->ring.resize( PROFILER_RING_SIZE );
+	std::lock_guard<std::mutex> lock( threadsLock );
+	zones->threadIdx = (uint)threads.size();
+	threads.push_back( zones );
+	return localZones = zones;
+}
+
+} // namespace
+
+//  +-----------------------------------------------------------------------------+
+//  |  Profiler::Enable / Clear                                                   |
+//  |  Control the capture.                                                 LH2'19|
+//  +-----------------------------------------------------------------------------+
+void Profiler::Enable( const bool on )
+{
+	enabled.store( on );
+}
+void Profiler::Clear()
+{
+	std::lock_guard<std::mutex> lock( threadsLock );
+	for (ThreadZones* zones : threads) zones->count = 0;
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  Profiler::Now / Enter / Leave                                              |
+//  |  Zone recording. Leave writes the zone to the ring buffer of the calling    |
+//  |  thread; only that thread writes to it, so no lock is needed.         LH2'19|
+//  +-----------------------------------------------------------------------------+
+int64_t Profiler::Now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+uint Profiler::Enter()
+{
+	return LocalZones()->depth++;
+}
+void Profiler::Leave( const char* name, const int64_t start, const uint depth )
+{
+	const int64_t end = Now();
+	ThreadZones* zones = LocalZones();
+	zones->depth = depth;
+	const uint64_t idx = zones->count.load( std::memory_order_relaxed );
+	Zone& zone = zones->ring[idx & (PROFILER_RING_SIZE - 1)];
+	zone.name = name, zone.start = start, zone.end = end, zone.depth = depth;
+	zones->count.store( idx + 1, std::memory_order_release );
+}
+
+//  +-----------------------------------------------------------------------------+
+//  |  Profiler::ExportChromeTrace                                                |
+//  |  Write all captured zones as 'complete' events (ph X), with time stamps in  |
+//  |  microseconds. Viewers reconstruct the hierarchy from the nesting of the    |
+//  |  zones per thread.                                                    LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool Profiler::ExportChromeTrace( const char* fileName )
+{
+	FILE* f = fopen( fileName, "w" );
+	if (!f) return false;
+	std::lock_guard<std::mutex> lock( threadsLock );
+	fprintf( f, "{\"traceEvents\":[\n" );
+	bool first = true;
+	for (ThreadZones* zones : threads)
+	{
+		fprintf( f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"thread %u\"}}",
+			first ? "" : ",\n", zones->threadIdx, zones->threadIdx );
+		first = false;
+		const uint64_t count = zones->count.load( std::memory_order_acquire );
+		const uint64_t oldest = count > PROFILER_RING_SIZE ? count - PROFILER_RING_SIZE : 0;
+		for (uint64_t i = oldest; i < count; i++)
+		{
+			const Zone& zone = zones->ring[i & (PROFILER_RING_SIZE - 1)];
+			fprintf( f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"depth\":%u}}",
+				zone.name, zones->threadIdx, zone.start * 0.001, (zone.end - zone.start) * 0.001, zone.depth );
+		}
+	}
+	fprintf( f, "\n]}\n" );
+	fclose( f );
+	return true;
+}
+
+// EOF
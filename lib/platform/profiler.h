@@ -0,0 +1,94 @@
+/* profiler.h - Copyright 2019 Utrecht University
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+	   http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License.
+
+   This file:
+
+   Hierarchical CPU profiler. PROFILE_ZONE( "name" ) measures the enclosing
+   scope; zones nest, and every thread records its zones in its own ring
+   buffer, so the oldest zones are overwritten once a buffer is full.
+   Capture is off by default; a disabled zone costs one flag test. With
+   PROFILING set to 0, zones compile to nothing.
+   The captured zones can be exported to the Chrome trace format (JSON),
+   for viewing in chrome://tracing or https://ui.perfetto.dev.
+
+   Note: platform is a static library, so each render core DLL has its own
+   profiler; zones recorded in a core are exported by that core.
+*/
+
+#pragma once
+
+#ifndef PROFILING
+#define PROFILING 1
+#endif
+
+#define PROFILER_RING_SIZE	65536		// zones per thread; must be a power of two
+
+namespace lighthouse2
+{
+
+//  +-----------------------------------------------------------------------------+
+//  |  Profiler                                                                   |
+//  |  Per-thread zone capture and Chrome trace export.                     LH2'19|
+//  +-----------------------------------------------------------------------------+
+class Profiler
+{
+public:
+	struct Zone
+	{
+		const char* name;				// string literal; only the pointer is stored
+		int64_t start, end;				// nanoseconds since the profiler epoch
+		uint depth;						// nesting level on the recording thread
+	};
+	// Enable: start or stop capturing zones.
+	static void Enable( const bool enabled );
+	static bool Enabled() { return enabled.load( std::memory_order_relaxed ); }
+	// Clear: discard all captured zones.
+	static void Clear();
+	// ExportChromeTrace: write the captured zones as a Chrome trace; call while capture is disabled.
+	static bool ExportChromeTrace( const char* fileName );
+	// used by ProfileZone
+	static int64_t Now();
+	static uint Enter();
+	static void Leave( const char* name, const int64_t start, const uint depth );
+private:
+	static std::atomic<bool> enabled;
+};
+
+// records the lifetime of a scope, if capture is enabled when the scope is entered
+class ProfileZone
+{
+public:
+	ProfileZone( const char* zoneName )
+	{
+		if (!Profiler::Enabled()) return;
+		name = zoneName, depth = Profiler::Enter(), start = Profiler::Now();
+	}
+	~ProfileZone() { if (name) Profiler::Leave( name, start, depth ); }
+private:
+	const char* name = nullptr;
+	int64_t start = 0;
+	uint depth = 0;
+};
+
+} // namespace lighthouse2
+
+#if PROFILING == 1
+#define PROFILE_CONCAT_( a, b ) a##b
+#define PROFILE_CONCAT( a, b ) PROFILE_CONCAT_( a, b )
+#define PROFILE_ZONE( name ) lighthouse2::ProfileZone PROFILE_CONCAT( profileZone, __LINE__ )( name )
+#else
+#define PROFILE_ZONE( name )
+#endif
+
+// EOF
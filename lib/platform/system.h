@@ -20,6 +20,7 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cstdarg>
@@ -28,10 +29,12 @@
 #include <ctime>
 #include <fstream>
 #include <half.hpp>
-#include <ppl.h>
+#include <map>
 #include <ratio>
 #include <string>
 #include <thread>
+#include <type_traits>
+#include <typeinfo>
 #include <vector>
 
 using namespace std;
@@ -42,7 +45,6 @@ using namespace half_float;
 #include "common_types.h"
 #include "common_settings.h"
 #include "common_classes.h"
-#include <GLFW/glfw3.h>		// needed for Timer class
 
 // https://devblogs.microsoft.com/cppblog/msvc-preprocessor-progress-towards-conformance/
 // MSVC _Should_ support this extended functionality for the token-paste operator:
@@ -77,7 +79,9 @@ using namespace half_float;
 class Thread
 {
 public:
-	void start();
+	virtual ~Thread() = default;
+	// start: launch the thread; optionally pin it to a core.
+	void start( const int core = -1 );
 	inline virtual void run() {};
 	std::thread thread;
 };
@@ -183,7 +187,35 @@ __inline uint64_t calccrc64( unsigned char* pbData, int len )
 		crc = crc64_table[t] ^ (crc << 8);
 	return crc ^ CLEARCRC64;
 }
-#define TRACKCHANGES public: bool Changed() { uint64_t currentcrc = crc64; \
+
+// change tracking
+// TRACKCHANGES adds a generation counter to a class. MarkAsDirty bumps it; Changed() reports whether it moved
+// since the previous call. Any modification of a tracked object must thus be followed by a MarkAsDirty call.
+// Besides the per-object counter, ChangeCounter<T> counts modifications (and constructions) for the whole type,
+// so the RenderSystem can skip an object pool entirely if nothing in it changed. With VERIFYCHANGES defined
+// (see common_settings.h), Changed() also compares a crc64 of the object against the previous call and reports
+// modifications that were not flagged. Code that updates derived data of an object after calling Changed()
+// should call Changed() once more to prevent false positives. The per-type counters are atomic, so distinct
+// objects may be modified from worker threads.
+// TRACKCHANGES_CRC64 provides the same interface based on a checksum only; this is meant for objects that are
+// modified in-place by application code, e.g. the camera.
+template <class T> struct ChangeCounter { static atomic<uint> value; };
+template <class T> atomic<uint> ChangeCounter<T>::value( 0 );
+#ifdef VERIFYCHANGES
+#define VERIFYCHANGES_DATA uint64_t verifycrc = 0;
+#define VERIFYCHANGES_CHECK( changed ) { const uint64_t prevcrc = verifycrc; verifycrc = 0; \
+verifycrc = calccrc64( (uchar*)this, sizeof( *this ) ); if (!(changed) && prevcrc != 0 && prevcrc != verifycrc) \
+printf( "%s: object was modified without MarkAsDirty.\n", typeid( *this ).name() ); }
+#else
+#define VERIFYCHANGES_DATA
+#define VERIFYCHANGES_CHECK( changed )
+#endif
+#define TRACKCHANGES public: bool Changed() { const bool changed = generation != syncedGeneration; \
+syncedGeneration = generation; VERIFYCHANGES_CHECK( changed ); return changed; } \
+void MarkAsDirty() { generation++; ChangeCounter<remove_pointer<decltype(this)>::type>::value++; } \
+private: uint generation = ++ChangeCounter<remove_pointer<decltype(this)>::type>::value, syncedGeneration = 0; \
+VERIFYCHANGES_DATA
+#define TRACKCHANGES_CRC64 public: bool Changed() { uint64_t currentcrc = crc64; \
 crc64 = CLEARCRC64; uint64_t newcrc = calccrc64( (uchar*)this, sizeof( *this ) ); \
 bool changed = newcrc != currentcrc; crc64 = newcrc; return changed; } \
 void MarkAsDirty() { dirty++; } \
@@ -236,7 +268,7 @@ public:
 	};
 	// constructor / destructor
 	GLTexture( uint width, uint height, uint type = DEFAULT );
-	GLTexture( const char* fileName, int filter = GL_NEAREST );
+	GLTexture( const char* fileName, int filter = 0x2600 /* GL_NEAREST; system.h does not include OpenGL */ );
 	~GLTexture();
 	// methods
 	void Bind();
@@ -244,12 +276,16 @@ public:
 	void CopyTo( Bitmap* dst );
 	// public data members
 public:
-	GLuint ID = 0;
+	uint ID = 0;						// OpenGL texture name (GLuint)
 	uint width = 0, height = 0;
 };
 
 } // namespace lighthouse2
 
+// job system and profiler
+#include "jobsystem.h"
+#include "profiler.h"
+
 // library namespace
 using namespace lighthouse2;
 
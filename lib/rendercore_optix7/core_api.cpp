@@ -109,6 +109,11 @@ void CoreAPI::SetGeometry( const int meshIdx, const float4* vertexData, const in
 	core->SetGeometry( meshIdx, vertexData, vertexCount, triangleCount, triangles, alphaFlags );
 }
 
+bool CoreAPI::UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount )
+{
+	return core->UpdateGeometry( meshIdx, vertexData, vertexCount, triangleCount, triangles, dirtyRanges, rangeCount );
+}
+
 void CoreAPI::SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform )
 {
 	core->SetInstance( instanceIdx, modelIdx, transform );
@@ -51,6 +51,8 @@ public:
 	void SetSkyData( const float3* pixels, const uint width, const uint height );
 	// SetGeometry: update the geometry for a single mesh.
 	void SetGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const uint* alphaFlags = 0 );
+	// UpdateGeometry: update the vertices of a mesh and refit its BVH.
+	bool UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount );
 	// SetInstance: update the data on a single instance.
 	void SetInstance( const int instanceIdx, const int modelIdx, const mat4& transform = mat4::Identity() );
 	// UpdateTopLevel: trigger a top-level BVH update.
@@ -66,18 +66,20 @@ void CoreMesh::SetGeometry( const float4* vertexData, const int vertexCount, con
 	buildInput.triangleArray.vertexBuffers = (CUdeviceptr*)positions4->DevPtrPtr();
 	buildInput.triangleArray.flags = inputFlags;
 	buildInput.triangleArray.numSbtRecords = 1;
-	// set acceleration structure build options
+	// set acceleration structure build options; animated meshes may be refitted later, see UpdateGeometry
 	buildOptions = {};
-	buildOptions.buildFlags = (allowCompaction ? OPTIX_BUILD_FLAG_ALLOW_COMPACTION : 0) | OPTIX_BUILD_FLAG_PREFER_FAST_TRACE;
+	buildOptions.buildFlags = (allowCompaction ? OPTIX_BUILD_FLAG_ALLOW_COMPACTION : OPTIX_BUILD_FLAG_ALLOW_UPDATE) | OPTIX_BUILD_FLAG_PREFER_FAST_TRACE;
 	buildOptions.operation = OPTIX_BUILD_OPERATION_BUILD;
+	refitCount = 0;
 	// determine buffer sizes for the acceleration structure
 	CHK_OPTIX( optixAccelComputeMemoryUsage( RenderCore::optixContext, &buildOptions, &buildInput, 1, &buildSizes ) );
 	uint compactedSizeOffset = roundUp<uint>( (uint)buildSizes.outputSizeInBytes, 8 );
 	// (re)allocate when needed
-	if (buildTemp == 0 || (size_t)buildTemp->GetSize() < buildSizes.tempSizeInBytes)
+	const size_t tempSize = max( buildSizes.tempSizeInBytes, allowCompaction ? 0 : buildSizes.tempUpdateSizeInBytes );
+	if (buildTemp == 0 || (size_t)buildTemp->GetSize() < tempSize)
 	{
 		delete buildTemp;
-		buildTemp = new CoreBuffer<uchar>( buildSizes.tempSizeInBytes, ON_DEVICE );
+		buildTemp = new CoreBuffer<uchar>( tempSize, ON_DEVICE );
 	}
 	if (buildBuffer == 0 || buildBuffer->GetSize() < compactedSizeOffset)
 	{
@@ -132,4 +134,30 @@ void CoreMesh::SetGeometry( const float4* vertexData, const int vertexCount, con
 	}
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  CoreMesh::UpdateGeometry                                                   |
+//  |  Copy the modified triangles and vertices to the device and refit the       |
+//  |  OptiX BVH. Returns false if the BVH does not allow updates; this is the    |
+//  |  case after the first build, which uses compaction instead.           LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool CoreMesh::UpdateGeometry( const float4* vertexData, const CoreTri* tris, const int2* dirtyRanges, const int rangeCount )
+{
+	if (!(buildOptions.buildFlags & OPTIX_BUILD_FLAG_ALLOW_UPDATE)) return false;
+	for (int i = 0; i < rangeCount; i++)
+	{
+		const int first = dirtyRanges[i].x, count = dirtyRanges[i].y;
+		CHK_CUDA( cudaMemcpy( triangles->DevPtr() + first, tris + first, count * sizeof( CoreTri4 ), cudaMemcpyHostToDevice ) );
+		CHK_CUDA( cudaMemcpy( positions4->DevPtr() + first * 3, vertexData + first * 3, count * 3 * sizeof( float4 ), cudaMemcpyHostToDevice ) );
+	}
+	// refit; rebuild now and then, as refitting degrades the quality of the BVH
+	const bool rebuild = ++refitCount == 64;
+	if (rebuild) refitCount = 0;
+	buildOptions.operation = rebuild ? OPTIX_BUILD_OPERATION_BUILD : OPTIX_BUILD_OPERATION_UPDATE;
+	CHK_OPTIX( optixAccelBuild( RenderCore::optixContext, 0, &buildOptions, &buildInput, 1,
+		(CUdeviceptr)buildTemp->DevPtr(), rebuild ? buildSizes.tempSizeInBytes : buildSizes.tempUpdateSizeInBytes,
+		gasData, buildSizes.outputSizeInBytes, &gasHandle, 0, 0 ) );
+	buildOptions.operation = OPTIX_BUILD_OPERATION_BUILD;
+	return true;
+}
+
 // EOF
\ No newline at end of file
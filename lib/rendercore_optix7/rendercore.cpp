@@ -342,6 +342,16 @@ void RenderCore::SetGeometry( const int meshIdx, const float4* vertexData, const
 	meshes[meshIdx]->SetGeometry( vertexData, vertexCount, triangleCount, triangles, alphaFlags );
 }
 
+//  +-----------------------------------------------------------------------------+
+//  |  RenderCore::UpdateGeometry                                                 |
+//  |  Update the vertices of a model without changing its topology.        LH2'19|
+//  +-----------------------------------------------------------------------------+
+bool RenderCore::UpdateGeometry( const int meshIdx, const float4* vertexData, const int vertexCount, const int triangleCount, const CoreTri* triangles, const int2* dirtyRanges, const int rangeCount )
+{
+	if (meshIdx >= meshes.size() || meshes[meshIdx]->triangleCount != triangleCount) return false;
+	return meshes[meshIdx]->UpdateGeometry( vertexData, triangles, dirtyRanges, rangeCount );
+}
+
 //  +-----------------------------------------------------------------------------+
 //  |  RenderCore::SetInstance                                                    |
 //  |  Set instance details.                                                LH2'19|